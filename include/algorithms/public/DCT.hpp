@@ -22,14 +22,18 @@ under the European Union’s Horizon 2020 research and innovation programme
 namespace fluid {
 namespace algorithm {
 
-class DCT
+// DCT-II in single (T = float) or double precision. The table is always
+// computed in double.
+template <typename T>
+class BasicDCT
 {
 public:
   using ArrayXd = Eigen::ArrayXd;
-  using MatrixXd = Eigen::MatrixXd;
+  using ArrayX = Eigen::Array<T, Eigen::Dynamic, 1>;
+  using MatrixX = Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>;
 
-  DCT(index maxInputSize, index maxOutputSize,
-      Allocator& alloc = FluidDefaultAllocator())
+  BasicDCT(index maxInputSize, index maxOutputSize,
+           Allocator& alloc = FluidDefaultAllocator())
       : mTable{maxOutputSize, maxInputSize, alloc}
   {}
 
@@ -56,12 +60,13 @@ public:
       double scale = i == 0 ? 1.0 / sqrt(inputSize) : sqrt(2.0 / inputSize);
       freqs = ((pi / inputSize) * i) *
               ArrayXd::LinSpaced(inputSize, 0.5, inputSize - 0.5);
-      mTable.topLeftCorner(outputSize, inputSize).row(i) = freqs.cos() * scale;
+      mTable.topLeftCorner(outputSize, inputSize).row(i) =
+          (freqs.cos() * scale).template cast<T>();
     }
     mInitialized = true;
   }
 
-  void processFrame(const RealVectorView in, RealVectorView out)
+  void processFrame(const FluidTensorView<T, 1> in, FluidTensorView<T, 1> out)
   {
     assert(mInitialized && "DCT: processFrame() called before init()");
     assert(in.size() == mInputSize &&
@@ -69,22 +74,24 @@ public:
     assert(out.size() == mOutputSize &&
            "DCT: actual output size doesn't maatch expected size");
 
-    FluidEigenMap<Eigen::Matrix> frame = _impl::asEigen<Eigen::Matrix>(in);
+    auto frame = _impl::asEigen<Eigen::Matrix>(in);
     _impl::asEigen<Eigen::Matrix>(out).noalias() =
         (mTable.topLeftCorner(mOutputSize, mInputSize) * frame);
   }
 
-  void processFrame(Eigen::Ref<const ArrayXd> input, Eigen::Ref<ArrayXd> output)
+  void processFrame(Eigen::Ref<const ArrayX> input, Eigen::Ref<ArrayX> output)
   {
     output.matrix().noalias() =
         (mTable.topLeftCorner(mOutputSize, mInputSize) * input.matrix());
   }
 
 private:
-  index                    mInputSize{40};
-  index                    mOutputSize{13};
-  bool                     mInitialized{false};
-  ScopedEigenMap<MatrixXd> mTable;
+  index                   mInputSize{40};
+  index                   mOutputSize{13};
+  bool                    mInitialized{false};
+  ScopedEigenMap<MatrixX> mTable;
 };
+
+using DCT = BasicDCT<double>;
 } // namespace algorithm
 } // namespace fluid
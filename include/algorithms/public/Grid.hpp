@@ -82,7 +82,7 @@ public:
     ArrayXd  yPos = yMin + (rowPos / (numRows - 1)) * (yMax - yMin);
     ArrayXXd grid(M, 2);
     grid << xPos, yPos;
-    ArrayXXd cost = algorithm::DistanceMatrix<ArrayXXd>(data, grid, 1);
+    ArrayXXd cost = algorithm::DistanceMatrix(data, grid, 1, 0);
     ArrayXidx  assignment(N);
     bool     outcome = assign2D.process(cost, assignment);
     if (!outcome) return DataSet();
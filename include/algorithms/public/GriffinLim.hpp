@@ -25,8 +25,10 @@ class GriffinLim
 {
 
 public:
+  // Each iteration's STFT and ISTFT are shared between up to maxThreads
+  // threads (0 for as many as the shared ThreadPool allows)
   void process(ComplexMatrixView in, index nSamples, index nIter, index winSize,
-               index fftSize, index hopSize)
+               index fftSize, index hopSize, index maxThreads = 1)
   {
     using namespace Eigen;
     using namespace _impl;
@@ -45,8 +47,8 @@ public:
     {
       prev = estimate;
       ArrayXXcd spectrogram = magnitude * phase;
-      istft.process(asFluid(spectrogram), asFluid(tmp));
-      stft.process(asFluid(tmp), asFluid(estimate));
+      istft.process(asFluid(spectrogram), asFluid(tmp), maxThreads);
+      stft.process(asFluid(tmp), asFluid(estimate), maxThreads);
       phase = estimate - (momentum / (1 + momentum)) * prev;
       phase = phase / (phase.abs() + epsilon);
     }
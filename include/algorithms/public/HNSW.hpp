@@ -0,0 +1,767 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+
+#pragma once
+
+#include "../util/DistanceFuncs.hpp"
+#include "../util/FluidEigenMappings.hpp"
+#include "../util/ParallelFor.hpp"
+#include "../../data/FluidDataSet.hpp"
+#include "../../data/FluidIndex.hpp"
+#include "../../data/FluidTensor.hpp"
+#include "../../data/TensorTypes.hpp"
+#include "../../data/FluidMemory.hpp"
+#include <Eigen/Core>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace fluid {
+namespace algorithm {
+
+// Approximate nearest neighbour search with a Hierarchical Navigable Small
+// World graph (Malkov & Yashunin, 2018). Each point is linked to its near
+// neighbours on the bottom layer and to a thinning random subset of points on
+// the layers above, which a query descends greedily before a beam search of
+// the bottom layer. Wider beams trade speed for recall. The query interface
+// mirrors KDTree so the two can be swapped.
+class HNSW
+{
+
+public:
+  using string = std::string;
+
+  using DataSet = FluidDataSet<string, double, 1>;
+  using ConstRealVectorView = FluidTensorView<const double, 1>;
+  using knnCandidate = std::pair<double, index>;
+  using KNNResult =
+      std::pair<rt::vector<double>, rt::vector<const std::string*>>;
+  using KNNIndexResult = std::pair<rt::vector<double>, rt::vector<index>>;
+  using Distance = DistanceFuncs::Distance;
+
+  static constexpr index defaultMaxConnections = 16;
+  static constexpr index defaultConstructionBeam = 100;
+  static constexpr index defaultSearchBeam = 50;
+
+  // Node i owns row i of data and ids and is row i of the DataSet the graph
+  // was fitted on. Row i of base holds the number of node i's neighbours on
+  // the bottom layer followed by up to 2 * maxConnections of them. A node
+  // whose level is l > 0 owns l consecutive rows of upper, in node order,
+  // laid out the same way for layers 1 to l with up to maxConnections
+  // neighbours each. With the cosine metric, data holds the fitted points
+  // scaled to unit norm.
+  struct FlatData
+  {
+    FluidTensor<index, 2>  base;
+    FluidTensor<index, 2>  upper;
+    FluidTensor<index, 1>  levels;
+    FluidTensor<string, 1> ids;
+    FluidTensor<double, 2> data;
+    index                  maxConnections{defaultMaxConnections};
+    index                  constructionBeam{defaultConstructionBeam};
+    index                  searchBeam{defaultSearchBeam};
+    index                  entryPoint{-1};
+    Distance               metric{Distance::kEuclidean};
+
+    FlatData(index n, index m, index maxConnections, index upperRows)
+        : base(n, 2 * maxConnections + 1), upper(upperRows, maxConnections + 1),
+          levels(n), ids(n), data(n, m), maxConnections(maxConnections)
+    {}
+  };
+
+  explicit HNSW() = default;
+  ~HNSW() = default;
+
+  // metric is one of DistanceFuncs::searchMetrics; cosine distances are
+  // found as Euclidean ones between points scaled to unit norm
+  HNSW(const DataSet& dataset, index maxConnections = defaultMaxConnections,
+       index constructionBeam = defaultConstructionBeam,
+       index searchBeam = defaultSearchBeam,
+       Distance metric = Distance::kEuclidean)
+      : mMaxConnections(std::max<index>(maxConnections, 2)),
+        mConstructionBeam(std::max<index>(constructionBeam, 1)),
+        mSearchBeam(std::max<index>(searchBeam, 1)), mMetric(metric)
+  {
+    reset(dataset.pointSize());
+    index n = dataset.size();
+    mScratch.visited.tags.reserve(asUnsigned(n));
+    mBase.resizeDim(0, n);
+    mLevels.resizeDim(0, n);
+    mIds.resizeDim(0, n);
+    mData.resizeDim(0, n);
+    mUpperStart.resize(asUnsigned(n));
+    index upperRows = 0;
+    for (index i = 0; i < n; i++)
+    {
+      mLevels(i) = randomLevel();
+      mUpperStart[asUnsigned(i)] = upperRows;
+      upperRows += mLevels(i);
+    }
+    mUpper.resizeDim(0, upperRows);
+    mBase.col(0).fill(0);
+    mUpper.col(0).fill(0);
+    mIds <<= dataset.getIds();
+    mData <<= dataset.getData();
+    if (mMetric == Distance::kCosine)
+      for (index i = 0; i < n; i++) normalize(mData.row(i));
+    withSearchMetric([this, n](auto metric) {
+      for (index i = 0; i < n; i++) insert(i, metric);
+    });
+    mInitialized = true;
+  }
+
+  void addNode(string id, ConstRealVectorView data)
+  {
+    if (mNPoints == 0) reset(data.size());
+    assert(data.size() == mDims);
+    index node = mNPoints;
+    index level = randomLevel();
+    mBase.resizeDim(0, 1);
+    mLevels.resizeDim(0, 1);
+    mIds.resizeDim(0, 1);
+    mData.resizeDim(0, 1);
+    mUpperStart.push_back(mUpper.rows());
+    mUpper.resizeDim(0, level);
+    mBase(node, 0) = 0;
+    for (index l = 1; l <= level; l++) mUpper(mUpper.rows() - l, 0) = 0;
+    mLevels(node) = level;
+    mIds(node) = id;
+    mData.row(node) <<= data;
+    if (mMetric == Distance::kCosine) normalize(mData.row(node));
+    withSearchMetric([this, node](auto metric) { insert(node, metric); });
+  }
+
+  // Approximate k nearest neighbours of data, nearest first. With a radius,
+  // only those within it are returned (all of those found if k is 0). The
+  // search beam is widened to k if needed; 0 uses the one set at fit.
+  KNNResult kNearest(ConstRealVectorView data, index k = 1, double radius = 0,
+                     Allocator& alloc = FluidDefaultAllocator(),
+                     index      searchBeam = 0) const
+  {
+    assert(data.size() == mDims);
+    QueryScratch scratch(beamFor(k, searchBeam) * mMaxConnections, alloc);
+    ScopedEigenMap<Eigen::ArrayXd> query(mDims, alloc);
+    search(data, query, scratch, k, radius, searchBeam);
+
+    auto&     queue = scratch.nearest;
+    KNNResult result =
+        std::make_pair(rt::vector<double>(queue.size(), alloc),
+                       rt::vector<const std::string*>(queue.size(), alloc));
+
+    std::for_each(queue.begin(), queue.end(),
+                  [this, &result, i = 0u](knnCandidate const& x) mutable {
+                    result.first[i] = x.first;
+                    result.second[i++] = &(mIds(x.second));
+                  });
+    return result;
+  }
+
+  // As above, but neighbours are given as rows of the DataSet the graph was
+  // fitted on rather than by id
+  KNNIndexResult kNearestIndices(ConstRealVectorView data, index k = 1,
+                                 double     radius = 0,
+                                 Allocator& alloc = FluidDefaultAllocator(),
+                                 index      searchBeam = 0) const
+  {
+    assert(data.size() == mDims);
+    QueryScratch scratch(beamFor(k, searchBeam) * mMaxConnections, alloc);
+    ScopedEigenMap<Eigen::ArrayXd> query(mDims, alloc);
+    search(data, query, scratch, k, radius, searchBeam);
+
+    auto&          queue = scratch.nearest;
+    KNNIndexResult result = std::make_pair(
+        rt::vector<double>(queue.size(), alloc),
+        rt::vector<index>(queue.size(), alloc));
+
+    std::for_each(queue.begin(), queue.end(),
+                  [&result, i = 0u](knnCandidate const& x) mutable {
+                    result.first[i] = x.first;
+                    result.second[i++] = x.second;
+                  });
+    return result;
+  }
+
+  // Batch query, laid out as KDTree's: row i of indices and distances
+  // receives the k nearest neighbours found for row i of points, with -1 and
+  // infinity in any unfilled slots
+  void kNearest(FluidTensorView<const double, 2> points, index k,
+                FluidTensorView<index, 2> indices,
+                FluidTensorView<double, 2> distances, index maxThreads = 0,
+                index searchBeam = 0) const
+  {
+    assert(points.cols() == mDims);
+    assert(indices.rows() == points.rows() && indices.cols() == k);
+    assert(distances.rows() == points.rows() && distances.cols() == k);
+    parallelFor(
+        points.rows(), 64,
+        [&](index start, index end) {
+          BatchScratch scratch(mNPoints, FluidDefaultAllocator());
+          ScopedEigenMap<Eigen::ArrayXd> query(mDims, FluidDefaultAllocator());
+          for (index i = start; i < end; i++)
+          {
+            search(points.row(i), query, scratch, k, 0, searchBeam);
+            auto& queue = scratch.nearest;
+            for (index j = 0; j < k; j++)
+            {
+              bool found = j < asSigned(queue.size());
+              indices(i, j) = found ? queue[asUnsigned(j)].second : -1;
+              distances(i, j) = found ? queue[asUnsigned(j)].first
+                                      : std::numeric_limits<double>::infinity();
+            }
+          }
+        },
+        maxThreads);
+  }
+
+  void kNearest(const DataSet& points, index k,
+                FluidTensorView<index, 2>  indices,
+                FluidTensorView<double, 2> distances, index maxThreads = 0,
+                index searchBeam = 0) const
+  {
+    kNearest(points.getData(), k, indices, distances, maxThreads, searchBeam);
+  }
+
+  // nodes are stored in fitted order already
+  void getIds(FluidTensorView<string, 1> out) const
+  {
+    assert(out.size() == mNPoints);
+    out <<= mIds;
+  }
+
+  // Copy of a DataSet sharing the graph's ids, reordered to match the DataSet
+  // the graph was fitted on. Returns false if any id is missing.
+  template <typename T>
+  bool alignToFitted(FluidDataSet<string, T, 1> const& in,
+                     FluidDataSet<string, T, 1>&       out) const
+  {
+    FluidTensor<T, 2> data(mNPoints, in.pointSize());
+    for (index i = 0; i < mNPoints; i++)
+    {
+      auto point = in.get(mIds(i));
+      if (point.data() == nullptr) return false;
+      data.row(i) <<= point;
+    }
+    out = FluidDataSet<string, T, 1>(mIds, data);
+    return true;
+  }
+
+  index dims() const { return mDims; }
+  index size() const { return mNPoints; }
+  bool  initialized() const { return mInitialized; }
+  index maxConnections() const { return mMaxConnections; }
+  index constructionBeam() const { return mConstructionBeam; }
+  index searchBeam() const { return mSearchBeam; }
+  Distance metric() const { return mMetric; }
+  void  setSearchBeam(index beam) { mSearchBeam = std::max<index>(beam, 1); }
+
+  void clear()
+  {
+    reset(0);
+    mMetric = Distance::kEuclidean;
+    mInitialized = false;
+  }
+
+  FlatData toFlat() const
+  {
+    FlatData store(0, 0, mMaxConnections, 0);
+    store.base = mBase;
+    store.upper = mUpper;
+    store.levels = mLevels;
+    store.ids = mIds;
+    store.data = mData;
+    store.constructionBeam = mConstructionBeam;
+    store.searchBeam = mSearchBeam;
+    store.entryPoint = mEntryPoint;
+    store.metric = mMetric;
+    return store;
+  }
+
+  // Returns false, leaving the graph as it was, if the parts don't describe a
+  // graph over the data (as from a corrupt file)
+  bool fromFlat(FlatData vectors)
+  {
+    if (!validGraph(vectors)) return false;
+    mMaxConnections = vectors.maxConnections;
+    mConstructionBeam = vectors.constructionBeam;
+    mSearchBeam = vectors.searchBeam;
+    mEntryPoint = vectors.entryPoint;
+    mMetric = vectors.metric;
+    mNPoints = vectors.data.rows();
+    mDims = vectors.data.cols();
+    mBase = std::move(vectors.base);
+    mUpper = std::move(vectors.upper);
+    mLevels = std::move(vectors.levels);
+    mIds = std::move(vectors.ids);
+    mData = std::move(vectors.data);
+    mUpperStart.resize(asUnsigned(mNPoints));
+    index upperRows = 0;
+    for (index i = 0; i < mNPoints; i++)
+    {
+      mUpperStart[asUnsigned(i)] = upperRows;
+      upperRows += mLevels(i);
+    }
+    mMaxLevel = mEntryPoint >= 0 ? mLevels(mEntryPoint) : 0;
+    mInitialized = true;
+    return true;
+  }
+
+private:
+  // The pass in which each node was last seen: costs a slot per node to set
+  // up but nothing to clear, so it pays off over the many searches of a build
+  // or a batch
+  template <typename IndexVector>
+  struct VisitedTags
+  {
+    IndexVector tags;
+    index       pass{0};
+
+    void clear() { ++pass; }
+
+    bool insert(index node)
+    {
+      index& tag = tags[asUnsigned(node)];
+      if (tag == pass) return false;
+      tag = pass;
+      return true;
+    }
+  };
+
+  // Open addressed set of the nodes seen by one search, so that a single
+  // query costs in proportion to what it visits rather than to the graph
+  struct VisitedSet
+  {
+    VisitedSet(index expected, Allocator& alloc)
+        : slots(asUnsigned(tableSize(expected)), -1, alloc)
+    {}
+
+    void clear()
+    {
+      std::fill(slots.begin(), slots.end(), -1);
+      count = 0;
+    }
+
+    bool insert(index node)
+    {
+      if (2 * (count + 1) > asSigned(slots.size())) grow();
+      if (!place(slots, node)) return false;
+      count++;
+      return true;
+    }
+
+  private:
+    static index tableSize(index expected)
+    {
+      index size = 16;
+      while (size < 2 * expected) size *= 2;
+      return size;
+    }
+
+    static bool place(rt::vector<index>& table, index node)
+    {
+      std::size_t mask = table.size() - 1;
+      std::size_t slot = static_cast<std::size_t>(
+                             (static_cast<std::uint64_t>(node) *
+                              0x9E3779B97F4A7C15ull) >> 32) & mask;
+      for (; table[slot] != -1; slot = (slot + 1) & mask)
+        if (table[slot] == node) return false;
+      table[slot] = node;
+      return true;
+    }
+
+    void grow()
+    {
+      rt::vector<index> larger(slots.size() * 2, -1, slots.get_allocator());
+      for (index node : slots)
+        if (node >= 0) place(larger, node);
+      slots.swap(larger);
+    }
+
+    rt::vector<index> slots;
+    index             count{0};
+  };
+
+  template <typename Visited, typename CandidateVector>
+  struct Scratch
+  {
+    Visited         visited;
+    CandidateVector candidates;
+    CandidateVector nearest;
+    CandidateVector selected;
+  };
+
+  using BuildScratch =
+      Scratch<VisitedTags<std::vector<index>>, std::vector<knnCandidate>>;
+
+  // for one query: expected is roughly how many nodes it will visit
+  struct QueryScratch : public Scratch<VisitedSet, rt::vector<knnCandidate>>
+  {
+    QueryScratch(index expected, Allocator& alloc)
+        : Scratch<VisitedSet, rt::vector<knnCandidate>>{
+              VisitedSet(expected, alloc), rt::vector<knnCandidate>(alloc),
+              rt::vector<knnCandidate>(alloc), rt::vector<knnCandidate>(alloc)}
+    {}
+  };
+
+  // for many queries of a graph with n nodes
+  struct BatchScratch
+      : public Scratch<VisitedTags<rt::vector<index>>, rt::vector<knnCandidate>>
+  {
+    BatchScratch(index n, Allocator& alloc)
+        : Scratch<VisitedTags<rt::vector<index>>, rt::vector<knnCandidate>>{
+              {rt::vector<index>(asUnsigned(n), 0, alloc), 0},
+              rt::vector<knnCandidate>(alloc), rt::vector<knnCandidate>(alloc),
+              rt::vector<knnCandidate>(alloc)}
+    {}
+  };
+
+  using Point = Eigen::Map<const Eigen::ArrayXd>;
+
+  void reset(index dims)
+  {
+    mDims = dims;
+    mNPoints = 0;
+    mEntryPoint = -1;
+    mMaxLevel = 0;
+    mBase = FluidTensor<index, 2>(0, 2 * mMaxConnections + 1);
+    mUpper = FluidTensor<index, 2>(0, mMaxConnections + 1);
+    mLevels = FluidTensor<index, 1>(0);
+    mIds = FluidTensor<string, 1>(0);
+    mData = FluidTensor<double, 2>(0, dims);
+    mUpperStart.clear();
+    mScratch = BuildScratch();
+    mRandom.seed(std::mt19937::default_seed);
+  }
+
+  // Every table has a row per node (and upper one per layer above the
+  // bottom), and every link list is in range and only names nodes that
+  // reach its layer, so that searches stay in bounds
+  static bool validGraph(FlatData const& g)
+  {
+    const index n = g.data.rows();
+    const index m = g.maxConnections;
+    if (m < 1 || g.constructionBeam < 1 || g.searchBeam < 1) return false;
+    if (g.ids.size() != n || g.levels.size() != n || g.base.rows() != n ||
+        g.base.cols() != 2 * m + 1 || g.upper.cols() != m + 1)
+      return false;
+    if (n == 0 ? g.entryPoint != -1 : g.entryPoint < 0 || g.entryPoint >= n)
+      return false;
+    index upperRows = 0;
+    for (index i = 0; i < n; i++)
+    {
+      if (g.levels(i) < 0 || g.levels(i) > g.upper.rows() - upperRows)
+        return false;
+      upperRows += g.levels(i);
+    }
+    if (upperRows != g.upper.rows()) return false;
+    auto validLinks = [&](FluidTensorView<const index, 1> links, index layer) {
+      if (links(0) < 0 || links(0) >= links.size()) return false;
+      for (index j = 1; j <= links(0); j++)
+        if (links(j) < 0 || links(j) >= n || g.levels(links(j)) < layer)
+          return false;
+      return true;
+    };
+    for (index i = 0, row = 0; i < n; i++)
+    {
+      if (!validLinks(g.base.row(i), 0)) return false;
+      for (index layer = 1; layer <= g.levels(i); layer++, row++)
+        if (!validLinks(g.upper.row(row), layer)) return false;
+    }
+    return true;
+  }
+
+  // level drawn from an exponential distribution, so that each layer holds
+  // roughly 1 / maxConnections of the points on the one below
+  index randomLevel()
+  {
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    double u = 1.0 - uniform(mRandom);
+    return static_cast<index>(-std::log(u) /
+                              std::log(static_cast<double>(mMaxConnections)));
+  }
+
+  index beamFor(index k, index searchBeam) const
+  {
+    return std::max(k, searchBeam > 0 ? searchBeam : mSearchBeam);
+  }
+
+  Point point(index node) const { return Point(mData.row(node).data(), mDims); }
+
+  // Calls f with the functor the graph is searched with. Euclidean and
+  // cosine searches compare squared Euclidean distances, which order points
+  // the same way, and take the root (or half, for cosine) at the end.
+  template <typename F>
+  void withSearchMetric(F&& f) const
+  {
+    switch (mMetric)
+    {
+    case Distance::kManhattan: f(DistanceFuncs::Manhattan{}); break;
+    case Distance::kMax: f(DistanceFuncs::Max{}); break;
+    default: f(DistanceFuncs::SqEuclidean{});
+    }
+  }
+
+  double fromSearchDistance(double d) const
+  {
+    switch (mMetric)
+    {
+    case Distance::kManhattan:
+    case Distance::kMax: return d;
+    case Distance::kCosine: return d / 2; // |x - y|^2 = 2 - 2 cos(x, y)
+    default: return std::sqrt(d);
+    }
+  }
+
+  template <typename Derived>
+  static void normalize(Eigen::ArrayBase<Derived>& p)
+  {
+    double norm = std::sqrt(p.square().sum());
+    if (norm > 0) p /= norm;
+  }
+
+  static void normalize(FluidTensorView<double, 1> point)
+  {
+    auto p = _impl::asEigen<Eigen::Array>(point);
+    normalize(p);
+  }
+
+  template <typename P, typename Metric>
+  double distance(index node, const P& p, const Metric& metric) const
+  {
+    return metric(point(node), p);
+  }
+
+  FluidTensorView<const index, 1> links(index node, index layer) const
+  {
+    if (layer == 0) return mBase.row(node);
+    return mUpper.row(mUpperStart[asUnsigned(node)] + layer - 1);
+  }
+
+  FluidTensorView<index, 1> links(index node, index layer)
+  {
+    if (layer == 0) return mBase.row(node);
+    return mUpper.row(mUpperStart[asUnsigned(node)] + layer - 1);
+  }
+
+  index maxLinks(index layer) const
+  {
+    return layer == 0 ? 2 * mMaxConnections : mMaxConnections;
+  }
+
+  // node's data, level and empty link rows are already in place
+  template <typename Metric>
+  void insert(index node, const Metric& metric)
+  {
+    const index level = mLevels(node);
+    mNPoints = node + 1;
+    mScratch.visited.tags.resize(asUnsigned(mNPoints), 0);
+    if (mEntryPoint < 0)
+    {
+      mEntryPoint = node;
+      mMaxLevel = level;
+      return;
+    }
+    const Point q = point(node);
+    index       entry = mEntryPoint;
+    double      entryDistance = distance(entry, q, metric);
+    for (index l = mMaxLevel; l > level; l--)
+      greedySearch(q, entry, entryDistance, l, metric);
+    for (index l = std::min(level, mMaxLevel); l >= 0; l--)
+    {
+      searchLayer(q, entry, entryDistance, mConstructionBeam, l, mScratch,
+                  metric);
+      std::sort_heap(mScratch.nearest.begin(), mScratch.nearest.end());
+      selectNeighbours(mScratch.nearest, mMaxConnections, mScratch.selected,
+                       metric);
+      auto nodeLinks = links(node, l);
+      nodeLinks(0) = asSigned(mScratch.selected.size());
+      for (index i = 0; i < asSigned(mScratch.selected.size()); i++)
+        nodeLinks(i + 1) = mScratch.selected[asUnsigned(i)].second;
+      entry = mScratch.nearest[0].second;
+      entryDistance = mScratch.nearest[0].first;
+      for (auto& neighbour : mScratch.selected)
+        connect(neighbour.second, node, neighbour.first, l, metric);
+    }
+    if (level > mMaxLevel)
+    {
+      mMaxLevel = level;
+      mEntryPoint = node;
+    }
+  }
+
+  // link from to to on layer, re-selecting from's neighbours if it is full
+  template <typename Metric>
+  void connect(index from, index to, double toDistance, index layer,
+               const Metric& metric)
+  {
+    auto  fromLinks = links(from, layer);
+    index count = fromLinks(0);
+    if (count < maxLinks(layer))
+    {
+      fromLinks(count + 1) = to;
+      fromLinks(0) = count + 1;
+      return;
+    }
+    auto& candidates = mScratch.candidates;
+    candidates.clear();
+    candidates.emplace_back(toDistance, to);
+    const Point p = point(from);
+    for (index i = 1; i <= count; i++)
+      candidates.emplace_back(distance(fromLinks(i), p, metric), fromLinks(i));
+    std::sort(candidates.begin(), candidates.end());
+    auto& kept = mScratch.nearest; // free until the next layer's search
+    selectNeighbours(candidates, maxLinks(layer), kept, metric);
+    fromLinks(0) = asSigned(kept.size());
+    for (index i = 0; i < asSigned(kept.size()); i++)
+      fromLinks(i + 1) = kept[asUnsigned(i)].second;
+  }
+
+  // Keeps a candidate (sorted nearest first) only if it is nearer the query
+  // than to any already kept, which favours links in different directions
+  // over clusters of redundant ones
+  template <typename CandidateVector, typename Metric>
+  void selectNeighbours(CandidateVector const& candidates, index m,
+                        std::vector<knnCandidate>& out,
+                        const Metric&              metric) const
+  {
+    out.clear();
+    for (auto& c : candidates)
+    {
+      if (asSigned(out.size()) >= m) break;
+      const Point p = point(c.second);
+      bool        keep = std::none_of(out.begin(), out.end(), [&](auto& r) {
+        return distance(r.second, p, metric) < c.first;
+      });
+      if (keep) out.push_back(c);
+    }
+  }
+
+  template <typename P, typename Metric>
+  void greedySearch(const P& q, index& entry, double& entryDistance,
+                    index layer, const Metric& metric) const
+  {
+    bool changed = true;
+    while (changed)
+    {
+      changed = false;
+      auto nodeLinks = links(entry, layer);
+      for (index i = 1; i <= nodeLinks(0); i++)
+      {
+        double d = distance(nodeLinks(i), q, metric);
+        if (d < entryDistance)
+        {
+          entryDistance = d;
+          entry = nodeLinks(i);
+          changed = true;
+        }
+      }
+    }
+  }
+
+  // beam search of one layer from entry, leaving the (up to) beam nearest
+  // nodes found in scratch.nearest as a max heap
+  template <typename P, typename S, typename Metric>
+  void searchLayer(const P& q, index entry, double entryDistance, index beam,
+                   index layer, S& scratch, const Metric& metric) const
+  {
+    auto& candidates = scratch.candidates;
+    auto& nearest = scratch.nearest;
+    auto& visited = scratch.visited;
+    std::greater<knnCandidate> closerFirst;
+    candidates.clear();
+    nearest.clear();
+    visited.clear();
+    candidates.emplace_back(entryDistance, entry);
+    nearest.emplace_back(entryDistance, entry);
+    visited.insert(entry);
+    while (!candidates.empty())
+    {
+      std::pop_heap(candidates.begin(), candidates.end(), closerFirst);
+      knnCandidate current = candidates.back();
+      candidates.pop_back();
+      if (current.first > nearest.front().first &&
+          asSigned(nearest.size()) >= beam)
+        break;
+      auto nodeLinks = links(current.second, layer);
+      for (index i = 1; i <= nodeLinks(0); i++)
+      {
+        index neighbour = nodeLinks(i);
+        if (!visited.insert(neighbour)) continue;
+        double d = distance(neighbour, q, metric);
+        if (asSigned(nearest.size()) < beam || d < nearest.front().first)
+        {
+          candidates.emplace_back(d, neighbour);
+          std::push_heap(candidates.begin(), candidates.end(), closerFirst);
+          nearest.emplace_back(d, neighbour);
+          std::push_heap(nearest.begin(), nearest.end());
+          if (asSigned(nearest.size()) > beam)
+          {
+            std::pop_heap(nearest.begin(), nearest.end());
+            nearest.pop_back();
+          }
+        }
+      }
+    }
+  }
+
+  // leaves the (up to) k nearest nodes to data in scratch.nearest, nearest
+  // first, as distances; query is scratch for a contiguous copy of data
+  template <typename S>
+  void search(ConstRealVectorView data, ScopedEigenMap<Eigen::ArrayXd>& query,
+              S& scratch, index k, double radius, index searchBeam) const
+  {
+    auto& nearest = scratch.nearest;
+    nearest.clear();
+    if (mNPoints == 0) return;
+    query = _impl::asEigen<Eigen::Array>(data).col(0);
+    if (mMetric == Distance::kCosine) normalize(query);
+    Eigen::Map<const Eigen::ArrayXd> q(query.data(), mDims);
+    index beam = beamFor(k, searchBeam);
+    withSearchMetric([&](auto metric) {
+      index  entry = mEntryPoint;
+      double entryDistance = distance(entry, q, metric);
+      for (index l = mMaxLevel; l > 0; l--)
+        greedySearch(q, entry, entryDistance, l, metric);
+      searchLayer(q, entry, entryDistance, beam, 0, scratch, metric);
+    });
+    std::sort_heap(nearest.begin(), nearest.end());
+    if (k > 0 && asSigned(nearest.size()) > k) nearest.resize(asUnsigned(k));
+    for (auto& x : nearest) x.first = fromSearchDistance(x.first);
+    if (radius > 0)
+      nearest.erase(std::find_if(nearest.begin(), nearest.end(),
+                                 [radius](auto& x) { return x.first > radius; }),
+                    nearest.end());
+  }
+
+  index                  mMaxConnections{defaultMaxConnections};
+  index                  mConstructionBeam{defaultConstructionBeam};
+  index                  mSearchBeam{defaultSearchBeam};
+  index                  mDims{0};
+  index                  mNPoints{0};
+  index                  mEntryPoint{-1};
+  index                  mMaxLevel{0};
+  Distance               mMetric{Distance::kEuclidean};
+  bool                   mInitialized{false};
+  FluidTensor<index, 2>  mBase;
+  FluidTensor<index, 2>  mUpper;
+  FluidTensor<index, 1>  mLevels;
+  FluidTensor<string, 1> mIds;
+  FluidTensor<double, 2> mData;
+  std::vector<index>     mUpperStart;
+  BuildScratch           mScratch;
+  std::mt19937           mRandom;
+};
+
+} // namespace algorithm
+} // namespace fluid
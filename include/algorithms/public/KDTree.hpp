@@ -10,16 +10,21 @@ under the European Union’s Horizon 2020 research and innovation programme
 
 #pragma once
 
+#include "../util/DistanceFuncs.hpp"
 #include "../util/FluidEigenMappings.hpp"
+#include "../util/ParallelFor.hpp"
 #include "../../data/FluidDataSet.hpp"
 #include "../../data/FluidIndex.hpp"
 #include "../../data/FluidTensor.hpp"
 #include "../../data/TensorTypes.hpp"
 #include "../../data/FluidMemory.hpp"
 #include <Eigen/Core>
+#include <algorithm>
+#include <limits>
+#include <numeric>
 #include <queue>
-#include <memory>
 #include <string>
+#include <vector>
 
 namespace fluid {
 namespace algorithm {
@@ -32,33 +37,46 @@ public:
 
   using DataSet = FluidDataSet<string, double, 1>;
   using ConstRealVectorView = FluidTensorView<const double, 1>;
-  struct Node;
-  using NodePtr = std::shared_ptr<Node>;
-  using knnCandidate = std::pair<double, const Node*>;
+  using knnCandidate = std::pair<double, index>;
   using knnQueue = rt::vector<knnCandidate>;
   using KNNResult =
       std::pair<rt::vector<double>, rt::vector<const std::string*>>;
+  using KNNIndexResult = std::pair<rt::vector<double>, rt::vector<index>>;
   using iterator = const std::vector<index>::iterator;
+  using Distance = DistanceFuncs::Distance;
 
-  struct Node
-  {
-    const string     id;
-    const RealVector data;
-    NodePtr          left{nullptr}, right{nullptr};
-  };
+  static constexpr index defaultLeafSize = 8;
 
+  // Node i owns row i of data and ids. A fitted tree stores its nodes in
+  // depth-first order; addNode appends each new node after them as a
+  // single-point leaf, linked from wherever its descent ends, so later rows
+  // need not follow their parents. Row i of tree holds the offsets of its
+  // left and right children (-1 for none), the dimension it splits on, the
+  // size of its bucket (node i and the following bucket - 1 rows are scanned
+  // together when it is visited) and the point's row in the DataSet the tree
+  // was fitted on, or its order of addition for added nodes.
+  // Narrower trees from older files split on depth % dims with no buckets,
+  // and take their node order as the fitted order.
+  // With the cosine metric, data holds the fitted points scaled to unit norm.
   struct FlatData
   {
     FluidTensor<index, 2>  tree;
     FluidTensor<string, 1> ids;
     FluidTensor<double, 2> data;
-    FlatData(index n, index m) : tree(n, 2), ids(n), data(n, m) {}
+    Distance               metric{Distance::kEuclidean};
+    FlatData(index n, index m) : tree(n, 5), ids(n), data(n, m) {}
   };
 
   explicit KDTree() = default;
   ~KDTree() = default;
 
-  KDTree(const DataSet& dataset)
+  // metric is one of DistanceFuncs::searchMetrics. Manhattan and Max
+  // (Chebyshev) distances prune the same way as Euclidean; cosine distances
+  // are found as Euclidean ones between points scaled to unit norm.
+  KDTree(const DataSet& dataset, index leafSize = defaultLeafSize,
+         Distance metric = Distance::kEuclidean)
+      : mTree(dataset.size(), kNumColumns), mIds(dataset.size()),
+        mData(dataset.size(), dataset.pointSize()), mMetric(metric)
   {
     using namespace std;
     mNPoints = dataset.size();
@@ -67,14 +85,60 @@ public:
     {
       vector<index> indices(asUnsigned(dataset.size()));
       iota(indices.begin(), indices.end(), 0);
-      mRoot = buildTree(indices, indices.begin(), indices.end(), dataset, 0);
+      index nextNode = 0;
+      if (mMetric == Distance::kCosine)
+      {
+        FluidTensor<double, 2> unit(dataset.getData());
+        for (index i = 0; i < mNPoints; i++) normalize(unit.row(i));
+        buildTree(indices, indices.begin(), indices.end(),
+                  DataSet(dataset.getIds(), unit),
+                  std::max<index>(leafSize, 1), nextNode);
+      }
+      else
+        buildTree(indices, indices.begin(), indices.end(), dataset,
+                  std::max<index>(leafSize, 1), nextNode);
     }
     mInitialized = true;
   }
 
   void addNode(string id, ConstRealVectorView data)
   {
-    mRoot = addNode(mRoot.get(), id, data, 0);
+    if (mNPoints == 0)
+    {
+      mDims = data.size();
+      mTree = FluidTensor<index, 2>(0, kNumColumns);
+      mIds = FluidTensor<string, 1>(0);
+      mData = FluidTensor<double, 2>(0, mDims);
+    }
+    assert(data.size() == mDims);
+    index node = mNPoints;
+    mTree.resizeDim(0, 1);
+    mIds.resizeDim(0, 1);
+    mData.resizeDim(0, 1);
+    mTree(node, kLeft) = -1;
+    mTree(node, kRight) = -1;
+    mTree(node, kSplit) = 0;
+    mTree(node, kBucket) = 1;
+    mTree(node, kIndex) = node;
+    mIds(node) = id;
+    mData.row(node) <<= data;
+    if (mMetric == Distance::kCosine) normalize(mData.row(node));
+    if (node > 0)
+    {
+      index current = 0;
+      while (true)
+      {
+        const index d = mTree(current, kSplit);
+        index side = mData(node, d) < mData(current, d) ? kLeft : kRight;
+        if (mTree(current, side) == -1)
+        {
+          mTree(current, side) = node;
+          mTree(node, kSplit) = (d + 1) % mDims;
+          break;
+        }
+        current = mTree(current, side);
+      }
+    }
     mNPoints++;
   }
 
@@ -85,193 +149,389 @@ public:
     rt::vector<knnCandidate> queue(alloc);
     if (k > 0) queue.reserve(asUnsigned(k));
 
-    kNearest(mRoot.get(), data, queue, k, radius, 0);
-    std::sort_heap(queue.begin(), queue.end());
+    ScopedEigenMap<Eigen::ArrayXd> query(mDims, alloc);
+    search(data, query, queue, k, radius);
 
     KNNResult result =
         std::make_pair(rt::vector<double>(queue.size(), alloc),
                        rt::vector<const std::string*>(queue.size(), alloc));
 
     std::for_each(queue.begin(), queue.end(),
-                  [&result, i = 0u](knnCandidate const& x) mutable {
+                  [this, &result, i = 0u](knnCandidate const& x) mutable {
+                    result.first[i] = x.first;
+                    result.second[i++] = &(mIds(x.second));
+                  });
+    return result;
+  }
+
+  // As above, but neighbours are given as rows of the DataSet the tree was
+  // fitted on rather than by id
+  KNNIndexResult kNearestIndices(ConstRealVectorView data, index k = 1,
+                                 double     radius = 0,
+                                 Allocator& alloc = FluidDefaultAllocator()) const
+  {
+    assert(data.size() == mDims);
+    rt::vector<knnCandidate> queue(alloc);
+    if (k > 0) queue.reserve(asUnsigned(k));
+
+    ScopedEigenMap<Eigen::ArrayXd> query(mDims, alloc);
+    search(data, query, queue, k, radius);
+
+    KNNIndexResult result = std::make_pair(
+        rt::vector<double>(queue.size(), alloc),
+        rt::vector<index>(queue.size(), alloc));
+
+    std::for_each(queue.begin(), queue.end(),
+                  [this, &result, i = 0u](knnCandidate const& x) mutable {
                     result.first[i] = x.first;
-                    result.second[i++] = &(x.second->id);
+                    result.second[i++] = mTree(x.second, kIndex);
                   });
     return result;
   }
 
-  void  print() const { print(mRoot.get(), 0); }
-  index dims() const { return mDims; }
-  index size() const { return mNPoints; }
-  bool  initialized() const { return mInitialized; }
+  // Batch query: row i of indices and distances receives the k nearest
+  // neighbours of row i of points, nearest first, given as rows of the
+  // DataSet the tree was fitted on. Unfilled slots (k > size()) get -1 and
+  // infinity. Queries are shared between up to maxThreads threads (0 for one
+  // per hardware thread).
+  void kNearest(FluidTensorView<const double, 2> points, index k,
+                FluidTensorView<index, 2> indices,
+                FluidTensorView<double, 2> distances,
+                index                      maxThreads = 0) const
+  {
+    assert(points.cols() == mDims);
+    assert(indices.rows() == points.rows() && indices.cols() == k);
+    assert(distances.rows() == points.rows() && distances.cols() == k);
+    parallelFor(
+        points.rows(), 64,
+        [&](index start, index end) {
+          rt::vector<knnCandidate>       queue(FluidDefaultAllocator());
+          ScopedEigenMap<Eigen::ArrayXd> query(mDims, FluidDefaultAllocator());
+          queue.reserve(asUnsigned(k));
+          for (index i = start; i < end; i++)
+          {
+            queue.clear();
+            search(points.row(i), query, queue, k, 0);
+            for (index j = 0; j < k; j++)
+            {
+              bool found = j < asSigned(queue.size());
+              indices(i, j) =
+                  found ? mTree(queue[asUnsigned(j)].second, kIndex) : -1;
+              distances(i, j) = found ? queue[asUnsigned(j)].first
+                                      : std::numeric_limits<double>::infinity();
+            }
+          }
+        },
+        maxThreads);
+  }
+
+  void kNearest(const DataSet& points, index k,
+                FluidTensorView<index, 2>  indices,
+                FluidTensorView<double, 2> distances,
+                index                      maxThreads = 0) const
+  {
+    kNearest(points.getData(), k, indices, distances, maxThreads);
+  }
+
+  // ids in the order of the DataSet the tree was fitted on
+  void getIds(FluidTensorView<string, 1> out) const
+  {
+    assert(out.size() == mNPoints);
+    for (index i = 0; i < mNPoints; i++) out(mTree(i, kIndex)) = mIds(i);
+  }
+
+  // points in the order of the DataSet the tree was fitted on (scaled to unit
+  // norm with the cosine metric)
+  void getData(FluidTensorView<double, 2> out) const
+  {
+    assert(out.rows() == mNPoints && out.cols() == mDims);
+    for (index i = 0; i < mNPoints; i++)
+      out.row(mTree(i, kIndex)) <<= mData.row(i);
+  }
+
+  // Copy of a DataSet sharing the tree's ids, reordered to match the DataSet
+  // the tree was fitted on, so that neighbour rows index it directly. Returns
+  // false if any id is missing.
+  template <typename T>
+  bool alignToFitted(FluidDataSet<string, T, 1> const& in,
+                     FluidDataSet<string, T, 1>&       out) const
+  {
+    FluidTensor<string, 1> ids(mNPoints);
+    FluidTensor<T, 2>      data(mNPoints, in.pointSize());
+    getIds(ids);
+    for (index i = 0; i < mNPoints; i++)
+    {
+      auto point = in.get(ids(i));
+      if (point.data() == nullptr) return false;
+      data.row(i) <<= point;
+    }
+    out = FluidDataSet<string, T, 1>(ids, data);
+    return true;
+  }
+
+  void  print() const { print(mNPoints > 0 ? 0 : -1, 0); }
+  index    dims() const { return mDims; }
+  index    size() const { return mNPoints; }
+  bool     initialized() const { return mInitialized; }
+  Distance metric() const { return mMetric; }
 
   void clear()
   {
-    mRoot = nullptr;
-    mNPoints = 0; 
-    mDims = 0; 
+    mTree = FluidTensor<index, 2>(0, kNumColumns);
+    mIds = FluidTensor<string, 1>(0);
+    mData = FluidTensor<double, 2>(0, 0);
+    mNPoints = 0;
+    mDims = 0;
+    mMetric = Distance::kEuclidean;
     mInitialized = false;
   }
 
   FlatData toFlat() const
   {
-    FlatData store(mNPoints, mDims);
-    flatten(0, mRoot.get(), store);
+    FlatData store(0, 0);
+    store.tree = mTree;
+    store.ids = mIds;
+    store.data = mData;
+    store.metric = mMetric;
     return store;
   }
 
-  void fromFlat(FlatData vectors)
+  // Returns false, leaving the tree as it was, if the parts don't describe a
+  // tree over the data (as from a corrupt file)
+  bool fromFlat(FlatData vectors)
   {
-    mRoot = unflatten(vectors, 0);
-    mNPoints = vectors.data.rows();
-    mDims = vectors.data.cols();
+    const index n = vectors.data.rows();
+    const index dims = vectors.data.cols();
+    if (vectors.ids.size() != n || vectors.tree.rows() != n ||
+        vectors.tree.cols() <= kRight)
+      return false;
+    const bool legacySplits = vectors.tree.cols() <= kSplit;
+    if (vectors.tree.cols() < kNumColumns)
+    {
+      index                 legacyCols = vectors.tree.cols();
+      FluidTensor<index, 2> tree(n, kNumColumns);
+      for (index c = 0; c < legacyCols; c++)
+        tree.col(c) <<= vectors.tree.col(c);
+      if (legacySplits) tree.col(kBucket).fill(1);
+      for (index i = 0; i < n; i++) tree(i, kIndex) = i;
+      vectors.tree = std::move(tree);
+    }
+    if (!validTree(vectors.tree, dims)) return false;
+    mNPoints = n;
+    mDims = dims;
+    mTree = std::move(vectors.tree);
+    mIds = std::move(vectors.ids);
+    mData = std::move(vectors.data);
+    mMetric = vectors.metric;
+    if (legacySplits && mNPoints > 0 && mDims > 0) setLegacySplits(0, 0);
     mInitialized = true;
+    return true;
   }
 
 private:
-  NodePtr buildTree(std::vector<index>& indices, iterator from, iterator to,
-                    const DataSet& dataset, index depth) const
+  enum { kLeft, kRight, kSplit, kBucket, kIndex, kNumColumns };
+
+  index buildTree(std::vector<index>& indices, iterator from, iterator to,
+                  const DataSet& dataset, index leafSize, index& nextNode)
   {
     using namespace std;
-    if (from == to)
-      return nullptr;
-    else if (std::distance(from, to) == 1)
+    if (from == to) return -1;
+    auto        points = dataset.getData();
+    const index range = std::distance(from, to);
+    const index d = widestDimension(from, to, points);
+    const index current = nextNode;
+    if (range <= leafSize)
     {
-      return makeNode(dataset.getIds()(*from), dataset.getData().row(*from));
+      for (auto i = from; i != to; ++i, ++nextNode)
+      {
+        mIds(nextNode) = dataset.getIds()(*i);
+        mData.row(nextNode) <<= points.row(*i);
+        mTree.row(nextNode).fill(-1);
+        mTree(nextNode, kSplit) = d;
+        mTree(nextNode, kBucket) = 0;
+        mTree(nextNode, kIndex) = *i;
+      }
+      mTree(current, kBucket) = range;
+      return current;
     }
-    const index d = depth % mDims;
-    sort(from, to, [&](index a, index b) {
-      return dataset.getData().row(a)(d) < dataset.getData().row(b)(d);
-    });
-    const index range = std::distance(from, to);
     const index median = range / 2;
-    NodePtr     current = makeNode(dataset.getIds().row(*(from + median)),
-                               dataset.getData().row(*(from + median)));
-    if (median > 0)
-      current->left =
-          buildTree(indices, from, from + median, dataset, depth + 1);
-    if (range - median > 1)
-      current->right =
-          buildTree(indices, from + median + 1, to, dataset, depth + 1);
+    nth_element(from, from + median, to,
+                [&](index a, index b) { return points(a, d) < points(b, d); });
+    nextNode++;
+    mIds(current) = dataset.getIds()(*(from + median));
+    mData.row(current) <<= points.row(*(from + median));
+    mTree(current, kSplit) = d;
+    mTree(current, kBucket) = 1;
+    mTree(current, kIndex) = *(from + median);
+    mTree(current, kLeft) =
+        buildTree(indices, from, from + median, dataset, leafSize, nextNode);
+    mTree(current, kRight) = buildTree(indices, from + median + 1, to, dataset,
+                                       leafSize, nextNode);
     return current;
   }
 
-  NodePtr makeNode(string id, ConstRealVectorView data) const
+  // fills queue with the (up to) k nearest nodes to data, nearest first,
+  // using query as scratch for a contiguous copy so bucket scans vectorise
+  void search(ConstRealVectorView data, ScopedEigenMap<Eigen::ArrayXd>& query,
+              knnQueue& queue, index k, double radius) const
   {
-    return std::make_shared<Node>(Node{id, RealVector{data}, nullptr, nullptr});
+    if (mNPoints > 0)
+    {
+      query = _impl::asEigen<Eigen::Array>(data).col(0);
+      Eigen::Map<const Eigen::ArrayXd> q(query.data(), mDims);
+      switch (mMetric)
+      {
+      case Distance::kManhattan:
+        kNearest(0, q, queue, k, radius, DistanceFuncs::Manhattan{});
+        break;
+      case Distance::kMax:
+        kNearest(0, q, queue, k, radius, DistanceFuncs::Max{});
+        break;
+      case Distance::kCosine:
+        // |x - y|^2 = 2 - 2 cos(x, y) for unit x and y
+        normalize(query);
+        kNearest(0, q, queue, k, std::sqrt(2 * radius),
+                 DistanceFuncs::Euclidean{});
+        for (auto& x : queue) x.first = x.first * x.first / 2;
+        break;
+      default: kNearest(0, q, queue, k, radius, DistanceFuncs::Euclidean{});
+      }
+    }
+    std::sort_heap(queue.begin(), queue.end());
   }
 
-  NodePtr addNode(Node* current, string id, ConstRealVectorView data,
-                  const index depth) const
+  template <typename Derived>
+  static void normalize(Eigen::ArrayBase<Derived>& point)
   {
-    if (current == nullptr) { return makeNode(id, data); }
+    double norm = std::sqrt(point.square().sum());
+    if (norm > 0) point /= norm;
+  }
 
-    const index d = depth % mDims;
-    if (data(d) < current->data(d))
-    { current->left = addNode(current->left.get(), id, data, depth + 1); }
-    else
+  static void normalize(FluidTensorView<double, 1> point)
+  {
+    auto p = _impl::asEigen<Eigen::Array>(point);
+    normalize(p);
+  }
+
+  index widestDimension(iterator from, iterator to,
+                        FluidTensorView<const double, 2> points) const
+  {
+    using namespace Eigen;
+    ArrayXd lo = Map<const ArrayXd>(points.row(*from).data(), mDims);
+    ArrayXd hi = lo;
+    for (auto i = from + 1; i < to; ++i)
     {
-      current->right = addNode(current->right.get(), id, data, depth + 1);
+      Map<const ArrayXd> p(points.row(*i).data(), mDims);
+      lo = lo.min(p);
+      hi = hi.max(p);
     }
-    return NodePtr(current);
+    index widest;
+    (hi - lo).maxCoeff(&widest);
+    return widest;
   }
 
-  double distance(ConstRealVectorView p1, ConstRealVectorView p2) const
+  // Children come after their parents, in range, so that walking the tree
+  // ends; buckets, splits and fitted rows are in range too
+  bool validTree(FluidTensorView<const index, 2> tree, index dims) const
   {
-    using namespace Eigen;
-    auto v1 = _impl::asEigen<Array>(p1);
-    auto v2 = _impl::asEigen<Array>(p2);
-    return (v1 - v2).matrix().norm();
+    const index       n = tree.rows();
+    std::vector<bool> fitted(asUnsigned(n), false);
+    for (index i = 0; i < n; i++)
+    {
+      auto node = tree.row(i);
+      for (index child : {node(kLeft), node(kRight)})
+        if (child != -1 && (child <= i || child >= n)) return false;
+      if (node(kBucket) < 0 || node(kBucket) > n - i) return false;
+      if (node(kSplit) < 0 || node(kSplit) >= dims) return false;
+      if (node(kIndex) < 0 || node(kIndex) >= n ||
+          fitted[asUnsigned(node(kIndex))])
+        return false;
+      fitted[asUnsigned(node(kIndex))] = true;
+    }
+    return true;
   }
 
-  void print(Node* current, index depth) const
+  void setLegacySplits(index current, index depth)
+  {
+    if (current == -1) return;
+    mTree(current, kSplit) = depth % mDims;
+    setLegacySplits(mTree(current, kLeft), depth + 1);
+    setLegacySplits(mTree(current, kRight), depth + 1);
+  }
+
+
+  void print(index current, index depth) const
   {
     for (index i = 0; i < depth; ++i) std::cout << "  ";
-    if (current == nullptr)
+    if (current == -1)
     {
       std::cout << " null" << std::endl;
       return;
     }
-    std::cout << " " << current->id << std::endl;
+    std::cout << " " << mIds(current);
+    for (index i = 1; i < mTree(current, kBucket); ++i)
+      std::cout << " " << mIds(current + i);
+    std::cout << std::endl;
     for (index i = 0; i < depth; ++i) std::cout << "  ";
     std::cout << " left" << std::endl;
-    print(current->left.get(), depth + 1);
+    print(mTree(current, kLeft), depth + 1);
     for (index i = 0; i < depth; ++i) std::cout << "  ";
     std::cout << " right" << std::endl;
-    print(current->right.get(), depth + 1);
-  }
-
-  void kNearest(const Node* current, ConstRealVectorView data, knnQueue& knn,
-                index k, double radius, index depth) const
-  {
-    if (current == nullptr) return;
-    const double currentDist = distance(current->data, data);
-    bool         withinRadius = radius > 0 ? currentDist < radius : true;
-    if (withinRadius && (knn.size() < asUnsigned(k) || k == 0))
-    {
-      knn.push_back(std::make_pair(currentDist, current));
-      std::push_heap(knn.begin(), knn.end());
-    }
-    else if (withinRadius && currentDist < knn.front().first)
-    {
-      std::pop_heap(knn.begin(), knn.end());
-      knn.back() = std::make_pair(currentDist, current);
-      std::push_heap(knn.begin(), knn.end());
-    }
-    const index  d = depth % mDims;
-    const double dimDif = current->data(d) - data(d);
-    Node*        firstBranch = current->left.get();
-    Node*        secondBranch = current->right.get();
-    if (dimDif <= 0)
-    {
-      firstBranch = current->right.get();
-      secondBranch = current->left.get();
-    }
-    kNearest(firstBranch, data, knn, k, radius, depth + 1);
-    if (k == 0 || knn.size() < asUnsigned(k) ||
-        dimDif < knn.front().first) // ball centered at query with diametre
-                                    // kthDist intersects with current partition
-                                    // (or need to get more neighbors)
-    {
-      kNearest(secondBranch, data, knn, k, radius, depth + 1);
-    }
+    print(mTree(current, kRight), depth + 1);
   }
 
-  index flatten(index nodeId, const Node* current, FlatData& store) const
+  // Any distance at least as large as the gap along a single dimension can
+  // prune by the distance to the splitting plane
+  template <typename Metric>
+  void kNearest(index current, const Eigen::Map<const Eigen::ArrayXd>& data,
+                knnQueue& knn, index k, double radius,
+                const Metric& metric) const
   {
-    if (current == nullptr) { return nodeId; }
-    store.ids(nodeId) = current->id;
-    store.data.row(nodeId) <<= current->data;
-
-    index nextNodeId = nodeId + 1;
-    if (current->left == nullptr) { store.tree(nodeId, 0) = -1; }
-    else
+    if (current == -1) return;
+    const index bucketEnd = current + mTree(current, kBucket);
+    for (index i = current; i < bucketEnd; ++i)
     {
-      store.tree(nodeId, 0) = nextNodeId;
-      nextNodeId = flatten(nextNodeId, current->left.get(), store);
+      const double currentDist =
+          metric(Eigen::Map<const Eigen::ArrayXd>(mData.row(i).data(), mDims),
+                 data);
+      bool         withinRadius = radius > 0 ? currentDist < radius : true;
+      if (withinRadius && (knn.size() < asUnsigned(k) || k == 0))
+      {
+        knn.push_back(std::make_pair(currentDist, i));
+        std::push_heap(knn.begin(), knn.end());
+      }
+      else if (withinRadius && currentDist < knn.front().first)
+      {
+        std::pop_heap(knn.begin(), knn.end());
+        knn.back() = std::make_pair(currentDist, i);
+        std::push_heap(knn.begin(), knn.end());
+      }
     }
-    if (current->right == nullptr) { store.tree(nodeId, 1) = -1; }
-    else
+    index firstBranch = mTree(current, kLeft);
+    index secondBranch = mTree(current, kRight);
+    if (firstBranch == -1 && secondBranch == -1) return;
+    const index  d = mTree(current, kSplit);
+    const double dimDif = mData(current, d) - data(d);
+    if (dimDif <= 0) std::swap(firstBranch, secondBranch);
+    kNearest(firstBranch, data, knn, k, radius, metric);
+    // ball centered at query with diametre kthDist intersects with the
+    // splitting plane (or need to get more neighbors)
+    const double planeDist = std::abs(dimDif);
+    if ((radius <= 0 || planeDist < radius) &&
+        (k == 0 || knn.size() < asUnsigned(k) ||
+         planeDist < knn.front().first))
     {
-      store.tree(nodeId, 1) = nextNodeId;
-      nextNodeId = flatten(nextNodeId, current->right.get(), store);
+      kNearest(secondBranch, data, knn, k, radius, metric);
     }
-    return nextNodeId;
-  }
-
-  NodePtr unflatten(const FlatData& store, index index) const
-  {
-    if (index == -1) return nullptr;
-    NodePtr current = makeNode(store.ids[index], store.data[index]);
-    current->left = unflatten(store, store.tree(index, 0));
-    current->right = unflatten(store, store.tree(index, 1));
-    return current;
   }
 
-  NodePtr mRoot{nullptr};
-  index   mDims{0};
-  index   mNPoints{0};
-  bool    mInitialized{false};
+  FluidTensor<index, 2>  mTree;
+  FluidTensor<string, 1> mIds;
+  FluidTensor<double, 2> mData;
+  index                  mDims{0};
+  index                  mNPoints{0};
+  Distance               mMetric{Distance::kEuclidean};
+  bool                   mInitialized{false};
 };
 } // namespace algorithm
 } // namespace fluid
@@ -12,14 +12,20 @@ under the European Union’s Horizon 2020 research and innovation programme
 
 #include "../util/DistanceFuncs.hpp"
 #include "../util/FluidEigenMappings.hpp"
+#include "../util/ParallelFor.hpp"
 #include "../../data/FluidDataSet.hpp"
 #include "../../data/FluidIndex.hpp"
 #include "../../data/FluidTensor.hpp"
 #include "../../data/TensorTypes.hpp"
 #include "../../data/FluidMemory.hpp"
 #include <Eigen/Core>
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <queue>
+#include <random>
 #include <string>
+#include <vector>
 
 namespace fluid {
 namespace algorithm {
@@ -31,42 +37,67 @@ public:
   void clear()
   {
     mMeans.setZero();
+    mHalfSqNorms.setZero();
     mAssignments.setZero();
     mTrained = false;
   }
 
   bool initialized() const { return mTrained; }
 
+  // Lloyd's algorithm, with Hamerly's bounds to skip most distance
+  // computations once the means settle, seeded by k-means++ unless already
+  // trained. A batchSize below the number of points runs maxIter mini-batch
+  // updates of that many random points instead (Sculley 2010), for very large
+  // datasets. Assignment is spread over up to maxThreads threads (0 for all).
   void train(const FluidDataSet<std::string, double, 1>& dataset, index k,
-             index maxIter)
+             index maxIter, index batchSize = 0, index maxThreads = 0)
   {
     using namespace Eigen;
-    using namespace _impl;
     assert(!mTrained || (dataset.pointSize() == mDims && mK == k));
-    auto dataPoints = asEigen<Array>(dataset.getData());
-    if (mTrained) { mAssignments = assignClusters(dataPoints); }
+    auto                        view = dataset.getData();
+    Map<const RowMajorArrayXXd> dataPoints(view.data(), view.rows(),
+                                           view.cols());
+    index                       n = dataPoints.rows();
+    bool                        miniBatch = batchSize > 0 && batchSize < n;
+    std::mt19937                gen{std::random_device{}()};
+    RowMajorArrayXXd            means;
+    if (mTrained) { means = mMeans; }
     else
     {
       mK = k;
       mDims = dataset.pointSize();
-      mMeans = ArrayXXd::Zero(mK, mDims);
-      mEmpty = std::vector<bool>(asUnsigned(mK), false);
-      mAssignments =
-          ((0.5 + (0.5 * ArrayXf::Random(dataPoints.rows()))) * (mK - 1))
-              .round()
-              .cast<int>();
-    }
-
-    while (maxIter-- > 0)
-    {
-      computeMeans(dataPoints);
-      auto assignments = assignClusters(dataPoints);
-      if (!changed(assignments)) { break; }
-      else
+      if (miniBatch) // k-means++ over a sample is enough to seed batches
       {
-        mAssignments = assignments;
+        std::uniform_int_distribution<index> pick(0, n - 1);
+        RowMajorArrayXXd sample(std::min(n, std::max(3 * batchSize, k)),
+                                mDims);
+        for (index i = 0; i < sample.rows(); i++)
+          sample.row(i) = dataPoints.row(pick(gen));
+        means = initMeans(sample, gen, maxThreads);
       }
+      else
+        means = initMeans(dataPoints, gen, maxThreads);
     }
+
+    if (miniBatch)
+      trainMiniBatch(dataPoints, means, maxIter, batchSize, gen, maxThreads);
+
+    VectorXi assignments(n);
+    ArrayXd  upper(n), lower(n);
+    parallelFor(
+        n, blockSize,
+        [&](index start, index end) {
+          for (index i = start; i < end; i++)
+            assignBounded(dataPoints.row(i), means, assignments(i), upper(i),
+                          lower(i));
+        },
+        maxThreads);
+    if (!miniBatch)
+      trainHamerly(dataPoints, means, assignments, upper, lower, maxIter,
+                   maxThreads);
+    mMeans = means;
+    updateNorms();
+    mAssignments = assignments;
     mTrained = true;
   }
 
@@ -80,11 +111,21 @@ public:
     return count;
   }
 
-  index vq(RealVectorView point) const
+  // The nearest mean, from one product with all the means: |x - c|^2 is
+  // least where x.c - |c|^2 / 2 is greatest. Scratch space comes from alloc,
+  // so this can run per frame in real time.
+  index vq(InputRealVectorView point,
+           Allocator&          alloc = FluidDefaultAllocator()) const
   {
-    assert(point.size() == mDims);
-    // transpose() allows us to avoid a temporary further down the call stack
-    return assignPoint(_impl::asEigen<Eigen::Array>(point).transpose());
+    using namespace Eigen;
+    assert(point.size() == dims());
+    ScopedEigenMap<VectorXd> x(dims(), alloc);
+    ScopedEigenMap<VectorXd> scores(size(), alloc);
+    x = _impl::asEigen<Matrix>(point);
+    scores.noalias() = mMeans.matrix() * x;
+    index nearest;
+    (scores.array() - mHalfSqNorms).maxCoeff(&nearest);
+    return nearest;
   }
 
   void getMeans(RealMatrixView out) const
@@ -97,7 +138,7 @@ public:
     mMeans = _impl::asEigen<Eigen::Array>(means);
     mDims = mMeans.cols();
     mK = mMeans.rows();
-    mEmpty = std::vector<bool>(asUnsigned(mK), false);
+    updateNorms();
     mTrained = true;
   }
 
@@ -114,72 +155,192 @@ public:
   void transform(RealMatrixView data, RealMatrixView out) const
   {
     Eigen::ArrayXXd points = _impl::asEigen<Eigen::Array>(data);
-    Eigen::ArrayXXd D = fluid::algorithm::DistanceMatrix(points, 2);
-    Eigen::MatrixXd means = mMeans.matrix();
-    D = fluid::algorithm::DistanceMatrix<Eigen::ArrayXXd>(points, mMeans, 2);
+    Eigen::ArrayXXd D = fluid::algorithm::DistanceMatrix(points, mMeans, 2, 0);
     out <<= _impl::asFluid(D);
   }
 
 protected:
-  template <typename DerivedA, typename DerivedB>
-  double distance(const Eigen::ArrayBase<DerivedA>& v1,
-                  const Eigen::ArrayBase<DerivedB>& v2) const
-  {
-    return (v1 - v2).matrix().norm();
-  }
+  void updateNorms() { mHalfSqNorms = 0.5 * mMeans.square().rowwise().sum(); }
+
+  using RowMajorArrayXXd =
+      Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+
+  static constexpr index blockSize = 1024;
 
-  template <typename Derived>
-  index assignPoint(const Eigen::ArrayBase<Derived>& point) const
+  // k-means++: each mean is a point drawn with probability proportional to
+  // its squared distance from the nearest mean chosen so far
+  template <typename Data>
+  RowMajorArrayXXd initMeans(const Data& dataPoints, std::mt19937& gen,
+                             index maxThreads) const
   {
-    double minDistance = std::numeric_limits<double>::infinity();
-    index  minK;
+    using namespace Eigen;
+    index            n = dataPoints.rows();
+    RowMajorArrayXXd means(mK, mDims);
+    ArrayXd nearest = ArrayXd::Constant(n, std::numeric_limits<double>::max());
+    std::uniform_int_distribution<index> pick(0, n - 1);
+    index                                next = pick(gen);
     for (index k = 0; k < mK; k++)
     {
-      double dist = distance(point, mMeans.row(k));
-      if (dist < minDistance)
+      means.row(k) = dataPoints.row(next);
+      if (k == mK - 1) break;
+      parallelFor(
+          n, blockSize,
+          [&](index start, index end) {
+            for (index i = start; i < end; i++)
+            {
+              double dist = (dataPoints.row(i) - means.row(k)).square().sum();
+              nearest(i) = std::min(nearest(i), dist);
+            }
+          },
+          maxThreads);
+      double total = nearest.sum();
+      if (total <= 0) // fewer distinct points than means
       {
-        minK = k;
-        minDistance = dist;
+        next = pick(gen);
+        continue;
       }
+      double target = std::uniform_real_distribution<double>(0, total)(gen);
+      for (next = 0; next < n - 1 && target >= nearest(next); next++)
+        target -= nearest(next);
     }
-    return minK;
+    return means;
   }
 
-  Eigen::VectorXi assignClusters(const Eigen::ArrayXXd& dataPoints) const
+  // finds the nearest mean, and the distances to it and the next nearest
+  template <typename Point>
+  void assignBounded(const Point& point, const RowMajorArrayXXd& means,
+                     int& assignment, double& upper, double& lower) const
   {
-    Eigen::VectorXi assignments = Eigen::VectorXi::Zero(dataPoints.rows());
-    for (index i = 0; i < dataPoints.rows(); i++)
+    double nearest = std::numeric_limits<double>::infinity();
+    double second = nearest;
+    for (index k = 0; k < means.rows(); k++)
     {
-      assignments(i) = static_cast<int>(assignPoint(dataPoints.row(i)));
+      double dist = (point - means.row(k)).square().sum();
+      if (dist < nearest)
+      {
+        second = nearest;
+        nearest = dist;
+        assignment = static_cast<int>(k);
+      }
+      else if (dist < second)
+        second = dist;
     }
-    return assignments;
+    upper = std::sqrt(nearest);
+    lower = std::sqrt(second);
   }
 
-  void computeMeans(const Eigen::ArrayXXd& dataPoints)
+  // Hamerly (2010): upper bounds each point's distance to its own mean and
+  // lower bounds its distance to any other, widening both as the means move,
+  // and only looks at the other means when the bounds no longer separate them
+  template <typename Data>
+  void trainHamerly(const Data& dataPoints, RowMajorArrayXXd& means,
+                    Eigen::VectorXi& assignments, Eigen::ArrayXd& upper,
+                    Eigen::ArrayXd& lower, index maxIter, index maxThreads)
   {
     using namespace Eigen;
-    for (index k = 0; k < mK; k++)
+    index            n = dataPoints.rows();
+    RowMajorArrayXXd sums = RowMajorArrayXXd::Zero(mK, mDims);
+    ArrayXd          counts = ArrayXd::Zero(mK);
+    for (index i = 0; i < n; i++)
     {
-      if (mEmpty[asUnsigned(k)]) continue;
-      std::vector<index> kAssignment;
-      for (index i = 0; i < mAssignments.size(); i++)
-      {
-        if (mAssignments(i) == k) kAssignment.push_back(i);
-      }
-      if (kAssignment.size() == 0)
+      sums.row(assignments(i)) += dataPoints.row(i);
+      counts(assignments(i))++;
+    }
+    RowMajorArrayXXd previous(mK, mDims);
+    ArrayXd          moved(mK), halfGap(mK);
+    VectorXi         previousAssignments(n);
+
+    while (maxIter-- > 0)
+    {
+      previous = means;
+      for (index k = 0; k < mK; k++) // empty clusters keep their mean
+        if (counts(k) > 0) means.row(k) = sums.row(k) / counts(k);
+      moved = (means - previous).matrix().rowwise().norm().array();
+      halfGap.setConstant(std::numeric_limits<double>::infinity());
+      for (index k = 0; k < mK; k++)
+        for (index j = k + 1; j < mK; j++)
+        {
+          double gap = 0.5 * (means.row(k) - means.row(j)).matrix().norm();
+          halfGap(k) = std::min(halfGap(k), gap);
+          halfGap(j) = std::min(halfGap(j), gap);
+        }
+      index  furthest;
+      double maxMove = moved.maxCoeff(&furthest);
+      double otherMove = 0;
+      for (index k = 0; k < mK; k++)
+        if (k != furthest) otherMove = std::max(otherMove, moved(k));
+
+      previousAssignments = assignments;
+      parallelFor(
+          n, blockSize,
+          [&](index start, index end) {
+            for (index i = start; i < end; i++)
+            {
+              index a = assignments(i);
+              upper(i) += moved(a);
+              lower(i) -= a == furthest ? otherMove : maxMove;
+              double bound = std::max(halfGap(a), lower(i));
+              if (upper(i) <= bound) continue;
+              upper(i) = (dataPoints.row(i) - means.row(a)).matrix().norm();
+              if (upper(i) <= bound) continue;
+              assignBounded(dataPoints.row(i), means, assignments(i), upper(i),
+                            lower(i));
+            }
+          },
+          maxThreads);
+
+      // only the points that moved change the sums
+      index nChanged = 0;
+      for (index i = 0; i < n; i++)
       {
-        std::cout << "Warning: empty cluster" << std::endl;
-        mEmpty[asUnsigned(k)] = true;
-        return;
+        index from = previousAssignments(i), to = assignments(i);
+        if (from == to) continue;
+        sums.row(from) -= dataPoints.row(i);
+        sums.row(to) += dataPoints.row(i);
+        counts(from)--;
+        counts(to)++;
+        nChanged++;
       }
-      ArrayXXd clusterPoints =
-          ArrayXXd::Zero(asSigned(kAssignment.size()), mDims);
-      for (index i = 0; asUnsigned(i) < kAssignment.size(); i++)
+      if (nChanged == 0) break;
+    }
+  }
+
+  // Sculley (2010): each batch is assigned to the current means, then each
+  // point pulls its mean towards it by one over the mean's count so far.
+  // Refitting a trained model counts the points it already assigned, so its
+  // means carry their weight rather than jumping to the first batch
+  template <typename Data>
+  void trainMiniBatch(const Data& dataPoints, RowMajorArrayXXd& means,
+                      index maxIter, index batchSize, std::mt19937& gen,
+                      index maxThreads) const
+  {
+    using namespace Eigen;
+    std::uniform_int_distribution<index> pick(0, dataPoints.rows() - 1);
+    std::vector<index>                   batch(asUnsigned(batchSize));
+    VectorXi                             batchAssignments(batchSize);
+    ArrayXd                              counts = ArrayXd::Zero(mK);
+    if (mTrained)
+      for (index i = 0; i < mAssignments.size(); i++)
+        counts(mAssignments(i))++;
+    while (maxIter-- > 0)
+    {
+      for (auto& i : batch) i = pick(gen);
+      parallelFor(
+          batchSize, blockSize,
+          [&](index start, index end) {
+            double upper, lower;
+            for (index b = start; b < end; b++)
+              assignBounded(dataPoints.row(batch[asUnsigned(b)]), means,
+                            batchAssignments(b), upper, lower);
+          },
+          maxThreads);
+      for (index b = 0; b < batchSize; b++)
       {
-        clusterPoints.row(i) = dataPoints.row(kAssignment[asUnsigned(i)]);
+        index k = batchAssignments(b);
+        counts(k)++;
+        means.row(k) += (dataPoints.row(batch[asUnsigned(b)]) - means.row(k)) /
+                        counts(k);
       }
-      ArrayXd mean = clusterPoints.colwise().mean();
-      mMeans.row(k) = mean;
     }
   }
 
@@ -189,12 +350,12 @@ protected:
     return dif > 0;
   }
 
-  index             mK{0};
-  index             mDims{0};
-  Eigen::ArrayXXd   mMeans;
-  std::vector<bool> mEmpty;
-  Eigen::VectorXi   mAssignments;
-  bool              mTrained{false};
+  index           mK{0};
+  index           mDims{0};
+  Eigen::ArrayXXd mMeans;
+  Eigen::ArrayXd  mHalfSqNorms;
+  Eigen::VectorXi mAssignments;
+  bool            mTrained{false};
 };
 } // namespace algorithm
 } // namespace fluid
@@ -10,15 +10,19 @@ under the European Union’s Horizon 2020 research and innovation programme
 
 #pragma once
 
+#include "HNSW.hpp"
 #include "KDTree.hpp"
 #include "../util/AlgorithmUtils.hpp"
 #include "../util/FluidEigenMappings.hpp"
+#include "../util/ParallelFor.hpp"
 #include "../../data/FluidDataSet.hpp"
 #include "../../data/FluidIndex.hpp"
 #include "../../data/FluidTensor.hpp"
 #include "../../data/TensorTypes.hpp"
 #include "../../data/FluidMemory.hpp"
+#include <algorithm>
 #include <string>
+#include <utility>
 
 namespace fluid {
 namespace algorithm {
@@ -29,59 +33,159 @@ class KNNClassifier
 public:
   using LabelSet = FluidDataSet<std::string, std::string, 1>;
 
-  std::string const& predict(KDTree const& tree, RealVectorView point,
+  // labels must be in the order of the DataSet the tree was fitted on (see
+  // KDTree::alignToFitted). tree can be a KDTree or an HNSW.
+  template <typename Tree>
+  std::string const& predict(Tree const& tree, RealVectorView point,
                              LabelSet const& labels, index k, bool weighted,
                              Allocator& alloc = FluidDefaultAllocator()) const
   {
-    using namespace std;
-    unordered_map<const string*, double> labelsMap;
-    auto [distances, ids] = tree.kNearest(point, k, 0, alloc);
+    auto [distances, indices] = tree.kNearestIndices(point, k, 0, alloc);
+    k = asSigned(indices.size()); // approximate searches may find fewer
+    rt::vector<double> weights = neighbourWeights(distances, weighted, alloc);
 
-    double             uniformWeight = 1.0 / k;
-    rt::vector<double> weights(asUnsigned(k), weighted ? 0 : uniformWeight,
-                               alloc);
-
-    double sum = 0;
-    if (weighted)
+    // at most k distinct labels, so a linear scan beats hashing them
+    rt::vector<std::pair<const std::string*, double>> votes(alloc);
+    votes.reserve(asUnsigned(k));
+    const std::string* prediction = nullptr;
+    double             maxWeight = 0;
+    for (size_t i = 0; i < asUnsigned(k); i++)
     {
-      bool binaryWeights = false;
-      for (size_t i = 0; i < asUnsigned(k); i++)
+      const std::string* label = &labels.getData()(indices[i], 0);
+      auto               pos = std::find_if(votes.begin(), votes.end(),
+                                            [label](auto const& v) {
+                                              return *v.first == *label;
+                                            });
+      if (pos == votes.end())
+        pos = votes.emplace(votes.end(), label, 0);
+      pos->second += weights[i];
+      if (pos->second > maxWeight)
       {
-        if (distances[i] < epsilon)
-        {
-          binaryWeights = true;
-          weights[i] = 1;
-        }
-        else
-          sum += (1.0 / distances[i]);
+        maxWeight = pos->second;
+        prediction = label;
       }
-      if (!binaryWeights)
+    }
+    return *prediction;
+  }
+
+  // As predict(), but each fitted point is given by its class index in
+  // [0, nClasses) (again in the order the tree was fitted on), and the
+  // winning class index is returned. Scratch memory only comes from alloc,
+  // so this is safe on the audio thread with a real-time allocator.
+  template <typename Tree>
+  index predictIndex(Tree const& tree, RealVectorView point,
+                     FluidTensorView<const index, 1> classes, index nClasses,
+                     index k, bool weighted,
+                     Allocator& alloc = FluidDefaultAllocator()) const
+  {
+    auto [distances, indices] = tree.kNearestIndices(point, k, 0, alloc);
+    k = asSigned(indices.size());
+    rt::vector<double> weights = neighbourWeights(distances, weighted, alloc);
+    rt::vector<double> votes(asUnsigned(nClasses), 0, alloc);
+    index              prediction = -1;
+    double             maxWeight = 0;
+    for (size_t i = 0; i < asUnsigned(k); i++)
+    {
+      index c = classes(indices[i]);
+      votes[asUnsigned(c)] += weights[i];
+      if (votes[asUnsigned(c)] > maxWeight)
       {
-        for (size_t i = 0; i < asUnsigned(k); i++)
-        {
-          weights[i] = (1.0 / distances[i]) / sum;
-        }
+        maxWeight = votes[asUnsigned(c)];
+        prediction = c;
       }
     }
+    return prediction;
+  }
 
-    const string* prediction;
-    double  maxWeight = 0;
-    for (size_t i = 0; i < asUnsigned(k); i++)
+  // Batch version of predictIndex(): out(i) receives the class of row i of
+  // points. Queries are taken in blocks, each resolved to fitted rows by one
+  // batch search, with blocks shared between up to maxThreads threads (0 for
+  // one per hardware thread).
+  template <typename Tree>
+  void predictIndex(Tree const& tree, FluidTensorView<const double, 2> points,
+                    FluidTensorView<const index, 1> classes, index nClasses,
+                    index k, bool weighted, FluidTensorView<index, 1> out,
+                    index maxThreads = 0) const
+  {
+    assert(out.size() == points.rows());
+    parallelFor(
+        points.rows(), blockSize,
+        [&](index start, index end) {
+          index                  n = end - start;
+          FluidTensor<index, 2>  indices(n, k);
+          FluidTensor<double, 2> distances(n, k);
+          FluidTensor<double, 1> weights(k);
+          FluidTensor<double, 1> votes(nClasses);
+          tree.kNearest(points(Slice(start, n), Slice(0)), k, indices,
+                        distances, 1);
+          for (index i = 0; i < n; i++)
+          {
+            // unfilled slots come last
+            auto  row = indices.row(i);
+            index found = std::count_if(row.begin(), row.end(),
+                                        [](index j) { return j >= 0; });
+            neighbourWeights(distances.row(i)(Slice(0, found)),
+                             weights(Slice(0, found)), weighted);
+            votes.fill(0);
+            index  prediction = -1;
+            double maxWeight = 0;
+            for (index j = 0; j < found; j++)
+            {
+              index c = classes(row(j));
+              votes(c) += weights(j);
+              if (votes(c) > maxWeight)
+              {
+                maxWeight = votes(c);
+                prediction = c;
+              }
+            }
+            out(start + i) = prediction;
+          }
+        },
+        maxThreads);
+  }
+
+private:
+  static constexpr index blockSize = 256;
+
+  static rt::vector<double>
+  neighbourWeights(rt::vector<double> const& distances, bool weighted,
+                   Allocator& alloc)
+  {
+    rt::vector<double> weights(distances.size(), 0, alloc);
+    neighbourWeights(FluidTensorView<const double, 1>(
+                         distances.data(), 0, asSigned(distances.size())),
+                     FluidTensorView<double, 1>(weights.data(), 0,
+                                                asSigned(weights.size())),
+                     weighted);
+    return weights;
+  }
+
+  // uniform, or inverse distance (exact matches take all the weight)
+  static void neighbourWeights(FluidTensorView<const double, 1> distances,
+                               FluidTensorView<double, 1> weights,
+                               bool                       weighted)
+  {
+    index k = distances.size();
+    weights.fill(weighted ? 0 : 1.0 / k);
+    if (!weighted) return;
+
+    double sum = 0;
+    bool   binaryWeights = false;
+    for (index i = 0; i < k; i++)
     {
-      const string* label = labels.get(*ids[i]).data();
-      assert(label && "KNNClassifier: ID not mapped to label");
-      auto pos = labelsMap.find(label);
-      if (pos == labelsMap.end())
-        labelsMap[label] = weights[i];
-      else
-        labelsMap[label] += weights[i];
-      if (labelsMap[label] > maxWeight)
+      if (distances(i) < epsilon)
       {
-        maxWeight = labelsMap[label];
-        prediction = label;
+        binaryWeights = true;
+        weights(i) = 1;
       }
+      else
+        sum += (1.0 / distances(i));
+    }
+    if (!binaryWeights)
+    {
+      for (index i = 0; i < k; i++) weights(i) = (1.0 / distances(i)) / sum;
     }
-    return *prediction;
   }
 };
 } // namespace algorithm
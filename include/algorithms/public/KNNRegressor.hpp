@@ -10,14 +10,17 @@ under the European Union’s Horizon 2020 research and innovation programme
 
 #pragma once
 
+#include "HNSW.hpp"
 #include "KDTree.hpp"
 #include "../util/AlgorithmUtils.hpp"
 #include "../util/FluidEigenMappings.hpp"
+#include "../util/ParallelFor.hpp"
 #include "../../data/FluidDataSet.hpp"
 #include "../../data/FluidIndex.hpp"
 #include "../../data/FluidTensor.hpp"
 #include "../../data/TensorTypes.hpp"
 #include "../../data/FluidMemory.hpp"
+#include <algorithm>
 #include <string>
 
 namespace fluid {
@@ -29,46 +32,93 @@ class KNNRegressor
 public:
   using DataSet = FluidDataSet<std::string, double, 1>;
 
-  void predict(KDTree const& tree, DataSet const& targets,
+  // targets must be in the order of the DataSet the tree was fitted on (see
+  // KDTree::alignToFitted). tree can be a KDTree or an HNSW.
+  template <typename Tree>
+  void predict(Tree const& tree, DataSet const& targets,
                  RealVectorView input, RealVectorView output,
                  index k, bool weighted,
                  Allocator& alloc = FluidDefaultAllocator()) const
   {
-    using namespace std;
     using _impl::asEigen;
     using Eigen::Array;
 
-    auto [distances, ids] = tree.kNearest(input, k, 0, alloc);
+    auto [distances, indices] = tree.kNearestIndices(input, k, 0, alloc);
+    k = asSigned(indices.size()); // approximate searches may find fewer
 
-    ScopedEigenMap<Eigen::VectorXd> weights(k, alloc);
-    weights.setConstant(weighted ? 0 : (1.0 / k));
+    ScopedEigenMap<Eigen::ArrayXd> weights(k, alloc);
+    neighbourWeights(
+        Eigen::Map<Eigen::ArrayXd>(distances.data(), distances.size()),
+        weights, weighted);
 
-    if (weighted)
-    {
-      auto distanceArray =
-          Eigen::Map<Eigen::ArrayXd>(distances.data(), distances.size());
+    auto targetPoints = asEigen<Array>(targets.getData())(indices, Eigen::all);
+    asEigen<Array>(output) =
+        (targetPoints.colwise() * weights).colwise().sum().transpose();
+  }
 
-      if ((distanceArray < epsilon).any())
-      {
-        weights = (distanceArray < epsilon).select(1.0, weights);
-      }
-      else
-      {
-        double sum = (1.0 / distanceArray).sum();
-        weights = (1.0 / distanceArray) / sum;
-      }
-    }
-      
-      output.fill(0);
+  // Batch version: row i of outputs receives the prediction for row i of
+  // inputs. Queries are taken in blocks, each resolved to fitted rows by one
+  // batch search and then gathered from targets, with blocks shared between
+  // up to maxThreads threads (0 for one per hardware thread).
+  template <typename Tree>
+  void predict(Tree const& tree, DataSet const& targets,
+               FluidTensorView<const double, 2> inputs,
+               FluidTensorView<double, 2> outputs, index k, bool weighted,
+               index maxThreads = 0) const
+  {
+    using _impl::asEigen;
+    using Eigen::Array;
 
-      rt::vector<index> indices(ids.size(), alloc);
-      
-      transform(ids.cbegin(), ids.cend(), indices.begin(),
-                [&targets](const string* id) { return targets.getIndex(*id); });
+    assert(outputs.rows() == inputs.rows());
+    assert(outputs.cols() == targets.dims());
+    auto targetData = asEigen<Array>(targets.getData());
+    parallelFor(
+        inputs.rows(), blockSize,
+        [&](index start, index end) {
+          index                  n = end - start;
+          FluidTensor<index, 2>  indices(n, k);
+          FluidTensor<double, 2> distances(n, k);
+          Eigen::ArrayXd         weights(k);
+          tree.kNearest(inputs(Slice(start, n), Slice(0)), k, indices,
+                        distances, 1);
+          for (index i = 0; i < n; i++)
+          {
+            // unfilled slots come last
+            auto  row = indices.row(i);
+            index found = std::count_if(row.begin(), row.end(),
+                                        [](index j) { return j >= 0; });
+            auto  rowIndices =
+                Eigen::Map<Eigen::Array<index, Eigen::Dynamic, 1>>(row.data(),
+                                                                   found);
+            neighbourWeights(
+                Eigen::Map<Eigen::ArrayXd>(distances.row(i).data(), found),
+                weights.head(found), weighted);
+            asEigen<Array>(outputs.row(start + i)) =
+                (targetData(rowIndices, Eigen::all).colwise() *
+                 weights.head(found))
+                    .colwise()
+                    .sum()
+                    .transpose();
+          }
+        },
+        maxThreads);
+  }
+
+private:
+  static constexpr index blockSize = 256;
 
-      auto targetPoints = asEigen<Array>(targets.getData())(indices, Eigen::all);
-      
-      asEigen<Array>(output) = (targetPoints.colwise() * weights.array()).colwise().sum().transpose();
+  // uniform, or inverse distance (exact matches take all the weight)
+  template <typename Distances, typename Weights>
+  static void neighbourWeights(Distances const& distances, Weights&& weights,
+                               bool weighted)
+  {
+    index k = distances.size();
+    weights.setConstant(weighted ? 0 : (1.0 / k));
+    if (!weighted) return;
+    if ((distances < epsilon).any())
+      weights = (distances < epsilon).select(1.0, weights);
+    else
+      weights = (1.0 / distances) / (1.0 / distances).sum();
   }
 };
 } // namespace algorithm
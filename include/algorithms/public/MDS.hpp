@@ -31,17 +31,11 @@ public:
   {
     using namespace Eigen;
     using namespace _impl;
-    auto     dist = static_cast<DistanceFuncs::Distance>(distance);
     MatrixXd input = asEigen<Matrix>(in);
     index    n = input.rows();
-    MatrixXd D = MatrixXd::Zero(n, n);
+    MatrixXd D = DistanceMatrix(input, distance, 0);
     MatrixXd I = MatrixXd::Identity(n, n);
     MatrixXd ones = MatrixXd::Ones(n, n);
-    for (index i = 0; i < n; i++)
-    {
-      for (index j = 0; j < n; j++)
-      { D(i, j) = DistanceFuncs::map()[dist](input.row(i), input.row(j)); }
-    }
     MatrixXd J = I - ones / n;
     D = -0.5 * J * D * J;
     BDCSVD<MatrixXd> svd(D, ComputeThinV | ComputeThinU);
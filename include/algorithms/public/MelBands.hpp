@@ -21,10 +21,15 @@ under the European Union’s Horizon 2020 research and innovation programme
 namespace fluid {
 namespace algorithm {
 
-class MelBands
+// Mel filterbank in single (T = float) or double precision. Filters are
+// always designed in double.
+template <typename T>
+class BasicMelBands
 {
+  using MatrixX = Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>;
+
 public:
-  MelBands(
+  BasicMelBands(
       index maxBands, index maxFFT, Allocator& alloc = FluidDefaultAllocator())
       : mFilters(maxBands, maxFFT / 2 + 1, alloc)
   {}
@@ -70,39 +75,42 @@ public:
     {
       lower = -ramps.row(i) / melD(i);
       upper = ramps.row(i + 2) / melD(i + 1);
-      mFilters.row(i).head(nBins) = lower.min(upper).max(0);
+      mFilters.row(i).head(nBins) = lower.min(upper).max(0).template cast<T>();
     }
     mNBands = nBands;
     mNBins = nBins;
   }
 
-  void processFrame(const RealVectorView in, RealVectorView out, bool magNorm,
-                    bool usePower, bool logOutput, Allocator&)
+  void processFrame(const FluidTensorView<T, 1> in, FluidTensorView<T, 1> out,
+                    bool magNorm, bool usePower, bool logOutput, Allocator&)
   {
     using namespace Eigen;
 
-    FluidEigenMap<Array> frame = _impl::asEigen<Array>(in);
-    FluidEigenMap<Array> result = _impl::asEigen<Array>(out);
+    auto frame = _impl::asEigen<Array>(in);
+    auto result = _impl::asEigen<Array>(out);
 
-    if (magNorm) frame = frame * mScale1;
-    double energy = frame.sum() * mScale2;
+    if (magNorm) frame = frame * T(mScale1);
+    T energy = frame.sum() * T(mScale2);
     if (usePower) frame = frame.square();
 
     result.matrix().noalias() =
         (mFilters.topLeftCorner(mNBands, mNBins) * frame.matrix());
 
-    if (magNorm) { result = result * energy / std::max(epsilon, result.sum()); }
+    if (magNorm)
+    { result = result * energy / std::max(T(epsilon), result.sum()); }
 
-    if (logOutput) result = 20 * result.max(epsilon).log10();
+    if (logOutput) result = 20 * result.max(T(epsilon)).log10();
   }
 
   double mScale1{1.0};
   double mScale2{1.0};
 
 private:
-  ScopedEigenMap<Eigen::MatrixXd> mFilters;
-  index                           mNBands;
-  index                           mNBins;
+  ScopedEigenMap<MatrixX> mFilters;
+  index                   mNBands;
+  index                   mNBins;
 };
+
+using MelBands = BasicMelBands<double>;
 } // namespace algorithm
 } // namespace fluid
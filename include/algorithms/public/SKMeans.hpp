@@ -16,6 +16,7 @@ under the European Union’s Horizon 2020 research and innovation programme
 #include "../../data/FluidIndex.hpp"
 #include "../../data/FluidTensor.hpp"
 #include "../../data/TensorTypes.hpp"
+#include "../../data/FluidMemory.hpp"
 #include <Eigen/Core>
 #include <queue>
 #include <string>
@@ -53,18 +54,31 @@ public:
       updateEmbedding();
       computeMeans(dataPoints);
     }
+    updateNorms();
     mTrained = true;
   }
 
 
-  void encode(RealMatrixView data, RealMatrixView out,
-                 double alpha = 0.25) const
+  void encode(InputRealMatrixView data, RealMatrixView out,
+              double alpha = 0.25) const
   {
     using namespace Eigen;
-    MatrixXd points = _impl::asEigen<Matrix>(data).transpose();
-    MatrixXd embedding = (mMeans.matrix() * points).array() - alpha;
-    embedding = (embedding.array() > 0).select(embedding, 0).transpose();
-    out <<= _impl::asFluid(embedding);
+    auto encoding = _impl::asEigen<Matrix>(out);
+    encoding.noalias() =
+        _impl::asEigen<Matrix>(data) * mMeans.matrix().transpose();
+    encoding = (encoding.array() - alpha).max(0).matrix();
+  }
+
+  // One frame's encoding, with scratch space from alloc for real time use
+  void encode(InputRealVectorView point, RealVectorView out, double alpha,
+              Allocator& alloc = FluidDefaultAllocator()) const
+  {
+    using namespace Eigen;
+    ScopedEigenMap<VectorXd> x(dims(), alloc);
+    ScopedEigenMap<VectorXd> encoding(size(), alloc);
+    x = _impl::asEigen<Matrix>(point);
+    encoding.noalias() = mMeans.matrix() * x;
+    _impl::asEigen<Array>(out) = (encoding.array() - alpha).max(0);
   }
 
 private:
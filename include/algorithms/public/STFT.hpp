@@ -14,36 +14,91 @@ under the European Union’s Horizon 2020 research and innovation programme
 #include "../util/AlgorithmUtils.hpp"
 #include "../util/FFT.hpp"
 #include "../util/FluidEigenMappings.hpp"
+#include "../util/ParallelFor.hpp"
 #include "../../data/FluidIndex.hpp"
 #include "../../data/FluidMemory.hpp"
 #include "../../data/FluidTensor.hpp"
 #include "../../data/TensorTypes.hpp"
 #include <Eigen/Core>
+#include <algorithm>
 #include <cmath>
+#include <complex>
+#include <limits>
+#include <mutex>
+#include <type_traits>
 
 namespace fluid {
 namespace algorithm {
 
-class STFT
+namespace impl {
+// Window functions are computed in double, then narrowed for float STFTs
+template <typename T>
+void makeWindow(WindowFuncs::WindowTypes type, index size, T* window,
+                Allocator& alloc)
 {
-  using ArrayXd = Eigen::ArrayXd;
-  using ArrayXXd = Eigen::ArrayXXd;
-  using ArrayXcd = Eigen::ArrayXcd;
-  using ArrayXXcd = Eigen::ArrayXXcd;
-  using ArrayXdMap = Eigen::Map<Eigen::ArrayXd>;
+  if constexpr (std::is_same<T, double>::value)
+  {
+    Eigen::Map<Eigen::ArrayXd> out(window, size);
+    WindowFuncs::map()[type](size, out);
+  }
+  else
+  {
+    ScopedEigenMap<Eigen::ArrayXd> tmp(size, alloc);
+    WindowFuncs::map()[type](size, tmp);
+    Eigen::Map<Eigen::Array<T, Eigen::Dynamic, 1>>(window, size) =
+        tmp.cast<T>();
+  }
+}
+
+// Calls f(start, end, transform) over blocks of frames, spread over up to
+// maxThreads threads (0 for as many as the shared ThreadPool allows). A
+// serial run uses own; parallel blocks each make their own transform of the
+// same size
+template <typename Transform, typename F>
+void forEachFrameBlock(index nFrames, index maxThreads, Transform& own, F&& f)
+{
+  constexpr index minFramesPerBlock = 16;
+  index nThreads = std::min(
+      maxThreads > 0 ? maxThreads : ThreadPool::instance().maxThreads(),
+      nFrames / minFramesPerBlock);
+  if (nThreads <= 1)
+  {
+    f(index(0), nFrames, own);
+    return;
+  }
+  parallelFor(
+      nFrames, (nFrames + nThreads - 1) / nThreads,
+      [&](index start, index end) {
+        Transform transform(own.size());
+        f(start, end, transform);
+      },
+      nThreads);
+}
+} // namespace impl
+
+// STFT in single (T = float) or double precision
+template <typename T>
+class BasicSTFT
+{
+  using ArrayX = Eigen::Array<T, Eigen::Dynamic, 1>;
+  using ArrayXc = Eigen::Array<std::complex<T>, Eigen::Dynamic, 1>;
+  using ArrayXMap = Eigen::Map<ArrayX>;
 
 public:
-  STFT(index windowSize, index fftSize, index hopSize, index windowType = 0,
-       Allocator& alloc = FluidDefaultAllocator())
+  using RealView = FluidTensorView<T, 1>;
+  using ComplexView = FluidTensorView<std::complex<T>, 1>;
+  using ComplexMatrixView = FluidTensorView<std::complex<T>, 2>;
+
+  BasicSTFT(index windowSize, index fftSize, index hopSize,
+            index windowType = 0, Allocator& alloc = FluidDefaultAllocator())
       : mWindowSize(windowSize), mHopSize(hopSize), mFrameSize(fftSize / 2 + 1),
         mMaxWindowSize(windowSize),
         mWindowType(static_cast<WindowFuncs::WindowTypes>(windowType)),
         mWindowBuffer(asUnsigned(mMaxWindowSize), alloc),
         mWindowedFrameBuffer(asUnsigned(mMaxWindowSize), alloc),
-        mFFT(fftSize, alloc)
+        mFFT(fftSize, alloc), mAlloc(&alloc)
   {
-    ArrayXdMap window(mWindowBuffer.data(), mWindowSize);
-    WindowFuncs::map()[mWindowType](mWindowSize, window);
+    impl::makeWindow(mWindowType, mWindowSize, mWindowBuffer.data(), *mAlloc);
   }
 
   void resize(index windowSize, index fftSize, index hopSize)
@@ -53,114 +108,145 @@ public:
     mWindowSize = windowSize;
     mHopSize = hopSize;
     mFrameSize = fftSize / 2 + 1;
-    ArrayXdMap window(mWindowBuffer.data(), mWindowSize);
-    WindowFuncs::map()[mWindowType](mWindowSize, window);
+    impl::makeWindow(mWindowType, mWindowSize, mWindowBuffer.data(), *mAlloc);
     mFFT.resize(fftSize);
   }
 
-  static void magnitude(const FluidTensorView<std::complex<double>, 2> in,
-                        FluidTensorView<double, 2>                     out)
+  static void magnitude(const FluidTensorView<std::complex<T>, 2> in,
+                        FluidTensorView<T, 2>                     out)
   {
     _impl::asEigen<Eigen::Array>(out) =
         _impl::asEigen<Eigen::Array>(in).abs().real();
   }
 
-  static void magnitude(const FluidTensorView<std::complex<double>, 1> in,
-                        FluidTensorView<double, 1>                     out)
+  static void magnitude(const FluidTensorView<std::complex<T>, 1> in,
+                        FluidTensorView<T, 1>                     out)
   {
     _impl::asEigen<Eigen::Array>(out) =
         _impl::asEigen<Eigen::Array>(in).abs().real();
   }
 
-  static void phase(const FluidTensorView<std::complex<double>, 2> in,
-                    FluidTensorView<double, 2>                     out)
+  static void phase(const FluidTensorView<std::complex<T>, 2> in,
+                    FluidTensorView<T, 2>                     out)
   {
     _impl::asEigen<Eigen::Array>(out) =
         _impl::asEigen<Eigen::Array>(in).arg().real();
   }
 
-  static void phase(const FluidTensorView<std::complex<double>, 1> in,
-                    FluidTensorView<double, 1>                     out)
+  static void phase(const FluidTensorView<std::complex<T>, 1> in,
+                    FluidTensorView<T, 1>                     out)
   {
-    phase(FluidTensorView<std::complex<double>, 2>(in),
-          FluidTensorView<double, 2>(out));
+    phase(FluidTensorView<std::complex<T>, 2>(in),
+          FluidTensorView<T, 2>(out));
   }
 
 
-  void process(const RealVectorView audio, ComplexMatrixView spectrogram)
+  // Analyses the whole of audio, with the first window centred on its first
+  // sample, straight into spectrogram (audio.size() / hopSize + 1 frames).
+  // Frames are shared between up to maxThreads threads (0 for as many as the
+  // shared ThreadPool allows)
+  void process(const RealView audio, ComplexMatrixView spectrogram,
+               index maxThreads = 1)
   {
-    index      halfWindow = mWindowSize / 2;
-    ArrayXdMap window(mWindowBuffer.data(), mWindowSize);
-    ArrayXd    padded(audio.size() + mWindowSize + mHopSize);
-    padded.fill(0);
-    padded.segment(halfWindow, audio.size()) =
-        Eigen::Map<const ArrayXd>(audio.data(), audio.size());
-    index nFrames = static_cast<index>(
-        std::floor((padded.size() - mWindowSize) / mHopSize));
+    assert(spectrogram.rows() == audio.size() / mHopSize + 1);
+    analyse(audio, spectrogram, -(mWindowSize / 2), maxThreads);
+  }
 
-    ArrayXXcd result(nFrames, mFrameSize);
-    for (index i = 0; i < nFrames; i++)
-    {
-      result.row(i) =
-          mFFT.process(padded.segment(i * mHopSize, mWindowSize) * window);
-    }
-    spectrogram <<= _impl::asFluid(result);
+  // As process(), but without the centring: frame i starts at
+  // audio(i * hopSize), for as many frames as spectrogram has rows
+  void processFrames(const RealView audio, ComplexMatrixView spectrogram,
+                     index maxThreads = 1)
+  {
+    analyse(audio, spectrogram, 0, maxThreads);
   }
 
-  void processFrame(const RealVectorView frame, ComplexVectorView out)
+  void processFrame(const RealView frame, ComplexView out)
   {
     assert(frame.size() == mWindowSize);
-    ArrayXdMap window(mWindowBuffer.data(), mWindowSize);
-    ArrayXdMap windowedFrame(mWindowedFrameBuffer.data(), mWindowSize);
+    ArrayXMap window(mWindowBuffer.data(), mWindowSize);
+    ArrayXMap windowedFrame(mWindowedFrameBuffer.data(), mWindowSize);
     windowedFrame = _impl::asEigen<Eigen::Array>(frame);
     windowedFrame *= window;
-    _impl::asEigen<Eigen::Array>(out) = mFFT.process(windowedFrame);
+    mFFT.process(windowedFrameView(), out);
   }
 
-  void processFrame(Eigen::Ref<ArrayXd> frame, Eigen::Ref<ArrayXcd> out)
+  void processFrame(Eigen::Ref<ArrayX> frame, Eigen::Ref<ArrayXc> out)
   {
     assert(frame.size() == mWindowSize);
-    ArrayXdMap window(mWindowBuffer.data(), mWindowSize);
-    ArrayXdMap windowedFrame(mWindowedFrameBuffer.data(), mWindowSize);
+    ArrayXMap window(mWindowBuffer.data(), mWindowSize);
+    ArrayXMap windowedFrame(mWindowedFrameBuffer.data(), mWindowSize);
     windowedFrame = frame;
     windowedFrame *= window;
-    out = mFFT.process(windowedFrame);
+    mFFT.process(windowedFrameView(), ComplexView(out.data(), 0, out.size()));
+  }
+
+  RealView window() { return RealView(mWindowBuffer.data(), 0, mWindowSize); }
+
+private:
+  FluidTensorView<const T, 1> windowedFrameView() const
+  {
+    return {mWindowedFrameBuffer.data(), 0, mWindowSize};
   }
 
-  RealVectorView window()
+  // Frame i covers audio from i * hopSize + offset, zero padded at either end
+  void analyse(const RealView audio, ComplexMatrixView spectrogram,
+               index offset, index maxThreads)
   {
-    return RealVectorView(mWindowBuffer.data(), 0, mWindowSize);
+    assert(spectrogram.cols() == mFrameSize);
+    ArrayXMap window(mWindowBuffer.data(), mWindowSize);
+    impl::forEachFrameBlock(
+        spectrogram.rows(), maxThreads, mFFT,
+        [&](index start, index end, BasicFFT<T>& fft) {
+          ArrayX frame(mWindowSize);
+          for (index i = start; i < end; i++)
+          {
+            index first = i * mHopSize + offset;
+            index from = std::max<index>(first, 0);
+            index to = std::min(first + mWindowSize, audio.size());
+            frame.setZero();
+            if (to > from)
+              frame.segment(from - first, to - from) =
+                  _impl::asEigen<Eigen::Array>(audio(Slice(from, to - from)));
+            frame *= window;
+            fft.process(
+                FluidTensorView<const T, 1>(frame.data(), 0, mWindowSize),
+                spectrogram.row(i));
+          }
+        });
   }
 
-private:
   index                    mWindowSize;
   index                    mHopSize;
   index                    mFrameSize;
   index                    mMaxWindowSize;
   WindowFuncs::WindowTypes mWindowType;
-  rt::vector<double>       mWindowBuffer;
-  rt::vector<double>       mWindowedFrameBuffer;
-  FFT                      mFFT;
+  rt::vector<T>            mWindowBuffer;
+  rt::vector<T>            mWindowedFrameBuffer;
+  BasicFFT<T>              mFFT;
+  Allocator*               mAlloc;
 };
 
-class ISTFT
+template <typename T>
+class BasicISTFT
 {
-  using ArrayXd = Eigen::ArrayXd;
-  using ArrayXcd = Eigen::ArrayXcd;
-  using ArrayXXcd = Eigen::ArrayXXcd;
-  using ArrayXdMap = Eigen::Map<Eigen::ArrayXd>;
+  using ArrayX = Eigen::Array<T, Eigen::Dynamic, 1>;
+  using ArrayXc = Eigen::Array<std::complex<T>, Eigen::Dynamic, 1>;
+  using ArrayXMap = Eigen::Map<ArrayX>;
 
 public:
-  ISTFT(index windowSize, index fftSize, index hopSize, index windowType = 0,
-        Allocator& alloc = FluidDefaultAllocator())
+  using RealView = FluidTensorView<T, 1>;
+  using ComplexView = FluidTensorView<std::complex<T>, 1>;
+  using ComplexMatrixView = FluidTensorView<std::complex<T>, 2>;
+
+  BasicISTFT(index windowSize, index fftSize, index hopSize,
+             index windowType = 0, Allocator& alloc = FluidDefaultAllocator())
       : mWindowSize(windowSize), mMaxWindowSize(windowSize), mHopSize(hopSize),
-        mScale(1 / double(fftSize)),
+        mScale(T(1) / T(fftSize)),
         mWindowType(static_cast<WindowFuncs::WindowTypes>(windowType)),
         mIFFT(fftSize, alloc), mBuffer(asUnsigned(mMaxWindowSize), alloc),
-        mWindowBuffer(asUnsigned(mMaxWindowSize), alloc)
+        mWindowBuffer(asUnsigned(mMaxWindowSize), alloc), mAlloc(&alloc)
   {
-    ArrayXdMap window(mWindowBuffer.data(), mWindowSize);
-    WindowFuncs::map()[mWindowType](mWindowSize, window);
+    impl::makeWindow(mWindowType, mWindowSize, mWindowBuffer.data(), *mAlloc);
   }
 
   void resize(index windowSize, index fftSize, index hopSize)
@@ -169,65 +255,100 @@ public:
            "STFT: Window Size greater than Max");
     mWindowSize = windowSize;
     mHopSize = hopSize;
-    mScale = 1 / double(fftSize);
+    mScale = T(1) / T(fftSize);
     mIFFT.resize(fftSize);
-    ArrayXdMap window(mWindowBuffer.data(), mWindowSize);
-    WindowFuncs::map()[mWindowType](mWindowSize, window);
+    impl::makeWindow(mWindowType, mWindowSize, mWindowBuffer.data(), *mAlloc);
   }
 
-  void process(const ComplexMatrixView spectrogram, RealVectorView audio)
+  // Overlap-adds every frame of spectrogram, with the first window centred on
+  // the first sample, and writes the normalised result straight into audio.
+  // Frames are shared between up to maxThreads threads (0 for as many as the
+  // shared ThreadPool allows)
+  void process(const ComplexMatrixView spectrogram, RealView audio,
+               index maxThreads = 1)
   {
-    const auto& epsilon = std::numeric_limits<double>::epsilon;
-    index       halfWindow = mWindowSize / 2;
-    index       nFrames = spectrogram.rows();
-    index       outputSize = mWindowSize + (nFrames - 1) * mHopSize;
-    outputSize += mWindowSize + mHopSize;
-    ArrayXdMap window(mWindowBuffer.data(), mWindowSize);
-    ArrayXXcd  specData = _impl::asEigen<Eigen::Array>(spectrogram);
-    ArrayXd    outputPadded = ArrayXd::Zero(outputSize);
-    ArrayXd    norm = ArrayXd::Zero(outputSize);
-    for (index i = 0; i < nFrames; i++)
-    {
-      ArrayXd frame = mIFFT.process(specData.row(i)).segment(0, mWindowSize);
-      outputPadded.segment(i * mHopSize, mWindowSize) +=
-          frame * mScale * window;
-      norm.segment(i * mHopSize, mWindowSize) += window * window;
-    }
-    outputPadded = outputPadded / norm.max(epsilon());
-    ArrayXd trimmed = outputPadded.segment(halfWindow, audio.size());
-    audio <<= _impl::asFluid(trimmed);
+    synthesise(spectrogram, audio, mWindowSize / 2, maxThreads);
   }
 
-  void processFrame(ComplexVectorView frame, RealVectorView audio)
+  // As process(), but without the centring: frame i lands at
+  // audio(i * hopSize)
+  void processFrames(const ComplexMatrixView spectrogram, RealView audio,
+                     index maxThreads = 1)
   {
-    ArrayXdMap           window(mWindowBuffer.data(), mWindowSize);
-    Eigen::Map<ArrayXcd> frameMap(mBuffer.data(), frame.size());
+    synthesise(spectrogram, audio, 0, maxThreads);
+  }
+
+  void processFrame(ComplexView frame, RealView audio)
+  {
+    ArrayXMap           window(mWindowBuffer.data(), mWindowSize);
+    Eigen::Map<ArrayXc> frameMap(mBuffer.data(), frame.size());
     frameMap = _impl::asEigen<Eigen::Array>(frame);
     _impl::asEigen<Eigen::Array>(audio) =
         mIFFT.process(frameMap).head(window.size()) * window * mScale;
   }
 
-  void processFrame(Eigen::Ref<ArrayXcd> frame, Eigen::Ref<ArrayXd> audio)
+  void processFrame(Eigen::Ref<ArrayXc> frame, Eigen::Ref<ArrayX> audio)
   {
-    ArrayXdMap window(mWindowBuffer.data(), mWindowSize);
+    ArrayXMap window(mWindowBuffer.data(), mWindowSize);
     audio = mIFFT.process(frame).segment(0, mWindowSize) * window * mScale;
   }
 
-  RealVectorView window()
+  RealView window() { return RealView(mWindowBuffer.data(), 0, mWindowSize); }
+
+private:
+  // audio(j) is the normalised overlap-add at j + offset
+  void synthesise(const ComplexMatrixView spectrogram, RealView audio,
+                  index offset, index maxThreads)
   {
-    return RealVectorView(mWindowBuffer.data(), 0, mWindowSize);
+    const auto& epsilon = std::numeric_limits<T>::epsilon;
+    index       nFrames = spectrogram.rows();
+    index       outputSize = mWindowSize + (nFrames - 1) * mHopSize;
+    outputSize += mWindowSize + mHopSize;
+    ArrayXMap  window(mWindowBuffer.data(), mWindowSize);
+    ArrayX     output = ArrayX::Zero(outputSize);
+    ArrayX     norm = ArrayX::Zero(outputSize);
+    std::mutex outputMutex;
+    // parallel blocks overlap at their edges, so each sums into its own
+    // buffer before adding that to the output
+    impl::forEachFrameBlock(
+        nFrames, maxThreads, mIFFT,
+        [&](index start, index end, BasicIFFT<T>& ifft) {
+          bool   whole = start == 0 && end == nFrames;
+          index  blockSize = (end - start - 1) * mHopSize + mWindowSize;
+          ArrayX partial = whole ? ArrayX() : ArrayX::Zero(blockSize);
+          ArrayXMap sum(whole ? output.data() : partial.data(), blockSize);
+          ArrayX    frame(mWindowSize);
+          for (index i = start; i < end; i++)
+          {
+            ifft.process(spectrogram.row(i),
+                         RealView(frame.data(), 0, mWindowSize));
+            sum.segment((i - start) * mHopSize, mWindowSize) +=
+                frame * mScale * window;
+          }
+          if (whole) return;
+          std::lock_guard<std::mutex> lock(outputMutex);
+          output.segment(start * mHopSize, blockSize) += partial;
+        });
+    for (index i = 0; i < nFrames; i++)
+      norm.segment(i * mHopSize, mWindowSize) += window * window;
+    _impl::asEigen<Eigen::Array>(audio) =
+        output.segment(offset, audio.size()) /
+        norm.segment(offset, audio.size()).max(epsilon());
   }
 
-private:
-  index                            mWindowSize{1024};
-  index                            mMaxWindowSize;
-  index                            mHopSize{512};
-  double                           mScale{1};
-  WindowFuncs::WindowTypes         mWindowType;
-  IFFT                             mIFFT;
-  rt::vector<std::complex<double>> mBuffer;
-  rt::vector<double>               mWindowBuffer;
+  index                       mWindowSize{1024};
+  index                       mMaxWindowSize;
+  index                       mHopSize{512};
+  T                           mScale{1};
+  WindowFuncs::WindowTypes    mWindowType;
+  BasicIFFT<T>                mIFFT;
+  rt::vector<std::complex<T>> mBuffer;
+  rt::vector<T>               mWindowBuffer;
+  Allocator*                  mAlloc;
 };
 
+using STFT = BasicSTFT<double>;
+using ISTFT = BasicISTFT<double>;
+
 } // namespace algorithm
 } // namespace fluid
@@ -21,22 +21,26 @@ under the European Union’s Horizon 2020 research and innovation programme
 namespace fluid {
 namespace algorithm {
 
-class SpectralShape
+// Spectral shape descriptors in single (T = float) or double precision.
+// The per-bin work runs in T; the handful of sums it reduces to are finished
+// in double.
+template <typename T>
+class BasicSpectralShape
 {
 
-  using ArrayXd = Eigen::ArrayXd;
+  using ArrayX = Eigen::Array<T, Eigen::Dynamic, 1>;
 
 public:
-  SpectralShape(Allocator& alloc) : mOutputBuffer(7, alloc) {}
+  BasicSpectralShape(Allocator& alloc) : mOutputBuffer(7, alloc) {}
 
-  void processFrame(Eigen::Ref<ArrayXd> in, double sampleRate, double minFreq,
+  void processFrame(Eigen::Ref<ArrayX> in, double sampleRate, double minFreq,
                     double maxFreq, double rolloffTarget, bool logFreq,
                     bool usePower, Allocator& alloc)
   {
     using namespace std;
     maxFreq = (maxFreq == -1) ? (sampleRate / 2) : min(maxFreq, sampleRate / 2);
-    ScopedEigenMap<ArrayXd> mag(in.size(), alloc);
-    mag = in.max(epsilon);
+    ScopedEigenMap<ArrayX> mag(in.size(), alloc);
+    mag = in.max(T(epsilon));
     index  nBins = mag.size();
     double binHz = sampleRate / ((nBins - 1) * 2.);
     index  minBin = static_cast<index>(ceil(minFreq / binHz));
@@ -56,26 +60,27 @@ public:
 
     index size = maxBin - minBin;
 
-    ScopedEigenMap<ArrayXd> amp(size, alloc);
+    ScopedEigenMap<ArrayX> amp(size, alloc);
     amp = mag.segment(minBin, size);
     if (usePower) amp = amp.square();
 
-    double                  ampSum = amp.sum();
-    ScopedEigenMap<ArrayXd> freqs(size, alloc);
-    freqs = ArrayXd::LinSpaced(size, minBin * binHz, maxBin * binHz);
+    double                 ampSum = amp.sum();
+    ScopedEigenMap<ArrayX> freqs(size, alloc);
+    freqs = ArrayX::LinSpaced(size, T(minBin * binHz), T(maxBin * binHz));
     if (logFreq)
     {
-      freqs = 69 + (12 * (freqs / 440).log() * log2E);
+      freqs = 69 + (12 * (freqs / 440).log() * T(log2E));
     } // MIDI cents
 
     double centroid = (amp * freqs).sum() / ampSum;
-    double spread = (amp * (freqs - centroid).square()).sum() / ampSum;
-    double skewness = (amp * (freqs - centroid).pow(3)).sum() /
+    T      mean = T(centroid);
+    double spread = (amp * (freqs - mean).square()).sum() / ampSum;
+    double skewness = (amp * (freqs - mean).pow(3)).sum() /
                       (spread * sqrt(spread) * ampSum);
     double kurtosis =
-        (amp * (freqs - centroid).pow(4)).sum() / (spread * spread * ampSum);
+        (amp * (freqs - mean).pow(4)).sum() / (spread * spread * ampSum);
 
-    double flatness = exp(amp.log().mean()) / amp.mean();
+    double flatness = exp(double(amp.log().mean())) / amp.mean();
     double rolloff = maxBin - 1;
     double cumSum = 0;
     double target = ampSum * rolloffTarget / 100.0;
@@ -101,22 +106,24 @@ public:
     mOutputBuffer(6) = 20 * log10(max(crest, epsilon));
   }
 
-  void processFrame(const RealVectorView input, RealVectorView output,
-                    double sampleRate, double minFreq, double maxFreq,
-                    double rolloffTarget, bool logFreq, bool usePower,
-                    Allocator& alloc)
+  void processFrame(const FluidTensorView<T, 1> input,
+                    FluidTensorView<T, 1> output, double sampleRate,
+                    double minFreq, double maxFreq, double rolloffTarget,
+                    bool logFreq, bool usePower, Allocator& alloc)
   {
     assert(output.size() == 7);
-    ScopedEigenMap<ArrayXd> in(input.size(), alloc);
+    ScopedEigenMap<ArrayX> in(input.size(), alloc);
     in = _impl::asEigen<Eigen::Array>(input);
     processFrame(in, sampleRate, minFreq, maxFreq, rolloffTarget, logFreq,
                  usePower, alloc);
-    _impl::asEigen<Eigen::Array>(output) = mOutputBuffer;
+    _impl::asEigen<Eigen::Array>(output) = mOutputBuffer.cast<T>();
   }
 
 private:
-  ScopedEigenMap<ArrayXd> mOutputBuffer;
+  ScopedEigenMap<Eigen::ArrayXd> mOutputBuffer;
 };
 
+using SpectralShape = BasicSpectralShape<double>;
+
 } // namespace algorithm
 } // namespace fluid
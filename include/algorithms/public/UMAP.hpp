@@ -1,15 +1,20 @@
 #pragma once
+#include "HNSW.hpp"
 #include "KDTree.hpp"
+#include "PCA.hpp"
 #include "../util/DistanceFuncs.hpp"
 #include "../util/FluidEigenMappings.hpp"
+#include "../util/ParallelFor.hpp"
 #include "../util/SpectralEmbedding.hpp"
 #include "../../data/TensorTypes.hpp"
 #include "../../data/FluidMemory.hpp"
 #include <Eigen/Core>
 #include <Eigen/SparseCore>
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <random>
+#include <type_traits>
 #include <unsupported/Eigen/NonLinearOptimization>
 #include <unsupported/Eigen/NumericalDiff>
 
@@ -18,77 +23,148 @@ namespace fluid {
 namespace algorithm {
 
 namespace impl {
-template <typename RefeferenceArray>
-void optimizeLayout(Eigen::ArrayXXd& embedding, RefeferenceArray& reference,
-                    Eigen::ArrayXi const&  embIndices,
-                    Eigen::ArrayXi const&  refIndices,
-                    Eigen::ArrayXd const&  epochsPerSample,
-                    Eigen::VectorXd const& AB, bool updateReference,
-                    double learningRate, index maxIter, double gamma = 1.0)
+
+using RowMajorArrayXXd =
+    Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+
+// Dims is the embedding size when known at compile time, or 0
+template <index Dims>
+inline double rowSqDistance(const double* x, const double* y, index dims)
+{
+  index  n = Dims > 0 ? Dims : dims;
+  double result = 0;
+  for (index d = 0; d < n; d++)
+  {
+    double diff = x[d] - y[d];
+    result += diff * diff;
+  }
+  return result;
+}
+
+inline double clipGradient(double x)
+{
+  return std::min(std::max(x, -4.0), 4.0);
+}
+
+// One SGD run over row-major embedding and reference rows (which may be the
+// same memory). Each epoch's edges are split into blocks shared between up
+// to maxThreads threads that update rows in place without locking, as in
+// the reference implementations: an occasional lost update doesn't matter
+// to the layout. Each block draws its negative samples from its own
+// generator.
+template <index Dims>
+void optimizeLayoutEpochs(double* embedding, double* reference,
+                          index nReference, index dims,
+                          Eigen::ArrayXi const& embIndices,
+                          Eigen::ArrayXi const& refIndices,
+                          Eigen::ArrayXd const& epochsPerSample, double a,
+                          double b, bool updateReference, double learningRate,
+                          index maxIter, double gamma, index maxThreads,
+                          unsigned seed)
 {
-  using namespace std;
-  using namespace Eigen;
-  double alpha = learningRate;
-  double negativeSampleRate = 5.0;
-  auto   distance = DistanceFuncs::map()[DistanceFuncs::Distance::kSqEuclidean];
-  double a = AB(0);
-  double b = AB(1);
-  random_device                   rd;
-  mt19937                         mt(rd());
-  uniform_int_distribution<index> randomInt(0, reference.rows() - 1);
-  ArrayXd epochsPerNegativeSample = epochsPerSample / negativeSampleRate;
-  ArrayXd nextEpoch = epochsPerSample;
-  ArrayXd nextNegEpoch = epochsPerNegativeSample;
-  ArrayXd bound = VectorXd::Constant(embedding.cols(),
-                                     4); // based on umap python implementation
+  constexpr index  edgesPerBlock = 4096;
+  constexpr double negativeSampleRate = 5.0;
+  index            n = Dims > 0 ? Dims : dims;
+  index            nEdges = epochsPerSample.size();
+  index            nBlocks = (nEdges + edgesPerBlock - 1) / edgesPerBlock;
+  Eigen::ArrayXd   epochsPerNegativeSample =
+      epochsPerSample / negativeSampleRate;
+  Eigen::ArrayXd nextEpoch = epochsPerSample;
+  Eigen::ArrayXd nextNegEpoch = epochsPerNegativeSample;
+  double         alpha = learningRate;
   for (index i = 0; i < maxIter; i++)
   {
-    for (index j = 0; j < epochsPerSample.size(); j++)
-    {
-      if (nextEpoch(j) > i) continue;
-      ArrayXd current = embedding.row(embIndices(j));
-      ArrayXd other = reference.row(refIndices(j));
-      double  dist = distance(current, other); // todo: try to have dist member
-      double  gradCoef = 0;
-      ArrayXd grad;
-      if (dist > 0)
+    auto epoch = [&](index start, index end) {
+      std::minstd_rand rng(
+          seed + static_cast<unsigned>(i * nBlocks + start / edgesPerBlock));
+      std::uniform_int_distribution<index> randomInt(0, nReference - 1);
+      for (index j = start; j < end; j++)
       {
-        gradCoef = -2.0 * a * b * pow(dist, b - 1.0);
-        gradCoef /= a * pow(dist, b) + 1.0;
-      }
-      grad = (gradCoef * (current - other)).cwiseMin(bound).cwiseMax(-bound);
-      current += grad * alpha;
-      if constexpr (!std::is_const_v<RefeferenceArray>)
-        if (updateReference) other += -grad * alpha;
-      nextEpoch(j) += epochsPerSample(j);
-      index numNegative = static_cast<index>((i - nextNegEpoch(j)) /
-                                             epochsPerNegativeSample(j));
-      for (index k = 0; k < numNegative; k++)
-      {
-        index negativeIndex = randomInt(mt);
-        if (negativeIndex == embIndices(j)) continue;
-        ArrayXd negative = reference.row(negativeIndex);
-        dist = distance(current, negative);
-        gradCoef = 0;
-        grad = VectorXd::Constant(reference.cols(), 4.0);
+        if (nextEpoch(j) > i) continue;
+        double* current = embedding + embIndices(j) * n;
+        double* other = reference + refIndices(j) * n;
+        double  dist = rowSqDistance<Dims>(current, other, n);
+        double  gradCoef = 0;
         if (dist > 0)
         {
-          gradCoef = 2.0 * gamma * b;
-          gradCoef /= (0.001 + dist) * (a * pow(dist, b) + 1);
-          grad = (gradCoef * (current - negative))
-                     .cwiseMin(bound)
-                     .cwiseMax(-bound);
+          double distB1 = std::pow(dist, b - 1.0);
+          gradCoef = -2.0 * a * b * distB1 / (a * distB1 * dist + 1.0);
+        }
+        for (index d = 0; d < n; d++)
+        {
+          double grad = clipGradient(gradCoef * (current[d] - other[d]));
+          current[d] += grad * alpha;
+          if (updateReference) other[d] -= grad * alpha;
+        }
+        nextEpoch(j) += epochsPerSample(j);
+        index numNegative = static_cast<index>((i - nextNegEpoch(j)) /
+                                               epochsPerNegativeSample(j));
+        for (index k = 0; k < numNegative; k++)
+        {
+          index negativeIndex = randomInt(rng);
+          if (negativeIndex == embIndices(j)) continue;
+          const double* negative = reference + negativeIndex * n;
+          dist = rowSqDistance<Dims>(current, negative, n);
+          gradCoef = 0;
+          if (dist > 0)
+          {
+            gradCoef = 2.0 * gamma * b;
+            gradCoef /= (0.001 + dist) * (a * std::pow(dist, b) + 1);
+          }
+          for (index d = 0; d < n; d++)
+          {
+            double grad =
+                dist > 0 ? clipGradient(gradCoef * (current[d] - negative[d]))
+                         : 4.0;
+            current[d] += grad * alpha;
+          }
         }
-        current += grad * alpha;
+        nextNegEpoch(j) += numNegative * epochsPerNegativeSample(j);
       }
-      nextNegEpoch(j) += numNegative * epochsPerNegativeSample(j);
-      embedding.row(embIndices(j)) = current;
-      if constexpr (!std::is_const_v<RefeferenceArray>)
-        if (updateReference) reference.row(refIndices(j)) = other;
-    }
+    };
+    parallelFor(nEdges, edgesPerBlock, epoch, maxThreads);
     alpha = learningRate * (1.0 - (i / double(maxIter)));
   }
 }
+
+// Optimises the rows of embedding that appear in embIndices against those of
+// reference, which is moved too if updateReference is set (it may then be
+// the same array as embedding)
+template <typename RefeferenceArray>
+void optimizeLayout(Eigen::ArrayXXd& embedding, RefeferenceArray& reference,
+                    Eigen::ArrayXi const&  embIndices,
+                    Eigen::ArrayXi const&  refIndices,
+                    Eigen::ArrayXd const&  epochsPerSample,
+                    Eigen::VectorXd const& AB, bool updateReference,
+                    double learningRate, index maxIter, double gamma = 1.0,
+                    index maxThreads = 0)
+{
+  constexpr bool constReference = std::is_const_v<RefeferenceArray>;
+  updateReference = updateReference && !constReference;
+  bool aliased = static_cast<const void*>(&embedding) == &reference;
+  // rows are updated one at a time, so work on row-major copies
+  RowMajorArrayXXd emb = embedding;
+  RowMajorArrayXXd ref;
+  if (!aliased) ref = reference;
+  double*  refData = aliased ? emb.data() : ref.data();
+  index    dims = embedding.cols();
+  unsigned seed = std::random_device()();
+  auto     run = [&](auto dimsConstant) {
+    optimizeLayoutEpochs<decltype(dimsConstant)::value>(
+        emb.data(), refData, reference.rows(), dims, embIndices, refIndices,
+        epochsPerSample, AB(0), AB(1), updateReference, learningRate, maxIter,
+        gamma, maxThreads, seed);
+  };
+  switch (dims)
+  {
+  case 2: run(std::integral_constant<index, 2>()); break;
+  case 3: run(std::integral_constant<index, 3>()); break;
+  default: run(std::integral_constant<index, 0>());
+  }
+  embedding = emb;
+  if constexpr (!constReference)
+    if (updateReference && !aliased) reference = ref;
+}
 } // namespace impl
 
 struct UMAPEmbeddingParamsFunctor
@@ -160,6 +236,7 @@ public:
   {
     mEmbedding.setZero();
     mTree.clear();
+    mSpectralEmbedding = SpectralEmbedding();
     mInitialized = false;
   }
 
@@ -171,13 +248,15 @@ public:
 
   bool initialized() const { return mInitialized; }
 
+  // approximate builds the k nearest neighbour graph with an HNSW rather than
+  // the KDTree, which is much faster for high dimensional inputs
   DataSet train(DataSet& in, index k = 15, index dims = 2, double minDist = 0.1,
-                index maxIter = 200, double learningRate = 1.0)
+                index maxIter = 200, double learningRate = 1.0,
+                bool approximate = false)
   {
     using namespace Eigen;
     using namespace _impl;
     using namespace std;
-    SpectralEmbedding      spectralEmbedding;
     index                  n = in.size();
     FluidTensor<string, 1> ids{in.getIds()};
     FluidTensor<string, 1> newIds(n);
@@ -186,13 +265,19 @@ public:
     SparseMatrixXd knnGraph = SparseMatrixXd(in.size(), in.size());
     ArrayXXd       dists = ArrayXXd::Zero(in.size(), k);
     mK = k;
-    makeGraph(in, mK, knnGraph, dists, true);
+    if (approximate)
+      makeGraph(HNSW(DataSet(newIds, in.getData())), in, mK, knnGraph, dists,
+                true);
+    else
+      makeGraph(mTree, in, mK, knnGraph, dists, true);
     ArrayXd sigma = findSigma(k, dists);
     computeHighDimProb(dists, sigma, knnGraph);
     SparseMatrixXd knnGraphT = knnGraph.transpose();
     knnGraph = (knnGraph + knnGraphT) - knnGraph.cwiseProduct(knnGraphT);
     mAB = findAB(minDist);
-    mEmbedding = spectralEmbedding.train(knnGraph, dims);
+    mEmbedding = mSpectralEmbedding.train(knnGraph, dims);
+    if (!mSpectralEmbedding.converged())
+      mEmbedding = fallbackEmbedding(in, dims);
     mEmbedding = normalizeEmbedding(mEmbedding);
     knnGraph.makeCompressed();
     ArrayXi rowIndices(knnGraph.nonZeros());
@@ -211,14 +296,8 @@ public:
   DataSet transform(DataSet& in, index maxIter = 200, double learningRate = 1.0) const
   {
     if (!mInitialized) return DataSet();
-    SparseMatrixXd knnGraph(in.size(), mEmbedding.rows());
-    ArrayXXd       dists = ArrayXXd::Zero(in.size(), mK);
-    makeGraph(in, mK, knnGraph, dists, false);
-    knnGraph.makeCompressed();
-    ArrayXd sigma = findSigma(mK, dists);
-    computeHighDimProb(dists, sigma, knnGraph);
-    normalizeRows(knnGraph);
-    ArrayXXd embedding =
+    SparseMatrixXd knnGraph = transformGraph(in);
+    ArrayXXd       embedding =
         initTransformEmbedding(knnGraph, mEmbedding, in.size());
     ArrayXi rowIndices(knnGraph.nonZeros());
     ArrayXi colIndices(knnGraph.nonZeros());
@@ -232,13 +311,102 @@ public:
     return out;
   }
 
+  // Grows a fitted model by the points of in without refitting it. They are
+  // placed as by transform() and added to the tree, then they and the
+  // existing points that now count one of them among their nearest
+  // neighbours are laid out again, with the rest of the embedding held
+  // still. Returns the embedding of the new points.
+  DataSet add(DataSet& in, index maxIter = 200, double learningRate = 1.0)
+  {
+    using namespace std;
+    if (!mInitialized) return DataSet();
+    index    nOld = mEmbedding.rows();
+    index    nNew = in.size();
+    index    n = nOld + nNew;
+    ArrayXXd placed;
+    {
+      SparseMatrixXd knnGraph = transformGraph(in);
+      placed = initTransformEmbedding(knnGraph, mEmbedding, nNew);
+    }
+    auto newData = in.getData();
+    for (index i = 0; i < nNew; i++)
+      mTree.addNode(to_string(nOld + i), newData.row(i));
+    mEmbedding.conservativeResize(n, Eigen::NoChange);
+    mEmbedding.bottomRows(nNew) = placed;
+
+    // existing points can only gain a new neighbour if they are near one, so
+    // only the new points' neighbours are candidates for moving: those that do
+    // are affected, and move along with the new points
+    FluidTensor<double, 2> points(n, mTree.dims());
+    mTree.getData(points);
+    FluidTensor<index, 2>  neighbors(nNew, mK + 1);
+    FluidTensor<double, 2> distances(nNew, mK + 1);
+    mTree.kNearest(newData, mK + 1, neighbors, distances);
+    vector<bool>  isCandidate(asUnsigned(n), false);
+    vector<index> candidates;
+    for (index i = nOld; i < n; i++) isCandidate[asUnsigned(i)] = true;
+    for (index j : neighbors)
+      if (j >= 0 && !isCandidate[asUnsigned(j)])
+      {
+        isCandidate[asUnsigned(j)] = true;
+        candidates.push_back(j);
+      }
+    for (index i = nOld; i < n; i++) candidates.push_back(i);
+
+    // fresh neighbourhoods for all the candidates, combined with each other
+    // as in train()...
+    index                  nLocal = asSigned(candidates.size());
+    FluidTensor<string, 1> localIds(nLocal);
+    FluidTensor<double, 2> localPoints(nLocal, mTree.dims());
+    for (index i = 0; i < nLocal; i++)
+    {
+      localIds(i) = to_string(candidates[asUnsigned(i)]);
+      localPoints.row(i) <<= points.row(candidates[asUnsigned(i)]);
+    }
+    SparseMatrixXd localGraph(nLocal, n);
+    ArrayXXd       dists = ArrayXXd::Zero(nLocal, mK);
+    makeGraph(mTree, DataSet(localIds, localPoints), mK, localGraph, dists,
+              true);
+    localGraph.makeCompressed();
+    ArrayXd sigma = findSigma(mK, dists);
+    computeHighDimProb(dists, sigma, localGraph);
+    vector<bool>                   isAffected(asUnsigned(n), false);
+    vector<Eigen::Triplet<double>> triplets;
+    triplets.reserve(asUnsigned(localGraph.nonZeros()));
+    traverseGraph(localGraph, [&](auto it) {
+      index row = candidates[asUnsigned(it.row())];
+      if (it.col() >= nOld) isAffected[asUnsigned(row)] = true;
+      triplets.emplace_back(row, it.col(), it.value());
+    });
+    for (index i = nOld; i < n; i++) isAffected[asUnsigned(i)] = true;
+    SparseMatrixXd knnGraph(n, n);
+    knnGraph.setFromTriplets(triplets.begin(), triplets.end());
+    SparseMatrixXd knnGraphT = knnGraph.transpose();
+    knnGraph = (knnGraph + knnGraphT) - knnGraph.cwiseProduct(knnGraphT);
+    // ...keeping only the edges that move an affected point
+    knnGraph.prune([&](index row, index, double) {
+      return isAffected[asUnsigned(row)];
+    });
+    knnGraph.makeCompressed();
+
+    ArrayXi rowIndices(knnGraph.nonZeros());
+    ArrayXi colIndices(knnGraph.nonZeros());
+    ArrayXd epochsPerSample(knnGraph.nonZeros());
+    getGraphIndices(knnGraph, rowIndices, colIndices);
+    computeEpochsPerSample(knnGraph, epochsPerSample);
+    epochsPerSample = (epochsPerSample == 0).select(-1, epochsPerSample);
+    optimizeLayout(mEmbedding, mEmbedding, rowIndices, colIndices,
+                   epochsPerSample, learningRate, maxIter);
+    ArrayXXd added = mEmbedding.bottomRows(nNew);
+    return DataSet(in.getIds(), _impl::asFluid(added));
+  }
 
   void transformPoint(RealVectorView in, RealVectorView out,
                       Allocator& alloc = FluidDefaultAllocator()) const
   {
     if (!mInitialized) return;
 
-    auto [distances, nearestIds] = mTree.kNearest(in, mK, 0, alloc);
+    auto [distances, neighbors] = mTree.kNearestIndices(in, mK, 0, alloc);
     using SparseMap = Eigen::Map<Eigen::SparseMatrix<double, Eigen::RowMajor>>;
 
     rt::vector<double> data(alloc);
@@ -252,10 +420,9 @@ public:
     ScopedEigenMap<ArrayXXd> dists(1, mK, alloc);
     for (size_t j = 0; j < asUnsigned(mK); j++)
     {
-      int neighborIndex = stoi(*nearestIds[j]);
       dists(0, asSigned(j)) = distances[j];
       data.push_back(distances[j]);
-      inner.push_back(neighborIndex);
+      inner.push_back(static_cast<int>(neighbors[j]));
     }
     int       maxIndex = *std::max_element(inner.cbegin(), inner.cend());
     SparseMap knnGraph(1, maxIndex, mK, outer.data(), inner.data(),
@@ -357,26 +524,57 @@ private:
     return ab;
   }
 
-  void makeGraph(const DataSet& in, index k, SparseMatrixXd& graph,
-                 Ref<ArrayXXd> dists, bool discardFirst) const
+  template <typename Tree>
+  void makeGraph(const Tree& tree, const DataSet& in, index k,
+                 SparseMatrixXd& graph, Ref<ArrayXXd> dists,
+                 bool discardFirst) const
   {
     graph.reserve(in.size() * k);
-    auto data = in.getData();
+    index                  first = discardFirst ? 1 : 0;
+    FluidTensor<index, 2>  neighbors(in.size(), k + first);
+    FluidTensor<double, 2> distances(in.size(), k + first);
+    tree.kNearest(in, k + first, neighbors, distances);
     for (index i = 0; i < in.size(); i++)
     {
-      auto [distances, nearestIds] =
-          mTree.kNearest(data.row(i), discardFirst ? k + 1 : k);
-
-      for (size_t j = 0; j < asUnsigned(k); j++)
+      for (index j = 0; j < k; j++)
       {
-        size_t pos = discardFirst ? j + 1 : j;
-        index  neighborIndex = stoi(*nearestIds[pos]);
-        dists(i, asSigned(j)) = distances[pos];
-        graph.insert(i, neighborIndex) = distances[pos];
+        if (neighbors(i, j + first) < 0) continue;
+        dists(i, j) = distances(i, j + first);
+        graph.insert(i, neighbors(i, j + first)) = distances(i, j + first);
       }
     }
   }
 
+  // neighbours of the points of in among the fitted ones, weighted for
+  // placing them
+  SparseMatrixXd transformGraph(const DataSet& in) const
+  {
+    SparseMatrixXd knnGraph(in.size(), mEmbedding.rows());
+    ArrayXXd       dists = ArrayXXd::Zero(in.size(), mK);
+    makeGraph(mTree, in, mK, knnGraph, dists, false);
+    knnGraph.makeCompressed();
+    ArrayXd sigma = findSigma(mK, dists);
+    computeHighDimProb(dists, sigma, knnGraph);
+    normalizeRows(knnGraph);
+    return knnGraph;
+  }
+
+  // for when the spectral embedding doesn't converge: the leading principal
+  // components of the input, and random coordinates for any dimensions
+  // beyond those
+  ArrayXXd fallbackEmbedding(const DataSet& in, index dims) const
+  {
+    ArrayXXd   result = ArrayXXd::Random(in.size(), dims);
+    RealMatrix data(in.getData());
+    PCA        pca;
+    pca.init(data);
+    index      nComponents = std::min({dims, data.cols(), data.rows()});
+    RealMatrix components(in.size(), nComponents);
+    pca.process(data, components, nComponents);
+    result.leftCols(nComponents) = _impl::asEigen<Eigen::Array>(components);
+    return result;
+  }
+
   ArrayXXd normalizeEmbedding(const Ref<ArrayXXd>& embedding)
   {
     // based on umap python implementation
@@ -462,11 +660,12 @@ private:
   }
 
 private:
-  KDTree   mTree;
-  index    mK;
-  VectorXd mAB;
-  ArrayXXd mEmbedding;
-  bool     mInitialized{false};
+  KDTree            mTree;
+  index             mK;
+  VectorXd          mAB;
+  ArrayXXd          mEmbedding;
+  SpectralEmbedding mSpectralEmbedding; // warm starts the next train()
+  bool              mInitialized{false};
 };
 }// namespace algorithm
 }// namespace fluid
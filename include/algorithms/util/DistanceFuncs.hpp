@@ -11,9 +11,13 @@ under the European Union’s Horizon 2020 research and innovation programme
 #pragma once
 
 #include "AlgorithmUtils.hpp"
+#include "ParallelFor.hpp"
+#include "../../data/FluidIndex.hpp"
 #include <Eigen/Core>
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <functional>
 #include <map>
 
 namespace fluid {
@@ -40,83 +44,239 @@ public:
   using DistanceFuncsMap =
       std::map<Distance, std::function<double(ArrayXd, ArrayXd)>>;
 
+  // The distances as functors over any pair of Eigen arrays (including maps
+  // and blocks), which evaluate without copying or allocating, for when the
+  // distance can be picked at compile time
+  struct Manhattan
+  {
+    template <typename X, typename Y>
+    double operator()(const Eigen::ArrayBase<X>& x,
+                      const Eigen::ArrayBase<Y>& y) const
+    {
+      return (x - y).abs().sum();
+    }
+  };
+
+  struct Euclidean
+  {
+    template <typename X, typename Y>
+    double operator()(const Eigen::ArrayBase<X>& x,
+                      const Eigen::ArrayBase<Y>& y) const
+    {
+      return std::sqrt((x - y).square().sum());
+    }
+  };
+
+  struct SqEuclidean
+  {
+    template <typename X, typename Y>
+    double operator()(const Eigen::ArrayBase<X>& x,
+                      const Eigen::ArrayBase<Y>& y) const
+    {
+      return (x - y).square().sum();
+    }
+  };
+
+  struct Max
+  {
+    template <typename X, typename Y>
+    double operator()(const Eigen::ArrayBase<X>& x,
+                      const Eigen::ArrayBase<Y>& y) const
+    {
+      return (x - y).abs().maxCoeff();
+    }
+  };
+
+  struct Min
+  {
+    template <typename X, typename Y>
+    double operator()(const Eigen::ArrayBase<X>& x,
+                      const Eigen::ArrayBase<Y>& y) const
+    {
+      return (x - y).abs().minCoeff();
+    }
+  };
+
+  struct KL
+  {
+    template <typename X, typename Y>
+    double operator()(const Eigen::ArrayBase<X>& x,
+                      const Eigen::ArrayBase<Y>& y) const
+    {
+      auto   logX = x.max(epsilon).log(), logY = y.max(epsilon).log();
+      double d1 = (x * (logX - logY)).sum();
+      double d2 = (y * (logY - logX)).sum();
+      return d1 + d2;
+    }
+  };
+
+  struct Cosine
+  {
+    template <typename X, typename Y>
+    double operator()(const Eigen::ArrayBase<X>& x,
+                      const Eigen::ArrayBase<Y>& y) const
+    {
+      double norm = std::sqrt(x.square().sum() * y.square().sum());
+      double dot = (x * y).sum();
+      return 1 - (dot / norm);
+    }
+  };
+
+  struct JS
+  {
+    template <typename X, typename Y>
+    double operator()(const Eigen::ArrayBase<X>& x,
+                      const Eigen::ArrayBase<Y>& y) const
+    {
+      double sumX = x.max(epsilon).sum();
+      double sumY = y.max(epsilon).sum();
+      auto   pX = x.max(epsilon) / sumX;
+      auto   pY = y.max(epsilon) / sumY;
+      auto   logM = ((0.5 * pX) + (0.5 * pY)).log();
+      double d1 = (pX * (pX.log() - logM)).sum();
+      double d2 = (pY * (pY.log() - logM)).sum();
+      return std::sqrt(0.5 * (d1 + d2));
+    }
+  };
+
+  // Calls f with the functor for distance, so that f is compiled once per
+  // distance rather than calling through a function pointer for every pair
+  template <typename F>
+  static decltype(auto) visit(Distance distance, F&& f)
+  {
+    switch (distance)
+    {
+    case Distance::kManhattan: return f(Manhattan{});
+    case Distance::kSqEuclidean: return f(SqEuclidean{});
+    case Distance::kMax: return f(Max{});
+    case Distance::kMin: return f(Min{});
+    case Distance::kKL: return f(KL{});
+    case Distance::kCosine: return f(Cosine{});
+    case Distance::kJS: return f(JS{});
+    default: return f(Euclidean{});
+    }
+  }
+
+  // The distances nearest neighbour searches (KDTree, HNSW) can use, in the
+  // order the clients' metric parameters list them
+  static constexpr Distance searchMetrics[] = {
+      Distance::kEuclidean, Distance::kManhattan, Distance::kMax,
+      Distance::kCosine};
+
+  static Distance searchMetric(index metric)
+  {
+    return metric >= 0 && metric < 4 ? searchMetrics[metric]
+                                     : Distance::kEuclidean;
+  }
+
   static DistanceFuncsMap& map()
   {
     static DistanceFuncsMap _funcs = {
         {Distance::kManhattan,
-         [](ArrayXd x, ArrayXd y) { return (x - y).abs().sum(); }},
+         [](ArrayXd x, ArrayXd y) { return Manhattan{}(x, y); }},
         {Distance::kEuclidean,
-         [](ArrayXd x, ArrayXd y) {
-           return std::sqrt((x - y).square().sum());
-         }},
+         [](ArrayXd x, ArrayXd y) { return Euclidean{}(x, y); }},
         {Distance::kSqEuclidean,
-         [](ArrayXd x, ArrayXd y) { return (x - y).square().sum(); }},
-        {Distance::kMax,
-         [](ArrayXd x, ArrayXd y) { return (x - y).abs().maxCoeff(); }},
-        {Distance::kMin,
-         [](ArrayXd x, ArrayXd y) { return (x - y).abs().minCoeff(); }},
-        {Distance::kKL,
-         [](ArrayXd x, ArrayXd y) {
-           auto   logX = x.max(epsilon).log(), logY = y.max(epsilon).log();
-           double d1 = (x * (logX - logY)).sum();
-           double d2 = (y * (logY - logX)).sum();
-           return d1 + d2;
-         }},
-        {Distance::kCosine, [](ArrayXd x, ArrayXd y) {
-           double norm = x.matrix().norm() * y.matrix().norm();
-           double dot = x.matrix().dot(y.matrix());
-           return 1 - (dot / norm);
-         }},
-         {Distance::kJS,
-           [](ArrayXd x, ArrayXd y) {
-             x = x.max(epsilon);
-             y = y.max(epsilon);
-             x = x / x.sum();
-             y = y / y.sum();
-             ArrayXd m = (0.5 * x) + (0.5 * y);
-             ArrayXd logX = x.log(),
-              logY = y.log(),
-              logM = m.log();
-              double d1 = (x * (logX - logM)).sum();
-              double d2 =  (y * (logY - logM)).sum();
-            return std::sqrt(0.5*(d1 + d2));
-          }}
-       };
+         [](ArrayXd x, ArrayXd y) { return SqEuclidean{}(x, y); }},
+        {Distance::kMax, [](ArrayXd x, ArrayXd y) { return Max{}(x, y); }},
+        {Distance::kMin, [](ArrayXd x, ArrayXd y) { return Min{}(x, y); }},
+        {Distance::kKL, [](ArrayXd x, ArrayXd y) { return KL{}(x, y); }},
+        {Distance::kCosine,
+         [](ArrayXd x, ArrayXd y) { return Cosine{}(x, y); }},
+        {Distance::kJS, [](ArrayXd x, ArrayXd y) { return JS{}(x, y); }}};
     return _funcs;
   }
 };
 
-Eigen::MatrixXd DistanceMatrix(Eigen::Ref<Eigen::MatrixXd> X, index distance)
+// D(i, j) is the distance between rows i of X and j of Y. Euclidean, squared
+// Euclidean and cosine distances come from a matrix product (via
+// |x - y|^2 = |x|^2 + |y|^2 - 2x.y); the others are evaluated pairwise over
+// tiles of points held contiguously. Blocks of rows of X are shared between
+// up to maxThreads threads (0 for one per hardware thread).
+template <typename DerivedX, typename DerivedY>
+Eigen::MatrixXd DistanceMatrix(const Eigen::DenseBase<DerivedX>& X,
+                               const Eigen::DenseBase<DerivedY>& Y,
+                               index distance, index maxThreads = 1)
 {
-  auto            dist = static_cast<DistanceFuncs::Distance>(distance);
-  Eigen::MatrixXd D = Eigen::MatrixXd::Zero(X.rows(), X.rows());
-  for (index i = 0; i < X.rows(); i++)
+  using namespace Eigen;
+  using Distance = DistanceFuncs::Distance;
+  constexpr index rowBlock = 64;
+  constexpr index tileSize = 256;
+  auto            dist = static_cast<Distance>(distance);
+  // one point per column
+  const MatrixXd Xt = X.derived().matrix().transpose();
+  const MatrixXd Yt = Y.derived().matrix().transpose();
+  MatrixXd       D(Xt.cols(), Yt.cols());
+  if (D.size() == 0) return D;
+  switch (dist)
   {
-    for (index j = 0; j < X.rows(); j++)
-    {
-      D(i, j) = DistanceFuncs::map()[dist](X.row(i).array(), X.row(j).array());
-    }
+  case Distance::kEuclidean:
+  case Distance::kSqEuclidean:
+  {
+    const RowVectorXd yy = Yt.colwise().squaredNorm();
+    parallelFor(
+        Xt.cols(), rowBlock,
+        [&](index start, index end) {
+          auto x = Xt.middleCols(start, end - start);
+          auto block = D.middleRows(start, end - start);
+          block.noalias() = -2.0 * x.transpose() * Yt;
+          block.colwise() += x.colwise().squaredNorm().transpose();
+          block.rowwise() += yy;
+          block = block.cwiseMax(0.0);
+          if (dist == Distance::kEuclidean) block = block.cwiseSqrt();
+        },
+        maxThreads);
+    break;
+  }
+  case Distance::kCosine:
+  {
+    const RowVectorXd yNorm = Yt.colwise().norm();
+    parallelFor(
+        Xt.cols(), rowBlock,
+        [&](index start, index end) {
+          auto x = Xt.middleCols(start, end - start);
+          auto block = D.middleRows(start, end - start);
+          block.noalias() = x.transpose() * Yt;
+          block.array().colwise() /= x.colwise().norm().transpose().array();
+          block.array().rowwise() /= yNorm.array();
+          block.array() = 1 - block.array();
+        },
+        maxThreads);
+    break;
+  }
+  default:
+    DistanceFuncs::visit(dist, [&](auto metric) {
+      parallelFor(
+          Xt.cols(), rowBlock,
+          [&](index start, index end) {
+            for (index tile = 0; tile < Yt.cols(); tile += tileSize)
+            {
+              index tileEnd = std::min(tile + tileSize, Yt.cols());
+              for (index i = start; i < end; i++)
+                for (index j = tile; j < tileEnd; j++)
+                  D(i, j) = metric(Xt.col(i).array(), Yt.col(j).array());
+            }
+          },
+          maxThreads);
+    });
   }
   return D;
 }
 
+// distances between all pairs of rows of X
 template <typename Derived>
-Eigen::MatrixXd DistanceMatrix(const Eigen::PlainObjectBase<Derived>& X,
-                               const Eigen::PlainObjectBase<Derived>& Y,
-                               index                                  distance)
+Eigen::MatrixXd DistanceMatrix(const Eigen::DenseBase<Derived>& X,
+                               index distance, index maxThreads = 1)
 {
-  auto            dist = static_cast<DistanceFuncs::Distance>(distance);
-  Eigen::MatrixXd D = Eigen::MatrixXd::Zero(X.rows(), Y.rows());
-  for (index i = 0; i < X.rows(); i++)
-  {
-    for (index j = 0; j < Y.rows(); j++)
-    {
-      D(i, j) = DistanceFuncs::map()[dist](X.row(i).array(), Y.row(j).array());
-    }
-  }
+  using Distance = DistanceFuncs::Distance;
+  Eigen::MatrixXd D = DistanceMatrix(X, X, distance, maxThreads);
+  // the product form can leave rounding error where there should be none
+  auto dist = static_cast<Distance>(distance);
+  if (dist == Distance::kEuclidean || dist == Distance::kSqEuclidean ||
+      dist == Distance::kCosine)
+    D.diagonal().setZero();
   return D;
 }
 
-
 } // namespace algorithm
 } // namespace fluid
@@ -12,13 +12,21 @@ under the European Union’s Horizon 2020 research and innovation programme
 
 #include "../../data/FluidIndex.hpp"
 #include "../../data/FluidMemory.hpp"
+#include "../../data/FluidTensor.hpp"
 #include <Eigen/Core>
 #include <fft/fft.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <complex>
+#include <deque>
+#include <mutex>
 
 namespace fluid {
 namespace algorithm {
 
 namespace impl {
+template <typename T>
 class FFTSetup
 {
 public:
@@ -47,38 +55,83 @@ public:
     return *this;
   }
 
-  htl::setup_type<double> operator()() const noexcept { return mSetup; }
-  index                   maxSize() const noexcept { return mMaxSize; }
+  htl::setup_type<T> operator()() const noexcept { return mSetup; }
+  index              maxSize() const noexcept { return mMaxSize; }
 
 private:
-  htl::setup_type<double> mSetup{nullptr};
-  index                   mMaxSize;
+  htl::setup_type<T> mSetup{nullptr};
+  index              mMaxSize;
+};
+
+// A setup serves every transform up to its own size, so one per precision is
+// enough. It is replaced by a larger one the first time a bigger FFT is made;
+// older setups are kept because existing FFTs still point at them. The
+// current one is published through an atomic, so only growing takes the lock
+// and FFTs that fit (on the audio thread, say) never wait for a big setup
+// being built elsewhere
+template <typename T>
+class FFTSetupCache
+{
+public:
+  static constexpr index defaultSize = 65536;
+
+  static htl::setup_type<T> get(index size)
+  {
+    static FFTSetupCache cache;
+    FFTSetup<T>* current = cache.mCurrent.load(std::memory_order_acquire);
+    if (current && current->maxSize() >= size) return (*current)();
+
+    std::lock_guard<std::mutex> lock(cache.mMutex);
+    current = cache.mCurrent.load(std::memory_order_relaxed);
+    if (!current || current->maxSize() < size)
+    {
+      index setupSize = defaultSize;
+      if (size > defaultSize)
+        setupSize = index(1)
+                    << static_cast<index>(std::ceil(std::log2(size)));
+      cache.mSetups.emplace_back(setupSize);
+      current = &cache.mSetups.back();
+      cache.mCurrent.store(current, std::memory_order_release);
+    }
+    return (*current)();
+  }
+
+private:
+  std::mutex                mMutex;
+  std::deque<FFTSetup<T>>   mSetups; // growing keeps elements in place
+  std::atomic<FFTSetup<T>*> mCurrent{nullptr};
 };
 } // namespace impl
 
-class FFT
+// Real FFT in single (T = float) or double precision. Sizes aren't capped:
+// transforms larger than 65536 points get their own setup on construction
+template <typename T>
+class BasicFFT
 {
 
 public:
-  using MapXcd = Eigen::Map<Eigen::ArrayXcd>;
+  using ArrayX = Eigen::Array<T, Eigen::Dynamic, 1>;
+  using ArrayXc = Eigen::Array<std::complex<T>, Eigen::Dynamic, 1>;
+  using MapXcd = Eigen::Map<ArrayXc>;
 
   static void setup() { getFFTSetup(); }
 
-  FFT() = delete;
+  BasicFFT() = delete;
 
-  FFT(index size, Allocator& alloc = FluidDefaultAllocator()) noexcept
+  BasicFFT(index size, Allocator& alloc = FluidDefaultAllocator()) noexcept
       : mMaxSize(size), mSize(size), mFrameSize(size / 2 + 1),
-        mLog2Size(static_cast<index>(std::log2(size))), mSetup(getFFTSetup()),
+        mLog2Size(static_cast<index>(std::log2(size))),
+        mSetup(getFFTSetup(size)),
         mRealBuffer(asUnsigned(mFrameSize), alloc),
         mImagBuffer(asUnsigned(mFrameSize), alloc),
         mOutputBuffer(asUnsigned(mFrameSize), alloc)
   {}
 
-  FFT(const FFT& other) = delete;
-  FFT(FFT&& other) noexcept = default;
+  BasicFFT(const BasicFFT& other) = delete;
+  BasicFFT(BasicFFT&& other) noexcept = default;
 
-  FFT& operator=(const FFT&) = delete;
-  FFT& operator=(FFT&& other) noexcept = default;
+  BasicFFT& operator=(const BasicFFT&) = delete;
+  BasicFFT& operator=(BasicFFT&& other) noexcept = default;
 
   void resize(index newSize) noexcept
   {
@@ -88,73 +141,141 @@ public:
     mSize = newSize;
   }
 
-  MapXcd process(const Eigen::Ref<const Eigen::ArrayXd>& input)
+  MapXcd process(const Eigen::Ref<const ArrayX>& input)
   {
-
-    mSplit.realp = mRealBuffer.data();
-    mSplit.imagp = mImagBuffer.data();
-    htl::rfft(mSetup, input.derived().data(), &mSplit, asUnsigned(input.size()),
-              asUnsigned(mLog2Size));
-    mSplit.realp[mFrameSize - 1] = mSplit.imagp[0];
-    mSplit.imagp[mFrameSize - 1] = 0;
-    mSplit.imagp[0] = 0;
-    for (index i = 0; i < mFrameSize; i++)
-    {
-      mOutputBuffer[asUnsigned(i)] =
-          0.5 * std::complex<double>(mSplit.realp[i], mSplit.imagp[i]);
-    }
+    transform(input.data(), input.size(), mOutputBuffer.data(), 1);
     return {mOutputBuffer.data(), mFrameSize};
   }
 
+  // Transforms frame, zero padded up to the FFT size, straight into out
+  void process(FluidTensorView<const T, 1>          frame,
+               FluidTensorView<std::complex<T>, 1> out)
+  {
+    assert(frame.size() <= mSize && out.size() == mFrameSize);
+    assert(frame.size() < 2 || frame.descriptor().strides[0] == 1);
+    transform(frame.data(), frame.size(), out.data(),
+              out.descriptor().strides[0]);
+  }
+
+  // Batch version: each row of frames becomes the matching row of out
+  void process(FluidTensorView<const T, 2>          frames,
+               FluidTensorView<std::complex<T>, 2> out)
+  {
+    assert(frames.rows() == out.rows());
+    for (index i = 0; i < frames.rows(); i++)
+      process(frames.row(i), out.row(i));
+  }
+
+  index size() const noexcept { return mSize; }
+  index frameSize() const noexcept { return mFrameSize; }
+
 protected:
-  static htl::setup_type<double> getFFTSetup()
+  static htl::setup_type<T> getFFTSetup(index size = 0)
   {
-    static const impl::FFTSetup static_setup(65536);
-    return static_setup();
+    return impl::FFTSetupCache<T>::get(size);
   }
 
+protected:
   index mMaxSize{16384};
   index mSize{1024};
   index mFrameSize{513};
   index mLog2Size{10};
 
-  htl::setup_type<double> mSetup;
-  htl::split_type<double> mSplit;
-  rt::vector<double>      mRealBuffer;
-  rt::vector<double>      mImagBuffer;
+  htl::setup_type<T> mSetup;
+  htl::split_type<T> mSplit;
+  rt::vector<T>      mRealBuffer;
+  rt::vector<T>      mImagBuffer;
 
 private:
-  rt::vector<std::complex<double>> mOutputBuffer;
+  // Writes the unscaled packed output of rfft into the complex frame at
+  // output, whose bins are stride elements apart
+  void transform(const T* input, index size, std::complex<T>* output,
+                 index stride)
+  {
+    mSplit.realp = mRealBuffer.data();
+    mSplit.imagp = mImagBuffer.data();
+    htl::rfft(mSetup, input, &mSplit, asUnsigned(size), asUnsigned(mLog2Size));
+    mSplit.realp[mFrameSize - 1] = mSplit.imagp[0];
+    mSplit.imagp[mFrameSize - 1] = 0;
+    mSplit.imagp[0] = 0;
+    Eigen::Map<ArrayXc, 0, Eigen::InnerStride<>> out(
+        output, mFrameSize, Eigen::InnerStride<>(stride));
+    out.real() = T(0.5) * Eigen::Map<ArrayX>(mSplit.realp, mFrameSize);
+    out.imag() = T(0.5) * Eigen::Map<ArrayX>(mSplit.imagp, mFrameSize);
+  }
+
+  rt::vector<std::complex<T>> mOutputBuffer;
 };
 
-class IFFT : public FFT
+template <typename T>
+class BasicIFFT : public BasicFFT<T>
 {
+  using BasicFFT<T>::mFrameSize;
+  using BasicFFT<T>::mImagBuffer;
+  using BasicFFT<T>::mLog2Size;
+  using BasicFFT<T>::mRealBuffer;
+  using BasicFFT<T>::mSetup;
+  using BasicFFT<T>::mSize;
+  using BasicFFT<T>::mSplit;
 
 public:
-  IFFT(index size, Allocator& alloc = FluidDefaultAllocator())
-      : FFT(size, alloc), mOutputBuffer(asUnsigned(size), alloc)
+  BasicIFFT(index size, Allocator& alloc = FluidDefaultAllocator())
+      : BasicFFT<T>(size, alloc), mOutputBuffer(asUnsigned(size), alloc)
   {}
 
-  using MapXd = Eigen::Map<Eigen::ArrayXd>;
+  using ArrayXc = typename BasicFFT<T>::ArrayXc;
+  using MapXd = Eigen::Map<typename BasicFFT<T>::ArrayX>;
 
-  MapXd process(const Eigen::Ref<const Eigen::ArrayXcd>& input)
+  MapXd process(const Eigen::Ref<const ArrayXc>& input)
   {
     assert(input.size() == mFrameSize);
+    transform(input.data(), 1, mOutputBuffer.data());
+    return {mOutputBuffer.data(), mSize};
+  }
 
-    mSplit.realp = mRealBuffer.data();
-    mSplit.imagp = mImagBuffer.data();
-    for (index i = 0; i < input.size(); i++)
+  // Writes the first out.size() samples of the inverse of in, straight into
+  // out when it takes the whole transform
+  void process(FluidTensorView<const std::complex<T>, 1> in,
+               FluidTensorView<T, 1>                     out)
+  {
+    assert(in.size() == mFrameSize && out.size() <= mSize);
+    index inStride = in.descriptor().strides[0];
+    if (out.size() == mSize && out.descriptor().strides[0] == 1)
+      transform(in.data(), inStride, out.data());
+    else
     {
-      mSplit.realp[i] = input(i).real();
-      mSplit.imagp[i] = input(i).imag();
+      transform(in.data(), inStride, mOutputBuffer.data());
+      out <<= FluidTensorView<T, 1>(mOutputBuffer.data(), 0, out.size());
     }
-    mSplit.imagp[0] = mSplit.realp[mFrameSize - 1];
-    htl::rifft(mSetup, &mSplit, mOutputBuffer.data(), asUnsigned(mLog2Size));
-    return {mOutputBuffer.data(), mSize};
+  }
+
+  // Batch version: each row of in becomes the matching row of out
+  void process(FluidTensorView<const std::complex<T>, 2> in,
+               FluidTensorView<T, 2>                     out)
+  {
+    assert(in.rows() == out.rows());
+    for (index i = 0; i < in.rows(); i++) process(in.row(i), out.row(i));
   }
 
 private:
-  rt::vector<double> mOutputBuffer;
+  void transform(const std::complex<T>* input, index stride, T* output)
+  {
+    Eigen::Map<const ArrayXc, 0, Eigen::InnerStride<>> in(
+        input, mFrameSize, Eigen::InnerStride<>(stride));
+    mSplit.realp = mRealBuffer.data();
+    mSplit.imagp = mImagBuffer.data();
+    Eigen::Map<typename BasicFFT<T>::ArrayX>(mSplit.realp, mFrameSize) =
+        in.real();
+    Eigen::Map<typename BasicFFT<T>::ArrayX>(mSplit.imagp, mFrameSize) =
+        in.imag();
+    mSplit.imagp[0] = mSplit.realp[mFrameSize - 1];
+    htl::rifft(mSetup, &mSplit, output, asUnsigned(mLog2Size));
+  }
+
+  rt::vector<T> mOutputBuffer;
 };
+
+using FFT = BasicFFT<double>;
+using IFFT = BasicIFFT<double>;
 } // namespace algorithm
 } // namespace fluid
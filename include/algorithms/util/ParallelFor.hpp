@@ -0,0 +1,130 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+
+#pragma once
+
+#include "ThreadPool.hpp"
+#include "../../data/FluidIndex.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+
+namespace fluid {
+namespace algorithm {
+
+namespace _impl {
+
+// Lets a parallelFor caller wait for the helpers that have started on its
+// loop, and turns away any that only start once it has closed the gate
+class HelperGate
+{
+public:
+  bool enter()
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mClosed) return false;
+    mRunning++;
+    return true;
+  }
+
+  void leave()
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (--mRunning == 0) mDone.notify_all();
+  }
+
+  void close()
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mClosed = true;
+    mDone.wait(lock, [this]() { return mRunning == 0; });
+  }
+
+  // keeps the first error only
+  void fail(std::exception_ptr error)
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mError) mError = error;
+  }
+
+  std::exception_ptr error()
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mError;
+  }
+
+private:
+  std::mutex              mMutex;
+  std::condition_variable mDone;
+  index                   mRunning{0};
+  bool                    mClosed{false};
+  std::exception_ptr      mError;
+};
+
+} // namespace _impl
+
+// Calls f(start, end) over consecutive blocks of [0, n), each at most grain
+// long, spread over up to maxThreads threads (the calling thread included;
+// 0 means as many as ThreadPool::instance() allows, which also caps larger
+// requests). Helpers are the pool's workers, so loops share its limit with
+// NRT jobs, and the caller works through whatever blocks no free worker
+// takes. Blocks are handed out dynamically, so f must be safe to call
+// concurrently on disjoint ranges. The first exception thrown by f stops
+// any further blocks being handed out and is rethrown here.
+template <typename F>
+void parallelFor(index n, index grain, F&& f, index maxThreads = 0)
+{
+  if (n <= 0) return;
+  grain = std::max<index>(grain, 1);
+  const index nBlocks = (n + grain - 1) / grain;
+  ThreadPool& pool = ThreadPool::instance();
+  const index limit = pool.maxThreads();
+  const index nThreads = std::min(
+      {nBlocks, maxThreads > 0 ? maxThreads : limit, limit});
+
+  if (nThreads <= 1)
+  {
+    f(index(0), n);
+    return;
+  }
+
+  auto               gate = std::make_shared<_impl::HelperGate>();
+  std::atomic<index> nextBlock{0};
+  auto               work = [&]() {
+    try
+    {
+      for (index b = nextBlock++; b < nBlocks; b = nextBlock++)
+        f(b * grain, std::min(n, (b + 1) * grain));
+    }
+    catch (...)
+    {
+      nextBlock = nBlocks;
+      gate->fail(std::current_exception());
+    }
+  };
+
+  // a helper only touches this frame between entering and leaving the gate,
+  // and close() doesn't return while one is inside
+  for (index i = 0; i < nThreads - 1; i++)
+    pool.offer([gate, &work]() {
+      if (!gate->enter()) return;
+      work();
+      gate->leave();
+    });
+  work();
+  gate->close();
+  if (auto error = gate->error()) std::rethrow_exception(error);
+}
+
+} // namespace algorithm
+} // namespace fluid
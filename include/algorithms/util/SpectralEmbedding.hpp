@@ -4,6 +4,9 @@
 #include <Eigen/Sparse>
 #include <Spectra/MatOp/SparseSymMatProd.h>
 #include <Spectra/SymEigsSolver.h>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
 
 namespace fluid {
 namespace algorithm {
@@ -16,41 +19,75 @@ public:
   using ArrayXXd = Eigen::ArrayXXd;
   using SparseMatrixXd = Eigen::SparseMatrix<double>;
 
-  ArrayXXd train(SparseMatrixXd graph, index dims)
+  // Embeds the nodes of a symmetric affinity graph with the eigenvectors of
+  // its normalised Laplacian L that have the smallest eigenvalues after the
+  // trivial one. They are found as the largest eigenvectors of I - L, which
+  // Lanczos iterations converge on much faster. The eigenvectors from the
+  // previous call seed the search when they fit (an embedding of no more
+  // nodes in as many dimensions, such as one from before nodes were
+  // appended, padded with zeros for the new nodes). If the solver hasn't
+  // converged within maxIter restarts, converged() is false and the result
+  // is empty, for the caller to fall back on another initialisation.
+  ArrayXXd train(SparseMatrixXd graph, index dims, index maxIter = 1000,
+                 double tolerance = 1e-4)
   {
     using namespace Eigen;
     using namespace Spectra;
     using namespace std;
+    mConverged = false;
+    mIterations = 0;
     VectorXd diagData = graph * VectorXd::Ones(graph.cols());
     diagData = (1 / diagData.array().sqrt());
     SparseMatrixXd D = SparseMatrixXd(graph.rows(), graph.cols());
     D.reserve(graph.rows());
     for (index i = 0; i < D.rows(); i++) { D.insert(i, i) = diagData(i); }
-    SparseMatrixXd I = SparseMatrixXd(D.rows(), D.cols());
-    I.setIdentity();
-    SparseMatrixXd L = I - (D * (graph * D));
+    SparseMatrixXd M = D * (graph * D); // I - L
     int            k = static_cast<int>(dims + 1);
-    index          ncv = max(2 * k + 1, int(round(sqrt(L.rows()))));
-    VectorXd       initV = VectorXd::Ones(L.rows());
-
-    SparseSymMatProd<double> op(L);
-    SymEigsSolver<SparseSymMatProd<double>> eig(op, k, ncv);    
-    eig.init(initV.data());
-    eig.compute(Spectra::SortRule::SmallestMagn, 1000, 1e-4); 
-    // TODO: failback if not converging
-    mEigenVectors = eig.eigenvectors();
-    mEigenValues = eig.eigenvalues();
+    index          ncv = max(2 * k + 1, int(round(sqrt(M.rows()))));
+    ncv = min(ncv, M.rows());
+    VectorXd initV = VectorXd::Ones(M.rows());
+    if (mEigenVectors.cols() == k && mEigenVectors.rows() <= M.rows())
+    {
+      initV.setZero();
+      initV.head(mEigenVectors.rows()) = mEigenVectors.rowwise().sum();
+    }
+
+    try
+    {
+      SparseSymMatProd<double>                op(M);
+      SymEigsSolver<SparseSymMatProd<double>> eig(op, k, ncv);
+      eig.init(initV.data());
+      eig.compute(SortRule::LargestAlge, maxIter, tolerance);
+      mIterations = static_cast<index>(eig.num_iterations());
+      if (eig.info() != CompInfo::Successful) return ArrayXXd();
+      // largest first, so the trivial eigenvector comes first
+      mEigenVectors = eig.eigenvectors();
+      mEigenValues = 1 - eig.eigenvalues().array();
+    }
+    catch (const std::exception&) // e.g. too few nodes for the dimensions
+    {
+      return ArrayXXd();
+    }
+    mConverged = true;
     ArrayXXd Y = mEigenVectors.block(0, 1, mEigenVectors.rows(), dims).array();
     return Y;
   }
 
+  bool converged() const { return mConverged; }
+
+  // restarts the solver took on the last call
+  index iterations() const { return mIterations; }
+
   Eigen::MatrixXd eigenVectors() { return mEigenVectors; }
 
+  // of the Laplacian, smallest first
   Eigen::MatrixXd eigenValues() { return mEigenValues; }
 
 private:
   Eigen::MatrixXd mEigenVectors;
   Eigen::MatrixXd mEigenValues;
+  bool            mConverged{false};
+  index           mIterations{0};
 };
 }// namespace algorithm
 }// namespace fluid
@@ -0,0 +1,232 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+#pragma once
+
+#include "../../data/FluidIndex.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace fluid {
+namespace algorithm {
+
+inline index hardwareThreads()
+{
+  return std::max<index>(std::thread::hardware_concurrency(), 1);
+}
+
+// Worker threads shared by everything the library runs in the background:
+// whole jobs, queued in submission order, and short helper tasks, which
+// parallelFor offers to spread a loop and which go ahead of queued jobs.
+// Threads are started on demand and kept for reuse, and at most maxThreads()
+// tasks of either kind run at once.
+class ThreadPool
+{
+public:
+  // Never destroyed, so that exiting doesn't wait on jobs that their owners
+  // have already let go of. Hosts that unload the library first call
+  // shutdown(), so that no worker outlives the code it runs
+  static ThreadPool& instance()
+  {
+    static ThreadPool* pool = new ThreadPool;
+    return *pool;
+  }
+
+  // Stops and joins the shared pool's workers (see stop()). Safe to call
+  // more than once
+  static void shutdown() { instance().stop(); }
+
+  explicit ThreadPool(index maxThreads = 0) { setMaxThreads(maxThreads); }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // Waits for running tasks; queued jobs are dropped, which makes their
+  // futures ready with a broken_promise error
+  ~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mStop = true;
+    }
+    stop();
+  }
+
+  // Joins every worker once its current task has returned, dropping queued
+  // jobs as the destructor does. Work submitted afterwards starts new
+  // workers. Mustn't be called from a task running on this pool
+  void stop()
+  {
+    std::vector<std::thread>          workers;
+    std::deque<Job>                   jobs; // destroyed outside the lock
+    std::deque<std::function<void()>> helpers;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mGeneration++;
+      mIdle = 0; // the old workers won't take anything else
+      std::swap(workers, mWorkers);
+      std::swap(jobs, mJobs);
+      std::swap(helpers, mHelpers);
+    }
+    mWake.notify_all();
+    for (auto& t : workers) t.join();
+  }
+
+  // Workers started and not yet stopped
+  index threads() const
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return asSigned(mWorkers.size());
+  }
+
+  // 0 means one per hardware thread. Lowering the limit doesn't interrupt
+  // running tasks, it just holds back new ones until enough have finished
+  void setMaxThreads(index n)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mMaxThreads = n > 0 ? n : hardwareThreads();
+    }
+    mWake.notify_all();
+  }
+
+  index maxThreads() const
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mMaxThreads;
+  }
+
+  // The future becomes ready once f has returned. If id is given, it
+  // receives a handle for withdraw(). A pool that is being destroyed can't
+  // queue anything, so it runs f on the calling thread instead (and sets id
+  // to -1).
+  template <typename F>
+  std::future<void> submit(F&& f, index* id = nullptr)
+  {
+    auto job = std::make_shared<std::packaged_task<void()>>(std::forward<F>(f));
+    auto result = job->get_future();
+    bool queued = false;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      if (id) *id = mStop ? -1 : mNextId;
+      if (!mStop)
+      {
+        mJobs.push_back({mNextId++, [job]() { (*job)(); }});
+        startWorkerIfNeeded();
+        queued = true;
+      }
+    }
+    if (queued)
+      mWake.notify_one();
+    else
+      (*job)();
+    return result;
+  }
+
+  // Takes a job that hasn't started off the queue, making its future ready
+  // (with a broken_promise error) straight away. Returns false if the job
+  // has already started, or finished.
+  bool withdraw(index id)
+  {
+    std::function<void()> dropped; // destroyed outside the lock
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      auto job = std::find_if(mJobs.begin(), mJobs.end(),
+                              [id](Job const& j) { return j.id == id; });
+      if (job == mJobs.end()) return false;
+      dropped = std::move(job->run);
+      mJobs.erase(job);
+    }
+    return true;
+  }
+
+  // Runs task on a worker as soon as one is free, ahead of any queued jobs.
+  // Nothing waits for it, so the caller has to arrange that itself; task
+  // mustn't throw.
+  void offer(std::function<void()> task)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      if (mStop) return;
+      mHelpers.push_back(std::move(task));
+      startWorkerIfNeeded();
+    }
+    mWake.notify_one();
+  }
+
+private:
+  void startWorkerIfNeeded()
+  {
+    if (asSigned(mJobs.size() + mHelpers.size()) > mIdle &&
+        asSigned(mWorkers.size()) < mMaxThreads)
+      mWorkers.emplace_back([this, g = mGeneration]() { work(g); });
+  }
+
+  // workers leave once stop() has moved on to a later generation
+  void work(index generation)
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (mGeneration == generation)
+    {
+      mIdle++;
+      mWake.wait(lock, [this, generation]() {
+        return mGeneration != generation ||
+               ((!mJobs.empty() || !mHelpers.empty()) &&
+                mActive < mMaxThreads);
+      });
+      if (mGeneration != generation) return;
+      mIdle--;
+      std::function<void()> task;
+      if (!mHelpers.empty())
+      {
+        task = std::move(mHelpers.front());
+        mHelpers.pop_front();
+      }
+      else
+      {
+        task = std::move(mJobs.front().run);
+        mJobs.pop_front();
+      }
+      mActive++;
+      lock.unlock();
+      task();
+      lock.lock();
+      mActive--;
+      if (!mJobs.empty() || !mHelpers.empty()) mWake.notify_one();
+    }
+  }
+
+  struct Job
+  {
+    index                 id;
+    std::function<void()> run;
+  };
+
+  mutable std::mutex                mMutex;
+  std::condition_variable           mWake;
+  std::deque<Job>                   mJobs;
+  std::deque<std::function<void()>> mHelpers;
+  std::vector<std::thread>          mWorkers;
+  index                             mMaxThreads{1};
+  index                             mActive{0};
+  index                             mIdle{0};
+  index                             mNextId{0};
+  index                             mGeneration{0};
+  bool                              mStop{false};
+};
+
+} // namespace algorithm
+} // namespace fluid
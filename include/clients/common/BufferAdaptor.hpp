@@ -141,6 +141,9 @@ public:
     //      destroy();
   }
 
+  // The host's name for the buffer, for messages
+  virtual std::string asString() const = 0;
+
 private:
   virtual bool         acquire() const = 0;
   virtual void         release() const = 0;
@@ -148,7 +151,6 @@ private:
   virtual bool         exists() const = 0;
   virtual const Result resize(index frames, index channels,
                               double sampleRate) = 0;
-  virtual std::string  asString() const = 0;
   // Return a slice of the buffer
   virtual FluidTensorView<float, 1>       samps(index channel) = 0;
   virtual FluidTensorView<float, 1>       samps(index offset, index nframes,
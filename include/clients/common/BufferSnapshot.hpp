@@ -0,0 +1,181 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+
+#pragma once
+
+#include "BufferAdaptor.hpp"
+#include "../../data/FluidIndex.hpp"
+#include "../../data/FluidTensor.hpp"
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace fluid {
+namespace client {
+
+// Read-only copy of a buffer for background jobs. Snapshots of the same
+// buffer share one immutable copy of its samples for as long as any of them
+// is alive and the buffer's contents haven't changed, so launching several
+// jobs against one long input only copies it once.
+class BufferSnapshot : public BufferAdaptor
+{
+  struct Frames
+  {
+    FluidTensor<float, 2> data; // channels x frames, so channels are contiguous
+    double                sampleRate{44100};
+    bool                  valid{false};
+    bool                  exists{false};
+    std::string           name;
+  };
+
+public:
+  using FramesPointer = std::shared_ptr<const Frames>;
+
+  // The registry is only locked to look up and publish: comparing against
+  // or copying a long buffer happens outside it, so takes of other buffers
+  // don't wait. Two racing takes of one changed buffer may both copy it;
+  // whichever publishes last is shared from then on
+  static std::shared_ptr<const BufferAdaptor>
+  take(std::shared_ptr<const BufferAdaptor> const& origin)
+  {
+    FramesPointer cached;
+    {
+      std::lock_guard<std::mutex> lock(registryMutex());
+      auto&                       registry = snapshots();
+      for (auto i = registry.begin(); i != registry.end();)
+        i = i->second.expired() ? registry.erase(i) : std::next(i);
+      auto entry = registry.find(origin.get());
+      if (entry != registry.end()) cached = entry->second.lock();
+    }
+
+    BufferAdaptor::ReadAccess src(origin.get());
+    if (cached && matches(*cached, src))
+      return std::make_shared<const BufferSnapshot>(cached);
+    auto frames = copy(origin.get(), src);
+    {
+      std::lock_guard<std::mutex> lock(registryMutex());
+      snapshots()[origin.get()] = frames;
+    }
+    return std::make_shared<const BufferSnapshot>(frames);
+  }
+
+  explicit BufferSnapshot(FramesPointer frames) : mFrames{std::move(frames)} {}
+
+  FramesPointer frames() const { return mFrames; }
+
+  bool acquire() const override { return true; }
+  void release() const override {}
+  bool valid() const override { return mFrames->valid; }
+  bool exists() const override { return mFrames->exists; }
+
+  const Result resize(index, index, double) override
+  {
+    return {Result::Status::kError, "Buffer snapshots are read only"};
+  }
+
+  FluidTensorView<const float, 2> allFrames() const override
+  {
+    return mFrames->data;
+  }
+
+  FluidTensorView<const float, 1> samps(index channel) const override
+  {
+    return mFrames->data.row(channel);
+  }
+
+  FluidTensorView<const float, 1> samps(index offset, index nframes,
+                                        index chanoffset) const override
+  {
+    return mFrames->data(Slice(chanoffset, 1), Slice(offset, nframes)).row(0);
+  }
+
+  // Snapshots are only ever handed out as const, so these are unreachable
+  FluidTensorView<float, 2> allFrames() override
+  {
+    assert(false && "Buffer snapshots are read only");
+    return {nullptr, 0, 0, 0};
+  }
+
+  FluidTensorView<float, 1> samps(index) override
+  {
+    assert(false && "Buffer snapshots are read only");
+    return {nullptr, 0, 0};
+  }
+
+  FluidTensorView<float, 1> samps(index, index, index) override
+  {
+    assert(false && "Buffer snapshots are read only");
+    return {nullptr, 0, 0};
+  }
+
+  index       numFrames() const override { return mFrames->data.cols(); }
+  index       numChans() const override { return mFrames->data.rows(); }
+  double      sampleRate() const override { return mFrames->sampleRate; }
+  std::string asString() const override { return mFrames->name; }
+
+private:
+  static bool matches(Frames const& frames, BufferAdaptor::ReadAccess& src)
+  {
+    if (frames.exists != src.exists() || frames.valid != src.valid())
+      return false;
+    if (!frames.valid) return true;
+    if (frames.sampleRate != src.sampleRate() ||
+        frames.data.rows() != src.numChans() ||
+        frames.data.cols() != src.numFrames())
+      return false;
+    for (index i = 0; i < frames.data.rows(); i++)
+    {
+      auto channel = src.samps(0, src.numFrames(), i);
+      auto cached = frames.data.row(i);
+      if (!std::equal(cached.begin(), cached.end(), channel.begin()))
+        return false;
+    }
+    return true;
+  }
+
+  static FramesPointer copy(const BufferAdaptor*       origin,
+                            BufferAdaptor::ReadAccess& src)
+  {
+    auto frames = std::make_shared<Frames>();
+    frames->exists = src.exists();
+    frames->valid = src.valid();
+    frames->name = origin->asString();
+    if (frames->valid)
+    {
+      frames->sampleRate = src.sampleRate();
+      frames->data.resize(src.numChans(), src.numFrames());
+      for (index i = 0; i < frames->data.rows(); i++)
+        frames->data.row(i) <<= src.samps(0, src.numFrames(), i);
+    }
+    return frames;
+  }
+
+  using Registry =
+      std::unordered_map<const BufferAdaptor*, std::weak_ptr<const Frames>>;
+
+  static Registry& snapshots()
+  {
+    static Registry registry;
+    return registry;
+  }
+
+  static std::mutex& registryMutex()
+  {
+    static std::mutex m;
+    return m;
+  }
+
+  FramesPointer mFrames;
+};
+
+} // namespace client
+} // namespace fluid
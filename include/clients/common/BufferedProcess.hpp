@@ -31,18 +31,22 @@ using HostVector = FluidTensorView<T, 1>;
 template <typename T>
 using HostMatrix = FluidTensorView<T, 2>;
 
-class BufferedProcess
+// Buffers host vectors into overlapping windows, processed in Real precision.
+// Input windows are views straight into the source's ring buffer, so
+// processing functions must treat them as read only
+template <typename Real>
+class BasicBufferedProcess
 {
+  using RealMatrixView = FluidTensorView<Real, 2>;
 
 public:
-  BufferedProcess(index maxFramesIn, index maxFramesOut, index maxChannelsIn,
+  BasicBufferedProcess(index maxFramesIn, index maxFramesOut, index maxChannelsIn,
       index maxChannelsOut, index hostSize,
       Allocator& alloc = FluidDefaultAllocator())
       : mHostSize(hostSize),
         mMaxHostSize(hostSize),
         mSource(maxFramesIn, maxChannelsIn, mMaxHostSize, alloc),
         mSink(maxFramesOut, maxChannelsOut, mMaxHostSize, alloc),
-        mFrameIn(asUnsigned(maxChannelsIn * maxFramesIn), alloc),
         mFrameOut(asUnsigned(maxChannelsOut * maxFramesOut), alloc)
   {}
 
@@ -56,10 +60,9 @@ public:
            "Window out bigger than maximum");
     for (; mFrameTime < mHostSize; mFrameTime += hopSize)
     {
-      RealMatrixView windowIn{mFrameIn.data(), 0, channelsIn(), windowSizeIn};
+      RealMatrixView windowIn = mSource.window(windowSizeIn, mFrameTime);
       RealMatrixView windowOut{
           mFrameOut.data(), 0, channelsOut(), windowSizeOut};
-      mSource.pull(windowIn, mFrameTime);
       processFunc(windowIn, windowOut);
       mSink.push(windowOut, mFrameTime);
 
@@ -79,9 +82,7 @@ public:
     assert(windowSize <= maxWindowSizeIn() && "Window bigger than maximum");
     for (; mFrameTime < mHostSize; mFrameTime += hopSize)
     {
-      RealMatrixView windowIn{mFrameIn.data(), 0, channelsIn(), windowSize};
-      mSource.pull(windowIn, mFrameTime);
-      processFunc(windowIn);
+      processFunc(mSource.window(windowSize, mFrameTime));
 
       if (FluidTask* t = c.task())
         if (!t->processUpdate(
@@ -160,15 +161,18 @@ private:
   index               mFrameTime = 0;
   index               mHostSize;
   index               mMaxHostSize;
-  FluidSource<double> mSource;
-  FluidSink<double>   mSink;
-  rt::vector<double>  mFrameIn;
-  rt::vector<double>  mFrameOut;
+  FluidSource<Real> mSource;
+  FluidSink<Real>   mSink;
+  rt::vector<Real>  mFrameOut;
 };
 
-template <bool Normalise = true>
+using BufferedProcess = BasicBufferedProcess<double>;
+
+template <bool Normalise = true, typename Real = double>
 class STFTBufferedProcess
 {
+  using RealMatrixView = FluidTensorView<Real, 2>;
+  using ComplexMatrixView = FluidTensorView<std::complex<Real>, 2>;
 
 public:
   STFTBufferedProcess(FFTParams fftParams, index channelsIn, index channelsOut,
@@ -220,7 +224,7 @@ public:
           {
             out.row(chansOut) <<= mSTFT.window();
             out.row(chansOut).apply(
-                mISTFT.window(), [](double& x, double& y) { x *= y; });
+                mISTFT.window(), [](Real& x, Real& y) { x *= y; });
           }
         });
 
@@ -232,7 +236,7 @@ public:
     {
       if (Normalise)
         unnormalisedFrame.row(i).apply(
-            unnormalisedFrame.row(chansOut), [](double& x, double g) {
+            unnormalisedFrame.row(chansOut), [](Real& x, Real g) {
               if (x != 0) { x /= (g > 0) ? g : 1; }
             });
       if (output[asUnsigned(i)].data())
@@ -287,7 +291,7 @@ public:
           {
             out.row(chansOut) <<= mSTFT.window();
             out.row(chansOut).apply(
-                mISTFT.window(), [](double& x, double& y) { x *= y; });
+                mISTFT.window(), [](Real& x, Real& y) { x *= y; });
           }
         });
 
@@ -298,7 +302,7 @@ public:
     {
       if (Normalise)
         unnormalisedFrame.row(i).apply(
-            unnormalisedFrame.row(chansOut), [](double& x, double g) {
+            unnormalisedFrame.row(chansOut), [](Real& x, Real g) {
               if (x != 0) { x /= (g > 0) ? g : 1; }
             });
       if (output[asUnsigned(i)].data())
@@ -327,12 +331,12 @@ private:
   }
 
   ParameterTrackChanges<index, index, index> mTrackValues;
-  BufferedProcess                            mBufferedProcess;
-  rt::vector<std::complex<double>>           mSpectrumIn;
-  rt::vector<std::complex<double>>           mSpectrumOut;
-  rt::vector<double>                         mFrameAndWindow;
-  algorithm::STFT                            mSTFT;
-  algorithm::ISTFT                           mISTFT;
+  BasicBufferedProcess<Real>                 mBufferedProcess;
+  rt::vector<std::complex<Real>>             mSpectrumIn;
+  rt::vector<std::complex<Real>>             mSpectrumOut;
+  rt::vector<Real>                           mFrameAndWindow;
+  algorithm::BasicSTFT<Real>                 mSTFT;
+  algorithm::BasicISTFT<Real>                mISTFT;
 };
 
 } // namespace client
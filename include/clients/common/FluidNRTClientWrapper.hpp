@@ -10,8 +10,10 @@ under the European Union’s Horizon 2020 research and innovation programme
 #pragma once
 
 #include "../common/BufferAdaptor.hpp"
+#include "../common/BufferSnapshot.hpp"
 #include "../common/FluidBaseClient.hpp"
 #include "../common/MemoryBufferAdaptor.hpp"
+#include "../common/NRTThreadPool.hpp"
 #include "../common/OfflineClient.hpp"
 #include "../common/ParameterSet.hpp"
 #include "../common/ParameterTypes.hpp"
@@ -19,8 +21,12 @@ under the European Union’s Horizon 2020 research and innovation programme
 #include "../../data/FluidIndex.hpp"
 #include "../../data/FluidTensor.hpp"
 #include "../../data/TensorTypes.hpp"
+#include "../../algorithms/util/ParallelFor.hpp"
+#include <atomic>
 #include <deque>
 #include <future>
+#include <memory>
+#include <mutex>
 #include <thread>
 #include <vector>
 
@@ -214,13 +220,15 @@ public:
       : mParams{x.mParams}, mNRTContext{x.mNRTContext},
         mRealTimeParams{RTClient::getParameterDescriptors(),
                         mParams.get().template subset<ParamOffset>()},
-        mClient{mRealTimeParams, mNRTContext}
+        mClient{mRealTimeParams, mNRTContext},
+        mChannelThreads{x.mChannelThreads}
   {}
 
 
   NRTClientWrapper(NRTClientWrapper&& x)
       : mParams{std::move(x.mParams)},
-        mNRTContext{std::move(x.mNRTContext)}, mClient{std::move(x.mClient)}
+        mNRTContext{std::move(x.mNRTContext)}, mClient{std::move(x.mClient)},
+        mChannelThreads{x.mChannelThreads}
   {
     mRealTimeParams =
         RTParamSetViewType(RTClient::getParameterDescriptors(),
@@ -233,6 +241,7 @@ public:
     mParams = x.mParams;
     mClient = x.mClient;
     mNRTContext = x.mNRTContext;
+    mChannelThreads = x.mChannelThreads;
     mRealTimeParams =
         RTParamSetViewType(RTClient::getParameterDescriptors(),
                            mParams.get().template subset<ParamOffset>());
@@ -246,6 +255,7 @@ public:
     swap(mClient, x.mClient);
     swap(mParams, x.mParams);
     swap(mNRTContext, x.mNRTContext);
+    swap(mChannelThreads, x.mChannelThreads);
     mRealTimeParams =
         RTParamSetViewType(RTClient::getParameterDescriptors(),
                            mParams.get().template subset<ParamOffset>());
@@ -273,6 +283,17 @@ public:
     return isControl ? 1 : mClient.audioChannelsOut();
   }
 
+  // How many threads process() may spread channels across, or processBatch()
+  // its items, each with its own copy of the wrapped client. The default, 1,
+  // processes everything one after another; 0 means as many as the shared
+  // NRTThreadPool allows. Hosts set it through
+  // NRTThreadingAdaptor::setChannelThreads()
+  index channelThreads() const noexcept { return mChannelThreads; }
+  void  channelThreads(index n) noexcept
+  {
+    mChannelThreads = std::max<index>(n, 0);
+  }
+
   void setParams(ParamSetViewType& p)
   {
     mParams = p;
@@ -319,41 +340,19 @@ public:
       count++;
     }
 
-    if (std::all_of(outputBuffers.begin(), outputBuffers.end(), [](auto& b) {
-          if (!b) return true;
-
-          BufferAdaptor::Access buf(b);
-          return !buf.exists();
-        }))
-      return {Result::Status::kError, "No valid output has been set"}; // error
-
-
-    Result r{Result::Status::kOk, ""};
-
-    // Remove non-existent output buffers from the output buffers vector, so
-    // clients don't try and use them
-    std::transform(
-        outputBuffers.begin(), outputBuffers.end(), outputBuffers.begin(),
-        [&r](auto& b) -> BufferAdaptor* {
-          if (!b) return nullptr;
-          BufferAdaptor::Access buf(b);
-          if (!buf.exists())
-          {
-            r.set(Result::Status::kWarning);
-            r.addMessage("One or more of your output buffers doesn't exist\n");
-          }
-          return buf.exists() ? b : nullptr;
-        });
-
+    Result r = checkOutputBuffers(outputBuffers);
+    if (r.status() == Result::Status::kError) return r;
 
     index numFrames = *std::min_element(inFrames.begin(), inFrames.end());
     index numChannels = *std::min_element(inChans.begin(), inChans.end());
 
     mNRTContext.task(c.task());
 
+    auto makeClient = clientFactory(mClient);
+
     Result processResult = AdaptorType<HostMatrix, HostVectorView>::process(
-        mClient, inputBuffers, outputBuffers, numFrames, numChannels,
-        userPadding<>(), mNRTContext);
+        mClient, makeClient, mChannelThreads, inputBuffers, outputBuffers,
+        numFrames, numChannels, userPadding<>(), mNRTContext);
 
     if (!processResult.ok())
     {
@@ -364,6 +363,157 @@ public:
     return r;
   }
 
+  // Runs the client over each of sources in turn, as though it were the
+  // source buffer, and packs the results into the output buffers one after
+  // another along their frames: item i starts at frame offsets[i], and
+  // offsets.back() is the total; on errors it is left empty. With
+  // channelThreads() other than 1, items run concurrently, each thread
+  // reusing one copy of the client between items, so sources must then be
+  // safe to read from several threads at once. Outputs get as many channels
+  // as the widest item, zero padding the rest.
+  Result processBatch(std::vector<BufferProcessSpec> sources,
+                      std::vector<index>& offsets, FluidContext& c)
+  {
+    static_assert(Ins == 1, "Batches need a client with a single input");
+    offsets.clear();
+
+    auto outputBuffers =
+        fetchOutputBuffers(std::make_index_sequence<Outs>());
+
+    for (auto& source : sources)
+    {
+      index nFrames = source.nFrames;
+      index nChans = source.nChans;
+      auto  rangeCheck = bufferRangeCheck(source.buffer, source.startFrame,
+                                          nFrames, source.startChan, nChans);
+      if (!rangeCheck.ok()) return rangeCheck;
+      source.nFrames = nFrames;
+      source.nChans = nChans;
+    }
+
+    Result r = checkOutputBuffers(outputBuffers);
+    if (r.status() == Result::Status::kError) return r;
+
+    using ItemOutputs = std::array<std::unique_ptr<MemoryBufferAdaptor>, Outs>;
+    index                    nItems = asSigned(sources.size());
+    std::vector<ItemOutputs> itemOutputs(sources.size());
+    std::vector<Result>      itemResults(sources.size());
+
+    // clients not in use by any thread, starting with our own
+    std::vector<RTClient*>                 idle{&mClient};
+    std::vector<std::unique_ptr<RTClient>> clones;
+    std::mutex                             idleMutex;
+
+    FluidContext itemContext{mNRTContext};
+    itemContext.task(nullptr);
+    FluidTask*         task = c.task();
+    std::atomic<index> itemsDone{0};
+    auto               padding = userPadding<>();
+
+    algorithm::parallelFor(
+        nItems, 1,
+        [&](index start, index end) {
+          RTClient* client;
+          {
+            std::lock_guard<std::mutex> lock(idleMutex);
+            if (idle.empty())
+            {
+              clones.push_back(
+                  std::make_unique<RTClient>(mRealTimeParams, itemContext));
+              idle.push_back(clones.back().get());
+            }
+            client = idle.back();
+            idle.pop_back();
+          }
+          auto makeClient = clientFactory(*client);
+          for (index i = start; i < end; ++i)
+          {
+            if (task && task->cancelled()) break;
+            auto& source = sources[asUnsigned(i)];
+            auto& outputs = itemOutputs[asUnsigned(i)];
+            std::array<BufferProcessSpec, 1> input{{source}};
+            std::array<BufferAdaptor*, Outs> output;
+            for (size_t k = 0; k < Outs; ++k)
+            {
+              if (outputBuffers[k])
+                outputs[k] = std::make_unique<MemoryBufferAdaptor>(1, 1, 0);
+              output[k] = outputs[k].get();
+            }
+            client->sampleRate(
+                BufferAdaptor::ReadAccess(source.buffer).sampleRate());
+            FluidContext context{itemContext};
+            itemResults[asUnsigned(i)] =
+                AdaptorType<HostMatrix, HostVectorView>::process(
+                    *client, makeClient, 1, input, output, source.nFrames,
+                    source.nChans, padding, context);
+            if (task)
+              task->processUpdate(static_cast<double>(++itemsDone),
+                                  static_cast<double>(nItems));
+          }
+          std::lock_guard<std::mutex> lock(idleMutex);
+          idle.push_back(client);
+        },
+        mChannelThreads);
+
+    if (task && task->cancelled()) return {Result::Status::kCancelled, ""};
+
+    for (index i = 0; i < nItems; ++i)
+    {
+      auto& itemResult = itemResults[asUnsigned(i)];
+      if (itemResult.status() == Result::Status::kError)
+        return {Result::Status::kError, "Item ", i, ": ",
+                itemResult.message()};
+      if (!itemResult.ok())
+      {
+        r.set(itemResult.status());
+        r.addMessage(itemResult.message());
+      }
+    }
+
+    // every item's outputs must agree on its length, so take it from the
+    // first output (checkOutputBuffers has made sure there is one)
+    size_t first = asUnsigned(
+        std::find_if(outputBuffers.begin(), outputBuffers.end(),
+                     [](BufferAdaptor* b) { return b != nullptr; }) -
+        outputBuffers.begin());
+    std::vector<index> itemOffsets{0};
+    for (auto& outputs : itemOutputs)
+      itemOffsets.push_back(itemOffsets.back() + outputs[first]->numFrames());
+
+    for (size_t k = 0; k < Outs; ++k)
+    {
+      if (!outputBuffers[k]) continue;
+      index  nChans = 0;
+      double sampleRate = 0;
+      for (index i = 0; i < nItems; ++i)
+      {
+        auto& item = *itemOutputs[asUnsigned(i)][k];
+        index frames =
+            itemOffsets[asUnsigned(i) + 1] - itemOffsets[asUnsigned(i)];
+        if (item.numFrames() != frames)
+          return {Result::Status::kError, "Item ", i,
+                  ": outputs have different lengths"};
+        nChans = std::max(nChans, item.numChans());
+        if (sampleRate == 0) sampleRate = item.sampleRate();
+      }
+      index nFrames = itemOffsets.back();
+      BufferAdaptor::Access packed(outputBuffers[k]);
+      Result resizeResult = packed.resize(nFrames, nChans, sampleRate);
+      if (!resizeResult.ok()) return resizeResult;
+      packed.allFrames().fill(0);
+      for (index i = 0; i < nItems; ++i)
+      {
+        auto& item = *itemOutputs[asUnsigned(i)][k];
+        for (index j = 0; j < item.numChans(); ++j)
+          packed.samps(itemOffsets[asUnsigned(i)], item.numFrames(), j) <<=
+              item.samps(j);
+      }
+    }
+
+    offsets = std::move(itemOffsets);
+    return r;
+  }
+
   template <typename C = RTClient>
   std::pair<index, index> userPadding(FFTWithControlOut<C>* = 0)
   {
@@ -419,6 +569,46 @@ public:
 
 
 private:
+  // Makes copies of client for adaptors to process channels concurrently
+  auto clientFactory(RTClient& client)
+  {
+    return [this, &client](FluidContext& context) {
+      auto clone = std::make_unique<RTClient>(mRealTimeParams, context);
+      clone->sampleRate(client.sampleRate());
+      return clone;
+    };
+  }
+
+  // Removes non-existent output buffers from outputBuffers, so clients don't
+  // try and use them, and fails if none are left
+  Result checkOutputBuffers(std::array<BufferAdaptor*, Outs>& outputBuffers)
+  {
+    if (std::all_of(outputBuffers.begin(), outputBuffers.end(), [](auto& b) {
+          if (!b) return true;
+
+          BufferAdaptor::Access buf(b);
+          return !buf.exists();
+        }))
+      return {Result::Status::kError, "No valid output has been set"}; // error
+
+    Result r{Result::Status::kOk, ""};
+
+    std::transform(
+        outputBuffers.begin(), outputBuffers.end(), outputBuffers.begin(),
+        [&r](auto& b) -> BufferAdaptor* {
+          if (!b) return nullptr;
+          BufferAdaptor::Access buf(b);
+          if (!buf.exists())
+          {
+            r.set(Result::Status::kWarning);
+            r.addMessage("One or more of your output buffers doesn't exist\n");
+          }
+          return buf.exists() ? b : nullptr;
+        });
+
+    return r;
+  }
+
   template <size_t N, typename T>
   struct GetWinSize
   {
@@ -460,13 +650,58 @@ private:
   FluidContext                             mNRTContext;
   RTParamSetViewType                       mRealTimeParams;
   WrappedClient                            mClient;
+  index                                    mChannelThreads{1};
 };
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+// Calls processChannel(client, channel, context, hopDone) for each channel,
+// running channels concurrently on up to maxThreads threads (0 means as many
+// as the shared NRTThreadPool allows). Every channel after the first gets its
+// own client from makeClient(context). The channel contexts don't carry c's
+// task: hopDone() reports progress over all nChans * nHops hops instead, and
+// returns false once the task has been cancelled.
+template <typename Client, typename MakeClient, typename F>
+void forEachChannel(Client& client, MakeClient& makeClient, index nChans,
+                    index nHops, index maxThreads, FluidContext& c,
+                    F&& processChannel)
+{
+  FluidTask*   task = c.task();
+  FluidContext channelContext{c};
+  channelContext.task(nullptr);
+
+  std::atomic<index> hopsDone{0};
+  const double       totalHops = static_cast<double>(nChans * nHops);
+  auto               hopDone = [&]() {
+    double done = static_cast<double>(++hopsDone);
+    return !task || task->processUpdate(done, totalHops);
+  };
+
+  index nThreads =
+      std::min(nChans, maxThreads > 0 ? maxThreads
+                                      : NRTThreadPool::instance().maxThreads());
+
+  algorithm::parallelFor(
+      nChans, 1,
+      [&](index start, index end) {
+        for (index i = start; i < end; ++i)
+        {
+          FluidContext context{channelContext};
+          if (i == 0 || nThreads <= 1)
+            processChannel(client, i, context, hopDone);
+          else
+            processChannel(*makeClient(context), i, context, hopDone);
+        }
+      },
+      nThreads);
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////
 template <typename HostMatrix, typename HostVectorView>
 struct Streaming
 {
-  template <typename Client, typename InputList, typename OutputList>
-  static Result process(Client& client, InputList& inputBuffers,
+  template <typename Client, typename MakeClient, typename InputList,
+            typename OutputList>
+  static Result process(Client& client, MakeClient&& makeClient,
+                        index maxThreads, InputList& inputBuffers,
                         OutputList& outputBuffers, index nFrames, index nChans,
                         std::pair<index, index> userPadding, FluidContext& c)
   {
@@ -505,32 +740,27 @@ struct Streaming
       }
     }
 
-    std::vector<HostVectorView> inputs(inputBuffers.size(), {nullptr, 0, 0});
-    std::vector<HostVectorView> outputs(outputBuffers.size(), {nullptr, 0, 0});
-    //    inputs.reserve(inputBuffers.size());
-
-    for (index i = 0; i < nChans; ++i)
-    {
-      if (c.task())
-        c.task()->iterationUpdate(static_cast<double>(i),
-                                  static_cast<double>(nChans));
-
-      client.reset(c);
-
-      for (index j = 0; j < nHops; ++j)
-      {
-        for (std::size_t k = 0; k < inputBuffers.size(); ++k)
-          inputs[k] = inputData[k].row(i)(Slice(j * VectorSize, VectorSize));
-        for (std::size_t k = 0; k < outputBuffers.size(); ++k)
-          outputs[k] = outputData[k].row(i)(Slice(j * VectorSize, VectorSize));
-        client.process(inputs, outputs, c);
-
-        if (c.task() &&
-            !c.task()->processUpdate(static_cast<double>(j + 1 + (nHops * i)),
-                                     static_cast<double>(nHops * nChans)))
-          break;
-      }
-    }
+    forEachChannel(
+        client, makeClient, nChans, nHops, maxThreads, c,
+        [&](auto& channelClient, index i, FluidContext& context,
+            auto& hopDone) {
+          std::vector<HostVectorView> inputs(inputBuffers.size(),
+                                             {nullptr, 0, 0});
+          std::vector<HostVectorView> outputs(outputBuffers.size(),
+                                              {nullptr, 0, 0});
+          channelClient.reset(context);
+          for (index j = 0; j < nHops; ++j)
+          {
+            for (std::size_t k = 0; k < inputBuffers.size(); ++k)
+              inputs[k] =
+                  inputData[k].row(i)(Slice(j * VectorSize, VectorSize));
+            for (std::size_t k = 0; k < outputBuffers.size(); ++k)
+              outputs[k] =
+                  outputData[k].row(i)(Slice(j * VectorSize, VectorSize));
+            channelClient.process(inputs, outputs, context);
+            if (!hopDone()) break;
+          }
+        });
 
     for (index i = 0; i < asSigned(outputBuffers.size()); ++i)
     {
@@ -550,8 +780,10 @@ struct Streaming
 template <typename HostMatrix, typename HostVectorView>
 struct StreamingControl
 {
-  template <typename Client, typename InputList, typename OutputList>
-  static Result process(Client& client, InputList& inputBuffers,
+  template <typename Client, typename MakeClient, typename InputList,
+            typename OutputList>
+  static Result process(Client& client, MakeClient&& makeClient,
+                        index maxThreads, InputList& inputBuffers,
                         OutputList& outputBuffers, index nFrames, index nChans,
                         std::pair<index, index> userPadding, FluidContext& c)
   {
@@ -599,40 +831,27 @@ struct StreamingControl
                             inputBuffers[asUnsigned(j)].startChan + i);
       }
     }
-    FluidTask* task = c.task();
-
-    for (index i = 0; i < nChans; ++i)
-    {
-      client.reset(c);
-      for (index j = 0; j < nAnalysisFrames; ++j)
-      {
-        index t = j * c.hostVectorSize();
-
-        std::vector<HostVectorView> inputs;
-        inputs.reserve(inputBuffers.size());
-        std::vector<HostVectorView> outputs;
-        outputs.reserve(outputBuffers.size());
-
-        for (index k = 0; k < asSigned(inputBuffers.size()); ++k)
-        {
-          inputs.emplace_back(
-              inputData[asUnsigned(k)].row(i)(Slice(t, controlRate)));
-        }
-
-        for(auto& out: outputData)
-        {
-          outputs.push_back(
-            out.col(j)(Slice(i * maxFeatures, maxFeatures)));
-        }
-
-        client.process(inputs, outputs, c);
-
-        if (task && !task->processUpdate(
-                        static_cast<double>(j + 1 + (nAnalysisFrames * i)),
-                        static_cast<double>(nAnalysisFrames * nChans)))
-          break;
-      }
-    }
+    forEachChannel(
+        client, makeClient, nChans, nAnalysisFrames, maxThreads, c,
+        [&](auto& channelClient, index i, FluidContext& context,
+            auto& hopDone) {
+          std::vector<HostVectorView> inputs(inputBuffers.size(),
+                                             {nullptr, 0, 0});
+          std::vector<HostVectorView> outputs(outputBuffers.size(),
+                                              {nullptr, 0, 0});
+          channelClient.reset(context);
+          for (index j = 0; j < nAnalysisFrames; ++j)
+          {
+            index t = j * controlRate;
+            for (std::size_t k = 0; k < inputBuffers.size(); ++k)
+              inputs[k] = inputData[k].row(i)(Slice(t, controlRate));
+            for (std::size_t k = 0; k < outputBuffers.size(); ++k)
+              outputs[k] =
+                  outputData[k].col(j)(Slice(i * maxFeatures, maxFeatures));
+            channelClient.process(inputs, outputs, context);
+            if (!hopDone()) break;
+          }
+        });
 
     for (auto outs = std::pair{outputBuffers.begin(), outputData.begin()};
          outs.first != outputBuffers.end(); ++outs.first, ++outs.second)
@@ -664,9 +883,11 @@ struct StreamingControl
 template <typename HostMatrix, typename HostVectorView>
 struct Slicing
 {
-  template <typename Client, typename InputList, typename OutputList>
-  static Result process(Client& client, InputList& inputBuffers,
-                        OutputList& outputBuffers, index nFrames, index nChans,
+  template <typename Client, typename MakeClient, typename InputList,
+            typename OutputList>
+  static Result process(Client& client, MakeClient&&, index /*maxThreads*/,
+                        InputList& inputBuffers, OutputList& outputBuffers,
+                        index nFrames, index nChans,
                         std::pair<index, index> /*userPadding*/,
                         FluidContext& c)
   {
@@ -923,7 +1144,10 @@ public:
               new ThreadedTask(mClient, mQueue.front(), false));
           mQueue.pop_front();
           state = kDoneStillProcessing;
-          mThreadedTask->mState = kDoneStillProcessing;
+          // unless the new job has already finished
+          ProcessState processing = kProcessing;
+          mThreadedTask->mState.compare_exchange_strong(processing,
+                                                        kDoneStillProcessing);
         }
         else
         {
@@ -942,6 +1166,19 @@ public:
 
   void setQueueEnabled(bool queue) { mQueueEnabled = queue; }
 
+  // How many threads each job may spread its channels across, for clients
+  // that wrap a real-time one (see NRTClientWrapper::channelThreads): 1, the
+  // default, is serial and 0 is as many as the shared NRTThreadPool allows.
+  // Other clients always run serially and ignore this
+  Result setChannelThreads(index n)
+  {
+    if (mThreadedTask) return {Result::Status::kError, "Already processing"};
+    setChannelThreads(*mClient, n, 0);
+    return {};
+  }
+
+  index channelThreads() const { return channelThreads(*mClient, 0); }
+
   double progress()
   {
     return mThreadedTask ? mThreadedTask->mTask.progress() : 0.0;
@@ -965,12 +1202,36 @@ public:
 
   ProcessState state() const
   {
-    return mThreadedTask ? mThreadedTask->mState : kNoProcess;
+    return mThreadedTask ? mThreadedTask->mState.load() : kNoProcess;
   }
 
   void setCallback(std::function<void()> cb) { mCallback = cb; }
 
 private:
+  template <typename C>
+  static auto setChannelThreads(C& client, index n, int)
+      -> decltype(client.channelThreads(n), void())
+  {
+    client.channelThreads(n);
+  }
+
+  template <typename C>
+  static void setChannelThreads(C&, index, long)
+  {}
+
+  template <typename C>
+  static auto channelThreads(C const& client, int)
+      -> decltype(client.channelThreads())
+  {
+    return client.channelThreads();
+  }
+
+  template <typename C>
+  static index channelThreads(C const&, long)
+  {
+    return 1;
+  }
+
   void swap(NRTThreadingAdaptor&& x, bool includeParams)
   {
     if (mThreadedTask)
@@ -979,7 +1240,7 @@ private:
       mThreadedTask.release();
     }
 
-    mThreadedTask.reset(x.mThreadedTask.get());
+    mThreadedTask = std::move(x.mThreadedTask);
     using std::swap;
     swap(mQueue, x.mQueue);
     swap(mSynchronous, x.mSynchronous);
@@ -1009,6 +1270,16 @@ private:
       }
     };
 
+    // inputs are only read, so jobs can share a snapshot of them
+    template <size_t N, typename T>
+    struct BufferShare
+    {
+      void operator()(typename T::type& param)
+      {
+        if (param) param = BufferSnapshot::take(param);
+      }
+    };
+
     template <size_t N, typename T>
     struct BufferCopyBack
     {
@@ -1032,45 +1303,63 @@ private:
 
       assert(mClient.get() != nullptr); // right?
 
-      std::promise<void> resultPromise;
-      mResultReady = resultPromise.get_future();
-
       mClient->setParams(mProcessParams);
-      if (synchronous) { process(std::move(resultPromise)); }
+      if (synchronous) { process(); }
       else
       {
-        auto entry = [](ThreadedTask* owner, std::promise<void> result) {
-          owner->process(std::move(result));
-        };
         mProcessParams.template forEachParamType<BufferT, BufferCopy>();
-        mProcessParams.template forEachParamType<InputBufferT, BufferCopy>();
+        mProcessParams.template forEachParamType<InputBufferT, BufferShare>();
         mState = kProcessing;
-        mThread = std::thread(entry, this, std::move(resultPromise));
+        mFinished =
+            NRTThreadPool::instance().submit([this]() { process(); }, &mJob);
       }
     }
 
     Result result() { return mResult; }
 
-    void process(std::promise<void> resultReady)
+    void process()
     {
       assert(mClient.get() != nullptr); // right?
-      mState = kProcessing;
-      mResult = mClient->template process<float>(mContext);
-      resultReady.set_value();
-      mState = kDone;
-      if (mCallback && !mDetached && !mTask.cancelled()) mCallback();
-      if (mDetached) delete this;
+      ProcessState notStarted = kNoProcess;
+      mState.compare_exchange_strong(notStarted, kProcessing);
+      // jobs cancelled while waiting for a worker don't need to run at all
+      mResult = mTask.cancelled()
+                    ? Result{Result::Status::kCancelled, ""}
+                    : mClient->template process<float>(mContext);
+      finish();
     }
 
-    void join() { mThread.join(); }
+    void join()
+    {
+      if (mFinished.valid()) mFinished.wait();
+    }
 
+    // after detaching, the task owns itself and the caller mustn't touch it
     void cancel(bool detach)
     {
       mTask.cancel();
 
-      mDetached = detach;
+      // a job still waiting for a worker is dropped, so nothing has to wait
+      // for the pool to get round to it
+      if (mJob >= 0 && NRTThreadPool::instance().withdraw(mJob))
+      {
+        mResult = {Result::Status::kCancelled, ""};
+        finish();
+      }
+
+      if (detach)
+      {
+        mDetached = true;
+        if (mFinishedOrDetached.exchange(true)) delete this;
+      }
+    }
 
-      if (detach && mThread.joinable()) mThread.detach();
+    void finish()
+    {
+      mState = kDone;
+      if (mCallback && !mDetached && !mTask.cancelled()) mCallback();
+      // whichever of this and a detaching cancel() comes second cleans up
+      if (mFinishedOrDetached.exchange(true)) delete this;
     }
 
     ProcessState checkProgress(Result& result)
@@ -1079,11 +1368,11 @@ private:
 
       if (state == kDone)
       {
-        if (mThread.get_id() != std::thread::id())
+        if (mFinished.valid())
         {
-          mResultReady.wait();
+          mFinished.wait();
+          mFinished = {};
           result = mResult;
-          mThread.join();
         }
 
         if (!mTask.cancelled())
@@ -1108,18 +1397,21 @@ private:
       return state;
     }
 
-    ParamSetType          mProcessParams;
-    ProcessState          mState;
-    std::thread           mThread;
-    std::future<void>     mResultReady;
-    Result                mResult;
-    ClientPointer         mClient;
-    FluidTask             mTask;
-    FluidContext          mContext;
-    bool                  mDetached = false;
-    std::function<void()> mCallback;
+    ParamSetType              mProcessParams;
+    std::atomic<ProcessState> mState;
+    std::future<void>         mFinished;
+    index                     mJob{-1};
+    Result                    mResult;
+    ClientPointer             mClient;
+    FluidTask                 mTask;
+    FluidContext              mContext;
+    std::atomic<bool>         mDetached{false};
+    std::atomic<bool>         mFinishedOrDetached{false};
+    std::function<void()>     mCallback;
   };
 
+  // first, so that it goes last, once this adaptor's own job is done with
+  NRTThreadPoolUser             mPoolUser;
   FluidContext                  mNRTContext;
   ParamSetType                  mHostParams;
   std::deque<NRTJob>            mQueue;
@@ -12,12 +12,15 @@ under the European Union’s Horizon 2020 research and innovation programme
 #include "../../data/FluidIndex.hpp"
 #include "../../data/FluidMemory.hpp"
 #include "../../data/FluidTensor.hpp"
+#include <algorithm>
 #include <cassert>
 #include <functional>
 
 namespace fluid {
 
-/// An output buffer, with overlap-add
+/// An output buffer, with overlap-add. Frames that run past the end of the
+/// ring are added in one go to an overflow region of size() samples, which is
+/// folded back into the start of the ring as it is pulled
 template <typename T>
 class FluidSink
 {
@@ -38,7 +41,7 @@ public:
             Allocator& alloc = FluidDefaultAllocator())
       : mSize(size), mChannels(channels), mHostBufferSize(maxHostVectorSize),
         mMaxHostBufferSize(maxHostVectorSize),
-        matrix(channels, bufferSize(), alloc)
+        matrix(channels, bufferSize() + size, alloc)
   {}
 
   /// Accumulate data into the buffer, optionally moving
@@ -53,7 +56,7 @@ public:
 
     index blocksize = x.cols();
 
-    assert(blocksize <= bufferSize());
+    assert(blocksize <= mSize);
 
     index offset = frameTime;
 
@@ -62,11 +65,7 @@ public:
     offset += mCounter;
     offset = offset < bufferSize() ? offset : offset - bufferSize();
 
-    index size = ((offset + blocksize) > bufferSize()) ? bufferSize() - offset
-                                                       : blocksize;
-
-    addIn(x(Slice(0), Slice(0, size)), offset, size);
-    addIn(x(Slice(0), Slice(size, blocksize - size)), 0, blocksize - size);
+    addIn(x, offset, blocksize);
   }
 
   /// Copy data from the buffer, and zero where it was
@@ -153,6 +152,15 @@ private:
   {
     if (size)
     {
+      index folded = std::min(offset + size, mSize) - offset;
+      if (folded > 0)
+      {
+        auto overflow = matrix(chans, Slice(offset + bufferSize(), folded));
+        matrix(chans, Slice(offset, folded)).apply(overflow, [](T& x, T& y) {
+          x += y;
+          y = 0;
+        });
+      }
       View buf = matrix(chans, Slice(offset, size));
       View output = buf;
       out <<= output;
@@ -13,11 +13,14 @@ under the European Union’s Horizon 2020 research and innovation programme
 #include "../../data/FluidIndex.hpp"
 #include "../../data/FluidMemory.hpp"
 #include "../../data/FluidTensor.hpp"
+#include <algorithm>
 #include <cassert>
 
 namespace fluid {
 
-/// Input buffer, with possibly overlapped reads
+/// Input buffer, with possibly overlapped reads. The first size() samples
+/// of the ring are mirrored just past its end, so that any window of up to
+/// size() samples is contiguous and can be handed out without copying
 template <typename T>
 class FluidSource
 {
@@ -36,7 +39,7 @@ public:
               Allocator& alloc = FluidDefaultAllocator())
       : mSize(size), mChannels(channels), mHostBufferSize(maxHostBufferSize),
         mMaxHostBufferSize(maxHostBufferSize),
-        matrix(channels, bufferSize(), alloc)
+        matrix(channels, bufferSize() + size, alloc)
   {}
 
   FluidSource() : FluidSource(0, 1, 0, FluidDefaultAllocator()){};
@@ -67,25 +70,24 @@ public:
   /// Pull a frame of data out of the buffer.
   void pull(View out, index frameTime)
   {
-    index blocksize = out.cols();
-    index offset = mHostBufferSize - frameTime;
-
-    if (offset > bufferSize())
+    if (mHostBufferSize - frameTime > bufferSize())
     {
       out.fill(0);
       return;
     }
+    out <<= window(out.cols(), frameTime);
+  }
 
-    offset += blocksize;
+  /// View, rather than copy, the frame that pull() would return. It stays
+  /// valid until the next push() and must not be written to
+  View window(index blocksize, index frameTime)
+  {
+    assert(blocksize <= mSize);
+    index offset = mHostBufferSize - frameTime + blocksize;
+    assert(offset <= bufferSize());
     offset = (offset <= mCounter) ? mCounter - offset
                                   : mCounter + bufferSize() - offset;
-
-    index size =
-        (offset + blocksize > bufferSize()) ? bufferSize() - offset : blocksize;
-
-    out(Slice(0), Slice(0, size)) <<= matrix(Slice(0), Slice(offset, size));
-    out(Slice(0), Slice(size, blocksize - size)) <<=
-        matrix(Slice(0), Slice(0, blocksize - size));
+    return matrix(Slice(0), Slice(offset, blocksize));
   }
 
   void setHostBufferSize(const index size)
@@ -150,6 +152,10 @@ private:
     if (size)
     {
       matrix(chans, Slice(offset, size)) <<= input;
+      index mirrored = std::min(offset + size, mSize) - offset;
+      if (mirrored > 0)
+        matrix(chans, Slice(offset + bufferSize(), mirrored)) <<=
+            matrix(chans, Slice(offset, mirrored));
       if (incrementTime) mCounter = offset + size;
     }
   }
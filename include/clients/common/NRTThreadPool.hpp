@@ -0,0 +1,47 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+#pragma once
+
+#include "../../algorithms/util/ThreadPool.hpp"
+#include "../../data/FluidIndex.hpp"
+#include <atomic>
+
+namespace fluid {
+namespace client {
+
+// Non-blocking NRT jobs run on the same process-wide pool that parallelFor
+// spreads its loops over, so that one limit (setMaxThreads()) caps both
+using NRTThreadPool = algorithm::ThreadPool;
+
+// Held by every client that queues jobs on the pool. When the last one goes,
+// as when a host tears down its objects before unloading the library, the
+// pool's workers are stopped and joined rather than left running
+class NRTThreadPoolUser
+{
+public:
+  NRTThreadPoolUser() { users()++; }
+  NRTThreadPoolUser(const NRTThreadPoolUser&) : NRTThreadPoolUser() {}
+  NRTThreadPoolUser& operator=(const NRTThreadPoolUser&) { return *this; }
+
+  ~NRTThreadPoolUser()
+  {
+    if (--users() == 0) NRTThreadPool::shutdown();
+  }
+
+private:
+  static std::atomic<index>& users()
+  {
+    static std::atomic<index> count{0};
+    return count;
+  }
+};
+
+} // namespace client
+} // namespace fluid
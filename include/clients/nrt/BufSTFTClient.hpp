@@ -165,9 +165,7 @@ private:
 
     auto stft = algorithm::STFT(winSize, fftSize, hopSize);
 
-    for (index i = 0; i < numHops; ++i)
-      stft.processFrame(paddedInput(Slice(i * hopSize, winSize)),
-                        tmpComplex.row(i));
+    stft.processFrames(paddedInput, tmpComplex, 0);
 
     if (haveMag)
     {
@@ -234,13 +232,10 @@ private:
     if (!resizeResult.ok()) return resizeResult;
 
     FluidTensor<double, 1> tmpOut(paddedOutputSize);
-    FluidTensor<double, 1> normalizer(paddedOutputSize);
 
-    FluidTensor<std::complex<double>, 2> tmpComplex(tmpOut.size() / hopSize,
+    FluidTensor<std::complex<double>, 2> tmpComplex(numFrames,
                                                     mags.numChans());
 
-    FluidTensor<double, 1> frame(winSize);
-
     auto magsView = mags.allFrames().transpose();
     auto phaseView = phases.allFrames().transpose();
 
@@ -249,26 +244,7 @@ private:
                    [](auto& m, auto& p) { return std::polar(m, p); });
 
     auto istft = algorithm::ISTFT(winSize, fftSize, hopSize);
-
-    FluidTensor<double, 1> windowSquared(istft.window());
-    windowSquared.apply([](double& x) { x *= x; });
-
-    auto addIn = [](double& x, double& y) { x += y; };
-
-    for (index i = 0; i < numFrames; ++i)
-    {
-      istft.processFrame(tmpComplex.row(i), frame);
-      auto thisSlice = Slice(i * hopSize, winSize);
-      tmpOut(thisSlice).apply(frame, addIn);
-      normalizer(thisSlice).apply(windowSquared, addIn);
-    }
-
-    std::transform(tmpOut.begin(), tmpOut.end(), normalizer.begin(),
-                   tmpOut.begin(), [](double x, double y) {
-                     constexpr double epsilon =
-                         std::numeric_limits<double>::epsilon();
-                     return x / std::max(y, epsilon);
-                   });
+    istft.processFrames(tmpComplex, tmpOut, 0);
 
     resynth.samps(0) <<= tmpOut(Slice(padding, finalOutputSize));
 
@@ -11,6 +11,7 @@ under the European Union’s Horizon 2020 research and innovation programme
 #pragma once
 #include "NRTClient.hpp"
 #include "../common/SharedClientUtils.hpp"
+#include "../../data/FluidBinaryFile.hpp"
 #include "../../data/FluidDataSet.hpp"
 #include "../../data/FluidJSON.hpp"
 #include <nlohmann/json.hpp>
@@ -40,6 +41,12 @@ public:
 
   MessageResult<void> write(string fileName)
   {
+    if (BinaryFile::isBinaryName(fileName))
+    {
+      auto file = BinaryFile(fileName, "w");
+      file.write(mAlgorithm);
+      return file.ok() ? OK() : Error(file.error());
+    }
     auto file = JSONFile(fileName, "w");
     file.write(mAlgorithm);
     return file.ok() ? OK() : Error(file.error());
@@ -47,36 +54,36 @@ public:
 
   MessageResult<void> read(string fileName)
   {
-    auto           file = JSONFile(fileName, "r");
-    nlohmann::json j = file.read();
-    if (!file.ok()) { return Error(file.error()); }
+    T result;
+    if (BinaryFile::isBinaryFile(fileName))
+    {
+      auto file = BinaryFile(fileName, "r");
+      if (!file.read(result)) return Error(file.error());
+    }
     else
     {
-      if (!check_json(j, mAlgorithm)) return Error("Invalid JSON format");
-      mAlgorithm = j.get<T>();
+      auto file = JSONFile(fileName, "r");
+      if (!file.read(result)) return Error(file.error());
     }
+    mAlgorithm = std::move(result);
     return OK();
   }
 
   MessageResult<string> dump()
   {
-    using namespace nlohmann;
     if (!mAlgorithm.initialized()) return string();
-    nlohmann::json j = mAlgorithm;
-    return j.dump();
+    std::ostringstream result;
+    write_json(result, mAlgorithm);
+    return result.str();
   }
 
   MessageResult<void> load(string s)
   {
-    using namespace std;
-    using namespace nlohmann;
-    json j = json::parse(s, nullptr, false);
-    if (j.is_discarded()) { return Error("Parse error"); }
-    else
+    switch (read_json(s, mAlgorithm))
     {
-      if (!check_json(j, mAlgorithm)) return Error("Invalid JSON format");
-      mAlgorithm = j.get<T>();
-      return OK();
+    case JSONReadResult::kParseError: return Error("Parse error");
+    case JSONReadResult::kInvalidFormat: return Error("Invalid JSON format");
+    default: return OK();
     }
   }
   
@@ -14,6 +14,7 @@ under the European Union’s Horizon 2020 research and innovation programme
 #include "NRTClient.hpp"
 #include "../common/SharedClientUtils.hpp"
 #include "../../algorithms/public/DataSetIdSequence.hpp"
+#include "../../algorithms/public/KDTree.hpp"
 #include "../../data/FluidDataSet.hpp"
 #include <sstream>
 #include <string>
@@ -145,6 +146,7 @@ public:
       return Error(WrongPointSize);
     auto       ids = srcDataSet.getIds();
     RealVector point(srcDataSet.pointSize());
+    mAlgorithm.reserve(mAlgorithm.size() + srcDataSet.size());
     for (index i = 0; i < srcDataSet.size(); i++)
     {
       srcDataSet.get(ids(i), point);
@@ -289,6 +291,41 @@ public:
     return labels;
   }
 
+  // Batch kNearest and kNearestDist over every point of source. The points
+  // are indexed with a KDTree once, and the queries spread over the worker
+  // pool. Row i of ids gets the ids of the neighbours of source's point i,
+  // nearest first, and row i of distances their squared distances, as
+  // kNearestDist gives.
+  MessageResult<void> kNearestDataSet(SharedClientRef<const DataSetClient> source,
+                                      LabelSetClientRef                ids,
+                                      SharedClientRef<DataSetClient> distances,
+                                      index nNeighbours) const
+  {
+    if (nNeighbours > mAlgorithm.size()) return Error(SmallDataSet);
+    if (nNeighbours <= 0) return Error(SmallK);
+    auto sourcePtr = source.get().lock();
+    if (!sourcePtr) return Error(NoDataSet);
+    auto idsPtr = ids.get().lock();
+    if (!idsPtr) return Error(NoLabelSet);
+    auto distancesPtr = distances.get().lock();
+    if (!distancesPtr) return Error(NoDataSet);
+    auto queries = sourcePtr->getDataSet();
+    if (queries.size() == 0) return Error(EmptyDataSet);
+    if (queries.pointSize() != mAlgorithm.dims()) return Error(WrongPointSize);
+
+    algorithm::KDTree      tree(mAlgorithm);
+    FluidTensor<index, 2>  indices(queries.size(), nNeighbours);
+    FluidTensor<double, 2> dists(queries.size(), nNeighbours);
+    tree.kNearest(queries, nNeighbours, indices, dists);
+    dists.apply([](double& d) { d *= d; });
+    FluidTensor<string, 2> neighbours(queries.size(), nNeighbours);
+    std::transform(indices.begin(), indices.end(), neighbours.begin(),
+                   [this](index i) { return mAlgorithm.getIds()(i); });
+    idsPtr->setLabelSet(LabelSet(queries.getIds(), neighbours));
+    distancesPtr->setDataSet(DataSet(queries.getIds(), dists));
+    return OK();
+  }
+
   MessageResult<void> clear()
   {
     mAlgorithm = DataSet(0);
@@ -324,7 +361,8 @@ public:
         makeMessage("toBuffer", &DataSetClient::toBuffer),
         makeMessage("getIds", &DataSetClient::getIds),
         makeMessage("kNearestDist", &DataSetClient::kNearestDist),
-        makeMessage("kNearest", &DataSetClient::kNearest));
+        makeMessage("kNearest", &DataSetClient::kNearest),
+        makeMessage("kNearestDataSet", &DataSetClient::kNearestDataSet));
   }
 
 private:
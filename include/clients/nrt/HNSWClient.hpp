@@ -0,0 +1,200 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+
+#pragma once
+
+#include "DataSetClient.hpp"
+#include "NRTClient.hpp"
+#include "../../algorithms/public/HNSW.hpp"
+#include <string>
+
+namespace fluid {
+namespace client {
+namespace hnsw {
+
+constexpr auto HNSWParams = defineParameters(
+    StringParam<Fixed<true>>("name", "Name"),
+    LongParam("numNeighbours", "Number of Nearest Neighbours", 1),
+    FloatParam("radius", "Maximum distance", 0, Min(0)),
+    LongParam("maxConnections", "Maximum Connections per Point",
+              algorithm::HNSW::defaultMaxConnections, Min(2)),
+    LongParam("constructionBeam", "Beam Width when Fitting",
+              algorithm::HNSW::defaultConstructionBeam, Min(1)),
+    LongParam("searchBeam", "Beam Width when Searching",
+              algorithm::HNSW::defaultSearchBeam, Min(1)),
+    EnumParam("metric", "Distance Metric", 0, "Euclidean", "Manhattan",
+              "Chebyshev", "Cosine"));
+
+class HNSWClient : public FluidBaseClient,
+                   OfflineIn,
+                   OfflineOut,
+                   ModelObject,
+                   public DataClient<algorithm::HNSW>
+{
+  enum {
+    kName,
+    kNumNeighbors,
+    kRadius,
+    kMaxConnections,
+    kConstructionBeam,
+    kSearchBeam,
+    kMetric
+  };
+
+public:
+  using string = std::string;
+  using BufferPtr = std::shared_ptr<BufferAdaptor>;
+  using InputBufferPtr = std::shared_ptr<const BufferAdaptor>;
+  using StringVector = FluidTensor<rt::string, 1>;
+  using DataSet = FluidDataSet<string, double, 1>;
+  using LabelSet = FluidDataSet<string, string, 1>;
+  using ParamDescType = decltype(HNSWParams);
+
+  using ParamSetViewType = ParameterSetView<ParamDescType>;
+  std::reference_wrapper<ParamSetViewType> mParams;
+
+  void setParams(ParamSetViewType& p) { mParams = p; }
+
+  template <size_t N>
+  auto& get() const
+  {
+    return mParams.get().template get<N>();
+  }
+
+  static constexpr auto& getParameterDescriptors() { return HNSWParams; }
+
+  HNSWClient(ParamSetViewType& p, FluidContext&) : mParams(p)
+  {
+    audioChannelsIn(1);
+    controlChannelsOut({1, 1});
+  }
+
+  template <typename T>
+  Result process(FluidContext&)
+  {
+    return {};
+  }
+
+  MessageResult<void> fit(InputDataSetClientRef datasetClient)
+  {
+    auto datasetClientPtr = datasetClient.get().lock();
+    if (!datasetClientPtr) return Error(NoDataSet);
+    auto dataset = datasetClientPtr->getDataSet();
+    if (dataset.size() == 0) return Error(EmptyDataSet);
+    mAlgorithm = algorithm::HNSW(
+        dataset, get<kMaxConnections>(), get<kConstructionBeam>(),
+        get<kSearchBeam>(),
+        algorithm::DistanceFuncs::searchMetric(get<kMetric>()));
+    return OK();
+  }
+
+  MessageResult<StringVector> kNearest(InputBufferPtr  data,
+                                       Optional<index> nNeighbours) const
+  {
+    index k = nNeighbours ? nNeighbours.value() : get<kNumNeighbors>();
+    if (!mAlgorithm.initialized()) return Error<StringVector>(NoDataFitted);
+    if (k > mAlgorithm.size()) return Error<StringVector>(SmallDataSet);
+    InBufferCheck bufCheck(mAlgorithm.dims());
+    if (!bufCheck.checkInputs(data.get()))
+      return Error<StringVector>(bufCheck.error());
+    RealVector point(mAlgorithm.dims());
+    point <<=
+        BufferAdaptor::ReadAccess(data.get()).samps(0, mAlgorithm.dims(), 0);
+    auto [dists, ids] =
+        mAlgorithm.kNearest(point, k, get<kRadius>(), FluidDefaultAllocator(),
+                            get<kSearchBeam>());
+    StringVector result(asSigned(ids.size()));
+    std::transform(ids.cbegin(), ids.cend(), result.begin(),
+                   [](const std::string* x) {
+                     return rt::string{*x, FluidDefaultAllocator()};
+                   });
+    return result;
+  }
+
+  MessageResult<RealVector> kNearestDist(InputBufferPtr  data,
+                                         Optional<index> nNeighbours) const
+  {
+    index k = nNeighbours ? nNeighbours.value() : get<kNumNeighbors>();
+    if (!mAlgorithm.initialized()) return Error<RealVector>(NoDataFitted);
+    if (k > mAlgorithm.size()) return Error<RealVector>(SmallDataSet);
+    InBufferCheck bufCheck(mAlgorithm.dims());
+    if (!bufCheck.checkInputs(data.get()))
+      return Error<RealVector>(bufCheck.error());
+    RealVector point(mAlgorithm.dims());
+    point <<=
+        BufferAdaptor::ReadAccess(data.get()).samps(0, mAlgorithm.dims(), 0);
+    auto [dist, ids] =
+        mAlgorithm.kNearest(point, k, get<kRadius>(), FluidDefaultAllocator(),
+                            get<kSearchBeam>());
+    return {dist};
+  }
+
+  // Batch kNearest and kNearestDist over every point of source, laid out as
+  // KDTree's kNearestDataSet. Slots the search couldn't fill get an empty id
+  // and an infinite distance.
+  MessageResult<void> kNearestDataSet(InputDataSetClientRef source,
+                                      LabelSetClientRef     ids,
+                                      DataSetClientRef      distances,
+                                      Optional<index>       nNeighbours) const
+  {
+    index k = nNeighbours ? nNeighbours.value() : get<kNumNeighbors>();
+    if (!mAlgorithm.initialized()) return Error(NoDataFitted);
+    if (k <= 0) return Error(SmallK);
+    if (k > mAlgorithm.size()) return Error(SmallDataSet);
+    auto sourcePtr = source.get().lock();
+    if (!sourcePtr) return Error(NoDataSet);
+    auto idsPtr = ids.get().lock();
+    if (!idsPtr) return Error(NoLabelSet);
+    auto distancesPtr = distances.get().lock();
+    if (!distancesPtr) return Error(NoDataSet);
+    auto dataSet = sourcePtr->getDataSet();
+    if (dataSet.size() == 0) return Error(EmptyDataSet);
+    if (dataSet.pointSize() != mAlgorithm.dims()) return Error(WrongPointSize);
+    FluidTensor<index, 2>  indices(dataSet.size(), k);
+    FluidTensor<double, 2> dists(dataSet.size(), k);
+    mAlgorithm.kNearest(dataSet, k, indices, dists, 0, get<kSearchBeam>());
+    FluidTensor<string, 1> fittedIds(mAlgorithm.size());
+    mAlgorithm.getIds(fittedIds);
+    FluidTensor<string, 2> neighbours(dataSet.size(), k);
+    std::transform(indices.begin(), indices.end(), neighbours.begin(),
+                   [&fittedIds](index i) {
+                     return i >= 0 ? fittedIds(i) : string();
+                   });
+    idsPtr->setLabelSet(LabelSet(dataSet.getIds(), neighbours));
+    distancesPtr->setDataSet(DataSet(dataSet.getIds(), dists));
+    return OK();
+  }
+
+  static auto getMessageDescriptors()
+  {
+    return defineMessages(
+        makeMessage("fit", &HNSWClient::fit),
+        makeMessage("kNearest", &HNSWClient::kNearest),
+        makeMessage("kNearestDist", &HNSWClient::kNearestDist),
+        makeMessage("kNearestDataSet", &HNSWClient::kNearestDataSet),
+        makeMessage("cols", &HNSWClient::dims),
+        makeMessage("clear", &HNSWClient::clear),
+        makeMessage("size", &HNSWClient::size),
+        makeMessage("load", &HNSWClient::load),
+        makeMessage("dump", &HNSWClient::dump),
+        makeMessage("write", &HNSWClient::write),
+        makeMessage("read", &HNSWClient::read));
+  }
+};
+
+using HNSWRef = SharedClientRef<const HNSWClient>;
+
+} // namespace hnsw
+
+using NRTThreadedHNSWClient =
+    NRTThreadingAdaptor<typename hnsw::HNSWRef::SharedType>;
+
+} // namespace client
+} // namespace fluid
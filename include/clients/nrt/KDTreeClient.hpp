@@ -22,7 +22,11 @@ namespace kdtree {
 constexpr auto KDTreeParams = defineParameters(
     StringParam<Fixed<true>>("name", "Name"),
     LongParam("numNeighbours", "Number of Nearest Neighbours", 1),
-    FloatParam("radius", "Maximum distance", 0, Min(0)));
+    FloatParam("radius", "Maximum distance", 0, Min(0)),
+    EnumParam("metric", "Distance Metric", 0, "Euclidean", "Manhattan",
+              "Chebyshev", "Cosine"),
+    LongParam("leafSize", "Points per Leaf", algorithm::KDTree::defaultLeafSize,
+              Min(1)));
 
 class KDTreeClient : public FluidBaseClient,
                      OfflineIn,
@@ -30,13 +34,15 @@ class KDTreeClient : public FluidBaseClient,
                      ModelObject,
                      public DataClient<algorithm::KDTree>
 {
-  enum { kName, kNumNeighbors, kRadius };
+  enum { kName, kNumNeighbors, kRadius, kMetric, kLeafSize };
 
 public:
   using string = std::string;
   using BufferPtr = std::shared_ptr<BufferAdaptor>;
   using InputBufferPtr = std::shared_ptr<const BufferAdaptor>;
   using StringVector = FluidTensor<rt::string, 1>;
+  using DataSet = FluidDataSet<string, double, 1>;
+  using LabelSet = FluidDataSet<string, string, 1>;
   using ParamDescType = decltype(KDTreeParams);
 
   using ParamSetViewType = ParameterSetView<ParamDescType>;
@@ -71,7 +77,9 @@ public:
     if (!datasetClientPtr) return Error(NoDataSet);
     auto dataset = datasetClientPtr->getDataSet();
     if (dataset.size() == 0) return Error(EmptyDataSet);
-    mAlgorithm = algorithm::KDTree(dataset);
+    mAlgorithm = algorithm::KDTree(
+        dataset, get<kLeafSize>(),
+        algorithm::DistanceFuncs::searchMetric(get<kMetric>()));
     return OK();
   }
 
@@ -120,12 +128,48 @@ public:
     return {dist};
   }
 
+  // Batch kNearest and kNearestDist over every point of source, with the
+  // queries spread over the worker pool. Row i of ids gets the ids of the
+  // neighbours of source's point i, nearest first, and row i of distances
+  // how far away they are.
+  MessageResult<void> kNearestDataSet(InputDataSetClientRef source,
+                                      LabelSetClientRef     ids,
+                                      DataSetClientRef      distances,
+                                      Optional<index>       nNeighbours) const
+  {
+    index k = nNeighbours ? nNeighbours.value() : get<kNumNeighbors>();
+    if (!mAlgorithm.initialized()) return Error(NoDataFitted);
+    if (k <= 0) return Error(SmallK);
+    if (k > mAlgorithm.size()) return Error(SmallDataSet);
+    auto sourcePtr = source.get().lock();
+    if (!sourcePtr) return Error(NoDataSet);
+    auto idsPtr = ids.get().lock();
+    if (!idsPtr) return Error(NoLabelSet);
+    auto distancesPtr = distances.get().lock();
+    if (!distancesPtr) return Error(NoDataSet);
+    auto dataSet = sourcePtr->getDataSet();
+    if (dataSet.size() == 0) return Error(EmptyDataSet);
+    if (dataSet.pointSize() != mAlgorithm.dims()) return Error(WrongPointSize);
+    FluidTensor<index, 2>  indices(dataSet.size(), k);
+    FluidTensor<double, 2> dists(dataSet.size(), k);
+    mAlgorithm.kNearest(dataSet, k, indices, dists);
+    FluidTensor<string, 1> fittedIds(mAlgorithm.size());
+    mAlgorithm.getIds(fittedIds);
+    FluidTensor<string, 2> neighbours(dataSet.size(), k);
+    std::transform(indices.begin(), indices.end(), neighbours.begin(),
+                   [&fittedIds](index i) { return fittedIds(i); });
+    idsPtr->setLabelSet(LabelSet(dataSet.getIds(), neighbours));
+    distancesPtr->setDataSet(DataSet(dataSet.getIds(), dists));
+    return OK();
+  }
+
   static auto getMessageDescriptors()
   {
     return defineMessages(
         makeMessage("fit", &KDTreeClient::fit),
         makeMessage("kNearest", &KDTreeClient::kNearest),
         makeMessage("kNearestDist", &KDTreeClient::kNearestDist),
+        makeMessage("kNearestDataSet", &KDTreeClient::kNearestDataSet),
         makeMessage("cols", &KDTreeClient::dims),
         makeMessage("clear", &KDTreeClient::clear),
         makeMessage("size", &KDTreeClient::size),
@@ -23,7 +23,8 @@ namespace kmeans {
 constexpr auto KMeansParams = defineParameters(
     StringParam<Fixed<true>>("name", "Name"),
     LongParam("numClusters", "Number of Clusters", 4, Min(1)),
-    LongParam("maxIter", "Max number of Iterations", 100, Min(1)));
+    LongParam("maxIter", "Max number of Iterations", 100, Min(1)),
+    LongParam("batchSize", "Mini-batch Size (0 for all points)", 0, Min(0)));
 
 class KMeansClient : public FluidBaseClient,
                      OfflineIn,
@@ -31,7 +32,7 @@ class KMeansClient : public FluidBaseClient,
                      ModelObject,
                      public DataClient<algorithm::KMeans>
 {
-  enum { kName, kNumClusters, kMaxIter };
+  enum { kName, kNumClusters, kMaxIter, kBatchSize };
   ParameterTrackChanges<index> mTracker; 
 public:
   using string = std::string;
@@ -79,7 +80,7 @@ public:
     if (dataSet.size() == 0) return Error<IndexVector>(EmptyDataSet);
     if (k <= 1) return Error<IndexVector>(SmallK);
     if(mTracker.changed(k)) mAlgorithm.clear(); 
-    mAlgorithm.train(dataSet, k, maxIter);
+    mAlgorithm.train(dataSet, k, maxIter, get<kBatchSize>());
     IndexVector assignments(dataSet.size());
     mAlgorithm.getAssignments(assignments);
     return getCounts(assignments, k);
@@ -99,7 +100,7 @@ public:
     if (k <= 1) return Error<IndexVector>(SmallK);
     if (maxIter <= 0) maxIter = 100;
     if(mTracker.changed(k)) mAlgorithm.clear(); 
-    mAlgorithm.train(dataSet, k, maxIter);
+    mAlgorithm.train(dataSet, k, maxIter, get<kBatchSize>());
     IndexVector assignments(dataSet.size());
     mAlgorithm.getAssignments(assignments);
     StringVectorView ids = dataSet.getIds();
@@ -167,7 +168,7 @@ public:
     if (dataSet.size() == 0) return Error<IndexVector>(EmptyDataSet);
     if (k <= 1) return Error<IndexVector>(SmallK);
     if (maxIter <= 0) maxIter = 100;
-    mAlgorithm.train(dataSet, k, maxIter);
+    mAlgorithm.train(dataSet, k, maxIter, get<kBatchSize>());
     IndexVector assignments(dataSet.size());
     mAlgorithm.getAssignments(assignments);
     transform(srcClient, dstClient);
@@ -309,7 +310,7 @@ public:
 
   template <typename T>
   void process(std::vector<FluidTensorView<T, 1>>& input,
-               std::vector<FluidTensorView<T, 1>>& output, FluidContext&)
+               std::vector<FluidTensorView<T, 1>>& output, FluidContext& c)
   {
     output[0] <<= input[0];
     if (input[0](0) > 0)
@@ -340,10 +341,10 @@ public:
         //report error?
         return;
       }
-      RealVector point(dims);
+      RealVector point(dims, c.allocator());
       point <<= BufferAdaptor::ReadAccess(get<kInputBuffer>().get())
                   .samps(0, dims, 0);
-      outSamps[0] = kmeansPtr->algorithm().vq(point);
+      outSamps[0] = kmeansPtr->algorithm().vq(point, c.allocator());
     }
   }
 
@@ -15,6 +15,7 @@ under the European Union’s Horizon 2020 research and innovation programme
 #include "NRTClient.hpp"
 #include "../../algorithms/public/KNNClassifier.hpp"
 #include "../../algorithms/public/LabelSetEncoder.hpp"
+#include <stdexcept>
 
 namespace fluid {
 namespace client {
@@ -23,39 +24,91 @@ namespace knnclassifier {
 struct KNNClassifierData
 {
   algorithm::KDTree                         tree{0};
+  algorithm::HNSW                           graph; // replaces tree if fitted
   FluidDataSet<std::string, std::string, 1> labels{1};
-  index                                     size() const { return labels.size(); }
-  index                                     dims() const { return tree.dims(); }
-  void                                      clear()
+  algorithm::LabelSetEncoder                encoder;
+  FluidTensor<index, 1> classes; // encoded label of each fitted point
+
+  // refreshes encoder and classes from labels
+  void encodeLabels()
+  {
+    encoder.fit(labels);
+    classes.resize(labels.size());
+    auto data = labels.getData();
+    for (index i = 0; i < labels.size(); i++)
+      classes(i) = encoder.encodeIndex(data(i, 0));
+  }
+
+  // calls f with whichever neighbour search was fitted
+  template <typename F>
+  decltype(auto) withIndex(F&& f) const
+  {
+    return graph.initialized() ? f(graph) : f(tree);
+  }
+
+  index size() const { return labels.size(); }
+  index dims() const
+  {
+    return withIndex([](auto& tree) { return tree.dims(); });
+  }
+  void clear()
   {
     labels = FluidDataSet<std::string, std::string, 1>(1);
     tree.clear();
+    graph.clear();
+    encoder.clear();
+    classes.resize(0);
+  }
+  bool initialized() const
+  {
+    return tree.initialized() || graph.initialized();
   }
-  bool initialized() const { return tree.initialized(); }
 };
 
 void to_json(nlohmann::json& j, const KNNClassifierData& data)
 {
-  j["tree"] = data.tree;
+  if (data.graph.initialized())
+    j["graph"] = data.graph;
+  else
+    j["tree"] = data.tree;
   j["labels"] = data.labels;
 }
 
 bool check_json(const nlohmann::json& j, const KNNClassifierData&)
 {
-  return fluid::check_json(j, {"tree", "labels"},
-                           {JSONTypes::OBJECT, JSONTypes::OBJECT});
+  return fluid::check_json(j, {"labels"}, {JSONTypes::OBJECT}) &&
+         (fluid::check_json(j, {"tree"}, {JSONTypes::OBJECT}) ||
+          fluid::check_json(j, {"graph"}, {JSONTypes::OBJECT}));
 }
 
 void from_json(const nlohmann::json& j, KNNClassifierData& data)
 {
-  data.tree = j.at("tree").get<algorithm::KDTree>();
-  data.labels = j.at("labels").get<FluidDataSet<std::string, std::string, 1>>();
+  auto labels = j.at("labels").get<FluidDataSet<std::string, std::string, 1>>();
+  if (j.contains("graph"))
+  {
+    data.tree = algorithm::KDTree();
+    data.graph = j.at("graph").get<algorithm::HNSW>();
+    if (!data.graph.alignToFitted(labels, data.labels))
+      throw std::invalid_argument("Labels don't match the fitted points");
+  }
+  else
+  {
+    data.graph = algorithm::HNSW();
+    data.tree = j.at("tree").get<algorithm::KDTree>();
+    if (!data.tree.alignToFitted(labels, data.labels))
+      throw std::invalid_argument("Labels don't match the fitted points");
+  }
+  data.encodeLabels();
 }
 
 constexpr auto KNNClassifierParams = defineParameters(
     StringParam<Fixed<true>>("name", "Name"),
     LongParam("numNeighbours", "Number of Nearest Neighbours", 3, Min(1)),
-    EnumParam("weight", "Weight Neighbours by Distance", 1, "No", "Yes"));
+    EnumParam("weight", "Weight Neighbours by Distance", 1, "No", "Yes"),
+    EnumParam("approximate", "Approximate Neighbour Search", 0, "No",
+              "Yes"),
+    EnumParam("metric", "Distance Metric", 0, "Euclidean", "Manhattan",
+              "Chebyshev", "Cosine"));
 
 class KNNClassifierClient : public FluidBaseClient,
                             OfflineIn,
@@ -63,7 +116,7 @@ class KNNClassifierClient : public FluidBaseClient,
                             ModelObject,
                             public DataClient<KNNClassifierData>
 {
-  enum { kName, kNumNeighbors, kWeight };
+  enum { kName, kNumNeighbors, kWeight, kApproximate, kMetric };
 
 public:
   using string = std::string;
@@ -112,10 +165,24 @@ public:
     auto labelSet = labelsetPtr->getLabelSet();
     if (labelSet.size() == 0) return Error(EmptyLabelSet);
     if (dataset.size() != labelSet.size()) return Error(SizesDontMatch);
-    mAlgorithm.tree = algorithm::KDTree{dataset};
-    mAlgorithm.labels = labelSet;
-    mAlgorithm = {mAlgorithm.tree, mAlgorithm.labels};
-    mLabelSetEncoder.fit(mAlgorithm.labels);
+    KNNClassifierData fitted{algorithm::KDTree(), algorithm::HNSW(),
+                             LabelSet(), algorithm::LabelSetEncoder(),
+                             FluidTensor<index, 1>()};
+    auto metric = algorithm::DistanceFuncs::searchMetric(get<kMetric>());
+    if (get<kApproximate>() != 0)
+      fitted.graph = algorithm::HNSW(
+          dataset, algorithm::HNSW::defaultMaxConnections,
+          algorithm::HNSW::defaultConstructionBeam,
+          algorithm::HNSW::defaultSearchBeam, metric);
+    else
+      fitted.tree = algorithm::KDTree(dataset,
+                                      algorithm::KDTree::defaultLeafSize, metric);
+    if (!fitted.withIndex([&](auto& tree) {
+          return tree.alignToFitted(labelSet, fitted.labels);
+        }))
+      return Error(PointNotFound);
+    fitted.encodeLabels();
+    mAlgorithm = std::move(fitted);
     return OK();
   }
 
@@ -124,18 +191,21 @@ public:
     index k = get<kNumNeighbors>();
     bool  weight = get<kWeight>() != 0;
     if (k == 0) return Error<string>(SmallK);
-    if (mAlgorithm.tree.size() == 0) return Error<string>(NoDataFitted);
-    if (mAlgorithm.tree.size() < k) return Error<string>(NotEnoughData);
-    InBufferCheck bufCheck(mAlgorithm.tree.dims());
+    if (mAlgorithm.size() == 0) return Error<string>(NoDataFitted);
+    if (mAlgorithm.size() < k) return Error<string>(NotEnoughData);
+    InBufferCheck bufCheck(mAlgorithm.dims());
     if (!bufCheck.checkInputs(data.get()))
       return Error<string>(bufCheck.error());
     algorithm::KNNClassifier classifier;
-    RealVector               point(mAlgorithm.tree.dims());
+    RealVector               point(mAlgorithm.dims());
     point <<= BufferAdaptor::ReadAccess(data.get())
-                .samps(0, mAlgorithm.tree.dims(), 0);
-    std::string result = classifier.predict(mAlgorithm.tree, point,
-                                            mAlgorithm.labels, k, weight);
-    return result;
+                .samps(0, mAlgorithm.dims(), 0);
+    index prediction = mAlgorithm.withIndex([&](auto& tree) {
+      return classifier.predictIndex(tree, point, mAlgorithm.classes,
+                                     mAlgorithm.encoder.numLabels(), k,
+                                     weight);
+    });
+    return mAlgorithm.encoder.decodeIndex(prediction);
   }
 
   MessageResult<void> predict(InputDataSetClientRef  source,
@@ -149,24 +219,23 @@ public:
     if (dataSet.size() == 0) return Error(EmptyDataSet);
     auto destPtr = dest.get().lock();
     if (!destPtr) return Error(NoLabelSet);
-    if (dataSet.pointSize() != mAlgorithm.tree.dims())
+    if (dataSet.pointSize() != mAlgorithm.dims())
       return Error(WrongPointSize);
     if (k == 0) return Error(SmallK);
-    if (mAlgorithm.tree.size() == 0) return Error(NoDataFitted);
-    if (mAlgorithm.tree.size() < k) return Error(NotEnoughData);
+    if (mAlgorithm.size() == 0) return Error(NoDataFitted);
+    if (mAlgorithm.size() < k) return Error(NotEnoughData);
 
     algorithm::KNNClassifier classifier;
-    auto                     ids = dataSet.getIds();
-    auto                     data = dataSet.getData();
-    LabelSet                 result(1);
+    FluidTensor<index, 1>    classes(dataSet.size());
+    mAlgorithm.withIndex([&](auto& tree) {
+      classifier.predictIndex(tree, dataSet.getData(), mAlgorithm.classes,
+                              mAlgorithm.encoder.numLabels(), k, weight,
+                              classes);
+    });
+    FluidTensor<string, 2> labels(dataSet.size(), 1);
     for (index i = 0; i < dataSet.size(); i++)
-    {
-      RealVectorView point = data.row(i);
-      StringVector   label = {classifier.predict(mAlgorithm.tree, point,
-                                               mAlgorithm.labels, k, weight)};
-      result.add(ids(i), label);
-    }
-    destPtr->setLabelSet(result);
+      labels(i, 0) = mAlgorithm.encoder.decodeIndex(classes(i));
+    destPtr->setLabelSet(LabelSet(dataSet.getIds(), labels));
     return OK();
   }
 
@@ -186,13 +255,10 @@ public:
         makeMessage("read", &KNNClassifierClient::read));
   }
 
-  index encodeIndex(std::string const& label) const 
+  index encodeIndex(std::string const& label) const
   {
-    return mLabelSetEncoder.encodeIndex(label);
+    return mAlgorithm.encoder.encodeIndex(label);
   }
-
-private:
-  algorithm::LabelSetEncoder mLabelSetEncoder;
 };
 
 using KNNClassifierRef = SharedClientRef<const KNNClassifierClient>;
@@ -249,21 +315,24 @@ public:
       index k = get<kNumNeighbors>();
       bool  weight = get<kWeight>() != 0;
       auto& algorithm = knnPtr->algorithm();
-      index treeSize = algorithm.tree.size();
+      index treeSize = algorithm.size();
       if (k == 0 || treeSize == 0 || treeSize < k) return;
-      InOutBuffersCheck bufCheck(algorithm.tree.dims());
+      InOutBuffersCheck bufCheck(algorithm.dims());
       if (!bufCheck.checkInputs(get<kInputBuffer>().get(),
                                 get<kOutputBuffer>().get()))
         return;
       auto outBuf = BufferAdaptor::Access(get<kOutputBuffer>().get());
       if (outBuf.samps(0).size() != 1) return;
       algorithm::KNNClassifier classifier;
-      RealVector               point(algorithm.tree.dims());
+      RealVector               point(algorithm.dims(), c.allocator());
       point <<= BufferAdaptor::ReadAccess(get<kInputBuffer>().get())
-                    .samps(0, algorithm.tree.dims(), 0);
-      std::string const& result = classifier.predict(
-          algorithm.tree, point, algorithm.labels, k, weight, c.allocator());
-      outBuf.samps(0)[0] = static_cast<double>(knnPtr->encodeIndex(result));
+                    .samps(0, algorithm.dims(), 0);
+      index prediction = algorithm.withIndex([&](auto& tree) {
+        return classifier.predictIndex(tree, point, algorithm.classes,
+                                       algorithm.encoder.numLabels(), k,
+                                       weight, c.allocator());
+      });
+      outBuf.samps(0)[0] = static_cast<double>(prediction);
     }
   }
 
@@ -13,6 +13,7 @@ under the European Union’s Horizon 2020 research and innovation programme
 #include "DataSetClient.hpp"
 #include "NRTClient.hpp"
 #include "../../algorithms/public/KNNRegressor.hpp"
+#include <stdexcept>
 
 namespace fluid {
 namespace client {
@@ -21,40 +22,77 @@ namespace knnregressor {
 struct KNNRegressorData
 {
   algorithm::KDTree                    tree{0};
+  algorithm::HNSW                      graph; // replaces tree if fitted
   FluidDataSet<std::string, double, 1> target{1};
-  index                                size() const { return target.size(); }
-  index                                dims() const { return tree.dims(); }
-  void                                 clear()
+
+  // calls f with whichever neighbour search was fitted
+  template <typename F>
+  decltype(auto) withIndex(F&& f) const
+  {
+    return graph.initialized() ? f(graph) : f(tree);
+  }
+
+  index size() const { return target.size(); }
+  index dims() const
+  {
+    return withIndex([](auto& tree) { return tree.dims(); });
+  }
+  void clear()
   {
     tree.clear();
+    graph.clear();
     target = FluidDataSet<std::string, double, 1>();
   }
-  bool initialized() const { return tree.initialized(); }
+  bool initialized() const
+  {
+    return tree.initialized() || graph.initialized();
+  }
 };
 
 void to_json(nlohmann::json& j, const KNNRegressorData& data)
 {
-  j["tree"] = data.tree;
+  if (data.graph.initialized())
+    j["graph"] = data.graph;
+  else
+    j["tree"] = data.tree;
   j["target"] = data.target;
 }
 
 bool check_json(const nlohmann::json& j, const KNNRegressorData&)
 {
-  return fluid::check_json(j, {"tree", "target"},
-                           {JSONTypes::OBJECT, JSONTypes::OBJECT});
+  return fluid::check_json(j, {"target"}, {JSONTypes::OBJECT}) &&
+         (fluid::check_json(j, {"tree"}, {JSONTypes::OBJECT}) ||
+          fluid::check_json(j, {"graph"}, {JSONTypes::OBJECT}));
 }
 
 void from_json(const nlohmann::json& j, KNNRegressorData& data)
 {
-  data.tree = j["tree"].get<algorithm::KDTree>();
-  data.target = j["target"].get<FluidDataSet<std::string, double, 1>>();
+  auto target = j["target"].get<FluidDataSet<std::string, double, 1>>();
+  if (j.contains("graph"))
+  {
+    data.tree = algorithm::KDTree();
+    data.graph = j["graph"].get<algorithm::HNSW>();
+    if (!data.graph.alignToFitted(target, data.target))
+      throw std::invalid_argument("Targets don't match the fitted points");
+  }
+  else
+  {
+    data.graph = algorithm::HNSW();
+    data.tree = j["tree"].get<algorithm::KDTree>();
+    if (!data.tree.alignToFitted(target, data.target))
+      throw std::invalid_argument("Targets don't match the fitted points");
+  }
 }
 
 
 constexpr auto KNNRegressorParams = defineParameters(
     StringParam<Fixed<true>>("name", "Name"),
     LongParam("numNeighbours", "Number of Nearest Neighbours", 3, Min(1)),
-    EnumParam("weight", "Weight Neighbours by Distance", 1, "No", "Yes"));
+    EnumParam("weight", "Weight Neighbours by Distance", 1, "No", "Yes"),
+    EnumParam("approximate", "Approximate Neighbour Search", 0, "No",
+              "Yes"),
+    EnumParam("metric", "Distance Metric", 0, "Euclidean", "Manhattan",
+              "Chebyshev", "Cosine"));
 
 class KNNRegressorClient : public FluidBaseClient,
                            OfflineIn,
@@ -62,7 +100,7 @@ class KNNRegressorClient : public FluidBaseClient,
                            ModelObject,
                            public DataClient<KNNRegressorData>
 {
-  enum { kName, kNumNeighbors, kWeight };
+  enum { kName, kNumNeighbors, kWeight, kApproximate, kMetric };
 
 public:
   using string = std::string;
@@ -113,9 +151,21 @@ public:
     auto target = targetClientPtr->getDataSet();
     if (target.size() == 0) return Error<string>(EmptyDataSet);
     if (dataSet.size() != target.size()) return Error<string>(SizesDontMatch);
-    mAlgorithm.tree = algorithm::KDTree{dataSet};
-    mAlgorithm.target = target;
-    mAlgorithm = {mAlgorithm.tree, mAlgorithm.target};
+    KNNRegressorData fitted{algorithm::KDTree(), algorithm::HNSW(), DataSet()};
+    auto metric = algorithm::DistanceFuncs::searchMetric(get<kMetric>());
+    if (get<kApproximate>() != 0)
+      fitted.graph = algorithm::HNSW(
+          dataSet, algorithm::HNSW::defaultMaxConnections,
+          algorithm::HNSW::defaultConstructionBeam,
+          algorithm::HNSW::defaultSearchBeam, metric);
+    else
+      fitted.tree = algorithm::KDTree(dataSet,
+                                      algorithm::KDTree::defaultLeafSize, metric);
+    if (!fitted.withIndex([&](auto& tree) {
+          return tree.alignToFitted(target, fitted.target);
+        }))
+      return Error<string>(PointNotFound);
+    mAlgorithm = std::move(fitted);
     return {};
   }
 
@@ -124,10 +174,10 @@ public:
     index k = get<kNumNeighbors>();
     bool  weight = get<kWeight>() != 0;
     if (k == 0) return Error(SmallK);
-    if (mAlgorithm.tree.size() == 0) return Error(NoDataFitted);
-    if (mAlgorithm.tree.size() < k) return Error(NotEnoughData);
+    if (mAlgorithm.size() == 0) return Error(NoDataFitted);
+    if (mAlgorithm.size() < k) return Error(NotEnoughData);
 
-    InBufferCheck bufCheck(mAlgorithm.tree.dims());
+    InBufferCheck bufCheck(mAlgorithm.dims());
     if (!bufCheck.checkInputs(in.get()))
       return Error(bufCheck.error());
     BufferAdaptor::ReadAccess inBuf(in.get());
@@ -136,10 +186,12 @@ public:
     Result resizeResult = outBuf.resize(mAlgorithm.target.dims(), 1, inBuf.sampleRate());
     if (!resizeResult.ok()) return Error(BufferAlloc);
     algorithm::KNNRegressor regressor;
-    RealVector              input(mAlgorithm.tree.dims());
+    RealVector              input(mAlgorithm.dims());
     RealVector              output(mAlgorithm.target.dims());
-    input <<= inBuf.samps(0, mAlgorithm.tree.dims(), 0);
-    regressor.predict(mAlgorithm.tree, mAlgorithm.target, input, output, k, weight);
+    input <<= inBuf.samps(0, mAlgorithm.dims(), 0);
+    mAlgorithm.withIndex([&](auto& tree) {
+      regressor.predict(tree, mAlgorithm.target, input, output, k, weight);
+    });
     outBuf.samps(0) <<= output;
     return OK();
   }
@@ -155,24 +207,19 @@ public:
     if (dataSet.size() == 0) return Error(EmptyDataSet);
     auto destPtr = dest.get().lock();
     if (!destPtr) return Error(NoDataSet);
-    if (dataSet.pointSize() != mAlgorithm.tree.dims())
+    if (dataSet.pointSize() != mAlgorithm.dims())
       return Error(WrongPointSize);
     if (k == 0) return Error(SmallK);
-    if (mAlgorithm.tree.size() == 0) return Error(NoDataFitted);
-    if (mAlgorithm.tree.size() < k) return Error(NotEnoughData);
+    if (mAlgorithm.size() == 0) return Error(NoDataFitted);
+    if (mAlgorithm.size() < k) return Error(NotEnoughData);
 
     algorithm::KNNRegressor regressor;
-    auto                    ids = dataSet.getIds();
-    auto                    data = dataSet.getData();
-    DataSet                 result(mAlgorithm.target.dims());
-    RealVector              prediction(mAlgorithm.target.dims());
-    for (index i = 0; i < dataSet.size(); i++)
-    {
-      RealVectorView point = data.row(i);
-      regressor.predict(mAlgorithm.tree, mAlgorithm.target, point, prediction, k, weight);
-      result.add(ids(i), prediction);
-    }
-    destPtr->setDataSet(result);
+    RealMatrix              predictions(dataSet.size(), mAlgorithm.target.dims());
+    mAlgorithm.withIndex([&](auto& tree) {
+      regressor.predict(tree, mAlgorithm.target, dataSet.getData(),
+                        predictions, k, weight);
+    });
+    destPtr->setDataSet(DataSet(dataSet.getIds(), predictions));
     return OK();
   }
 
@@ -247,9 +294,9 @@ public:
       const KNNRegressorData& algorithm = knnPtr->algorithm();
       index                   k = get<kNumNeighbors>();
       bool                    weight = get<kWeight>() != 0;
-      if (k == 0 || algorithm.tree.size() == 0 || algorithm.tree.size() < k)
+      if (k == 0 || algorithm.size() == 0 || algorithm.size() < k)
         return;
-      InOutBuffersCheck bufCheck(algorithm.tree.dims());
+      InOutBuffersCheck bufCheck(algorithm.dims());
       if (!bufCheck.checkInputs(get<kInputBuffer>().get(),
                                 get<kOutputBuffer>().get()))
         return;
@@ -258,13 +305,16 @@ public:
 
       algorithm::KNNRegressor regressor;
 
-      RealVector input(algorithm.tree.dims(), c.allocator());
+      RealVector input(algorithm.dims(), c.allocator());
       RealVector output(algorithm.target.dims(), c.allocator());
 
       input <<= BufferAdaptor::ReadAccess(get<kInputBuffer>().get())
-                  .samps(0, algorithm.tree.dims(), 0);
+                  .samps(0, algorithm.dims(), 0);
 
-      regressor.predict(algorithm.tree, algorithm.target, input, output, k, weight, c.allocator());
+      algorithm.withIndex([&](auto& tree) {
+        regressor.predict(tree, algorithm.target, input, output, k, weight,
+                          c.allocator());
+      });
       outBuf.samps(0) <<= output;
     }
   }
@@ -236,7 +236,7 @@ public:
         return {Result::Status::kCancelled, ""};
       //          tmp = sourceData.col(i);
       tmp <<= source.samps(get<kOffset>(), nFrames, get<kStartChan>() + i);
-      stft.process(tmp, spectrum);
+      stft.process(tmp, spectrum, 0);
       algorithm::STFT::magnitude(spectrum, magnitude);
       int progressCount{0};
       // For multichannel dictionaries, seed data could be all over the place,
@@ -322,7 +322,7 @@ public:
           if (c.task() &&
               !c.task()->processUpdate(++progressCount, progressTotal))
             return {Result::Status::kCancelled, ""};
-          istft.process(resynthSpectrum, resynthAudio);
+          istft.process(resynthSpectrum, resynthAudio, 0);
           resynth.samps(i * get<kRank>() + j) <<= resynthAudio(Slice(0, nFrames));
           if (c.task() &&
               !c.task()->processUpdate(++progressCount, progressTotal))
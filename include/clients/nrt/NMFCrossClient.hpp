@@ -130,10 +130,10 @@ public:
     if (!resizeResult.ok()) return resizeResult;
 
     srcTmp <<= source.samps(0, srcFrames, 0);
-    stft.process(srcTmp, srcSpectrum);
+    stft.process(srcTmp, srcSpectrum, 0);
     STFT::magnitude(srcSpectrum, W);
     tgtTmp <<= target.samps(0, tgtFrames, 0);
-    stft.process(tgtTmp, tgtSpectrum);
+    stft.process(tgtTmp, tgtSpectrum, 0);
     STFT::magnitude(tgtSpectrum, tgtMag);
     index rank = W.rows();
     auto  outputEnvelopes = FluidTensor<double, 2>(tgtWindows, rank);
@@ -166,12 +166,12 @@ public:
 
     GriffinLim gl;
     gl.process(result, tgtFrames, 50, fftParams.winSize(), fftParams.fftSize(),
-               fftParams.hopSize());
+               fftParams.hopSize(), 0);
 
     r = checkTask(c, ++progressCount, progressTotal);
     if (!r.ok()) return r;
 
-    istft.process(result, resultAudio);
+    istft.process(result, resultAudio, 0);
 
     r = checkTask(c, ++progressCount, progressTotal);
     if (!r.ok()) return r;
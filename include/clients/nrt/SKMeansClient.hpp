@@ -318,7 +318,7 @@ public:
 
   template <typename T>
   void process(std::vector<FluidTensorView<T, 1>>& input,
-               std::vector<FluidTensorView<T, 1>>& output, FluidContext&)
+               std::vector<FluidTensorView<T, 1>>& output, FluidContext& c)
   {
     output[0] = input[0];
     if (input[0](0) > 0)
@@ -338,10 +338,10 @@ public:
       auto outBuf = BufferAdaptor::Access(get<kOutputBuffer>().get());
       auto outSamps = outBuf.samps(0);
       if (outSamps.size() < 1) return;
-      RealVector point(dims);
+      RealVector point(dims, c.allocator());
       point <<= BufferAdaptor::ReadAccess(get<kInputBuffer>().get())
                   .samps(0, dims, 0);
-      outSamps[0] = kmeansPtr->algorithm().vq(point);
+      outSamps[0] = kmeansPtr->algorithm().vq(point, c.allocator());
     }
   }
 
@@ -24,7 +24,9 @@ constexpr auto UMAPParams = defineParameters(
     LongParam("numNeighbours", "Number of Nearest Neighbours", 15, Min(1)),
     FloatParam("minDist", "Minimum Distance", 0.1, Min(0)),
     LongParam("iterations", "Number of Iterations", 200, Min(1)),
-    FloatParam("learnRate", "Learning Rate", 0.1, Min(0.0), Max(1.0)));
+    FloatParam("learnRate", "Learning Rate", 0.1, Min(0.0), Max(1.0)),
+    EnumParam("approximate", "Approximate Neighbour Search", 0, "No",
+              "Yes"));
 
 class UMAPClient : public FluidBaseClient,
                    OfflineIn,
@@ -38,7 +40,8 @@ class UMAPClient : public FluidBaseClient,
     kNumNeighbors,
     kMinDistance,
     kNumIter,
-    kLearningRate
+    kLearningRate,
+    kApproximate
   };
 
 public:
@@ -86,7 +89,7 @@ public:
     {
       result = mAlgorithm.train(src, get<kNumNeighbors>(), get<kNumDimensions>(),
                                 get<kMinDistance>(), get<kNumIter>(),
-                                get<kLearningRate>());
+                                get<kLearningRate>(), get<kApproximate>() != 0);
     }
     catch (const std::runtime_error& e) //spectra library will throw if eigen decomp fails
     {
@@ -108,7 +111,7 @@ public:
     FluidDataSet<string, double, 1> result;
     result = mAlgorithm.train(src, get<kNumNeighbors>(), get<kNumDimensions>(),
                               get<kMinDistance>(), get<kNumIter>(),
-                              get<kLearningRate>());
+                              get<kLearningRate>(), get<kApproximate>() != 0);
     return OK();
   }
 
@@ -132,6 +135,26 @@ public:
     return OK();
   }
 
+  // adds the points of a DataSet to the fitted model without refitting, and
+  // writes out their embedding
+  MessageResult<void> add(InputDataSetClientRef sourceClient,
+                          DataSetClientRef      destClient)
+  {
+    auto srcPtr = sourceClient.get().lock();
+    auto destPtr = destClient.get().lock();
+    if (!srcPtr || !destPtr) return Error(NoDataSet);
+    auto src = srcPtr->getDataSet();
+    if (src.size() == 0) return Error(EmptyDataSet);
+    if (!mAlgorithm.initialized()) return Error(NoDataFitted);
+    if (get<kNumDimensions>() != mAlgorithm.dims())
+      return Error("Wrong target number of dimensions");
+    if (src.pointSize() != mAlgorithm.inputDims()) return Error(WrongPointSize);
+    FluidDataSet<string, double, 1> result;
+    result = mAlgorithm.add(src, get<kNumIter>(), get<kLearningRate>());
+    destPtr->setDataSet(result);
+    return OK();
+  }
+
   MessageResult<void> transformPoint(InputBufferPtr in, BufferPtr out)
   {
     index inSize = mAlgorithm.inputDims();
@@ -159,6 +182,7 @@ public:
         makeMessage("fitTransform", &UMAPClient::fitTransform),
         makeMessage("fit", &UMAPClient::fit),
         makeMessage("transform", &UMAPClient::transform),
+        makeMessage("add", &UMAPClient::add),
         makeMessage("transformPoint", &UMAPClient::transformPoint),
         makeMessage("cols", &UMAPClient::dims),
         makeMessage("clear", &UMAPClient::clear),
@@ -47,8 +47,13 @@ constexpr auto MFCCParams = defineParameters(
     FloatParam("maxFreq", "High Frequency Bound", 20000, Min(0)),
     FFTParam("fftSettings", "FFT Settings", 1024, -1, -1));
 
-class MFCCClient : public FluidBaseClient, public AudioIn, public ControlOut
+template <typename Real>
+class BasicMFCCClient : public FluidBaseClient,
+                        public AudioIn,
+                        public ControlOut
 {
+  using ComplexMatrixView = FluidTensorView<std::complex<Real>, 2>;
+
 public:
   using ParamDescType = decltype(MFCCParams);
 
@@ -69,7 +74,7 @@ public:
 
   static constexpr auto& getParameterDescriptors() { return MFCCParams; }
 
-  MFCCClient(ParamSetViewType& p, FluidContext& c)
+  BasicMFCCClient(ParamSetViewType& p, FluidContext& c)
       : mParams{p}, mSTFTBufferedProcess(get<kFFT>(), 1, 0, c.hostVectorSize(), c.allocator()),
         mMelBands(get<kFFT>().max(), get<kFFT>().max(), c.allocator()),
         mDCT(get<kFFT>().max(), get<kNCoefs>().max() + 1, c.allocator()),
@@ -112,7 +117,8 @@ public:
 
     if (mHostSizeTracker.changed(c.hostVectorSize()))
     {
-      mSTFTBufferedProcess =    STFTBufferedProcess<false>(get<kFFT>(),1,0,c.hostVectorSize(),c.allocator());
+      mSTFTBufferedProcess = STFTBufferedProcess<false, Real>(
+          get<kFFT>(), 1, 0, c.hostVectorSize(), c.allocator());
     }
 
     auto mags  = mMagnitude(Slice(0,frameSize));
@@ -121,7 +127,7 @@ public:
 
     mSTFTBufferedProcess.processInput(
         get<kFFT>(), input, c, [&](ComplexMatrixView in) {
-          algorithm::STFT::magnitude(in.row(0), mags);
+          algorithm::BasicSTFT<Real>::magnitude(in.row(0), mags);
           mMelBands.processFrame(mags, bands, false, false, true, c.allocator());
           mDCT.processFrame(bands, coefs);
         });
@@ -156,17 +162,21 @@ private:
   ParameterTrackChanges<index, index, index, double, double, double> mTracker;
   ParameterTrackChanges<index> mHostSizeTracker;
   
-  STFTBufferedProcess<false> mSTFTBufferedProcess;
+  STFTBufferedProcess<false, Real> mSTFTBufferedProcess;
 
-  algorithm::MelBands    mMelBands;
-  algorithm::DCT         mDCT;
-  FluidTensor<double, 1> mMagnitude;
-  FluidTensor<double, 1> mBands;
-  FluidTensor<double, 1> mCoefficients;
+  algorithm::BasicMelBands<Real> mMelBands;
+  algorithm::BasicDCT<Real>      mDCT;
+  FluidTensor<Real, 1>           mMagnitude;
+  FluidTensor<Real, 1>           mBands;
+  FluidTensor<Real, 1>           mCoefficients;
 };
+
+using MFCCClient = BasicMFCCClient<double>;
+using MFCCFloatClient = BasicMFCCClient<float>; // cheaper, less accurate
 } // namespace mfcc
 
 using RTMFCCClient = ClientWrapper<mfcc::MFCCClient>;
+using RTMFCCFloatClient = ClientWrapper<mfcc::MFCCFloatClient>;
 
 auto constexpr NRTMFCCParams =
     makeNRTParams<mfcc::MFCCClient>(InputBufferParam("source", "Source Buffer"),
@@ -178,5 +188,11 @@ using NRTMFCCClient =
 
 using NRTThreadedMFCCClient = NRTThreadingAdaptor<NRTMFCCClient>;
 
+using NRTMFCCFloatClient =
+    NRTControlAdaptor<mfcc::MFCCFloatClient, decltype(NRTMFCCParams),
+                      NRTMFCCParams, 1, 1>;
+
+using NRTThreadedMFCCFloatClient = NRTThreadingAdaptor<NRTMFCCFloatClient>;
+
 } // namespace client
 } // namespace fluid
@@ -24,8 +24,6 @@ namespace fluid {
 namespace client {
 namespace spectralshape {
 
-using algorithm::SpectralShape;
-
 enum SpectralShapeParamIndex {
   kSelect,
   kMinFreq,
@@ -46,11 +44,13 @@ constexpr auto SpectralShapeParams = defineParameters(
     EnumParam("power", "Use Power", 0, "No", "Yes"),
     FFTParam("fftSettings", "FFT Settings", 1024, -1, -1));
 
-class SpectralShapeClient : public FluidBaseClient,
-                            public AudioIn,
-                            public ControlOut
+template <typename Real>
+class BasicSpectralShapeClient : public FluidBaseClient,
+                                 public AudioIn,
+                                 public ControlOut
 {
   static constexpr index mMaxOutputSize = 7;
+  using ComplexMatrixView = FluidTensorView<std::complex<Real>, 2>;
 
 public:
   using ParamDescType = decltype(SpectralShapeParams);
@@ -71,7 +71,7 @@ public:
     return SpectralShapeParams;
   }
 
-  SpectralShapeClient(ParamSetViewType& p, FluidContext& c)
+  BasicSpectralShapeClient(ParamSetViewType& p, FluidContext& c)
       : mParams(p), mSTFTBufferedProcess(get<kFFT>(), 1, 0, c.hostVectorSize(),
                                          c.allocator()),
         mAlgorithm{c.allocator()},
@@ -82,7 +82,7 @@ public:
     controlChannelsOut({1, asSigned(get<kSelect>().count()), mMaxOutputSize});
     setInputLabels({"audio input"});
     setOutputLabels({"spectral features"});
-    mDescriptors = FluidTensor<double, 1>(mMaxOutputSize);
+    mDescriptors = FluidTensor<Real, 1>(mMaxOutputSize);
   }
 
   template <typename T>
@@ -98,14 +98,14 @@ public:
 
     if (mHostSizeTracker.changed(c.hostVectorSize()))
     {
-      mSTFTBufferedProcess = STFTBufferedProcess<>(get<kFFT>(), 1, 0, c.hostVectorSize(),
-                                         c.allocator());
+      mSTFTBufferedProcess = STFTBufferedProcess<true, Real>(
+          get<kFFT>(), 1, 0, c.hostVectorSize(), c.allocator());
     }
 
     mSTFTBufferedProcess.processInput(
         get<kFFT>(), input, c, [&](ComplexMatrixView in) {
-          algorithm::STFT::magnitude(in.row(0),
-                                     mMagnitude(Slice(0, in.size())));
+          algorithm::BasicSTFT<Real>::magnitude(
+              in.row(0), mMagnitude(Slice(0, in.size())));
           mAlgorithm.processFrame(
               mMagnitude(Slice(0, in.size())), mDescriptors, sampleRate(),
               get<kMinFreq>(), get<kMaxFreq>(), get<kRollOffPercent>(),
@@ -137,15 +137,20 @@ public:
 
 private:
   ParameterTrackChanges<index>         mHostSizeTracker;
-  STFTBufferedProcess<>                mSTFTBufferedProcess;
+  STFTBufferedProcess<true, Real>      mSTFTBufferedProcess;
 
-  SpectralShape          mAlgorithm;
-  FluidTensor<double, 1> mMagnitude;
-  FluidTensor<double, 1> mDescriptors;
+  algorithm::BasicSpectralShape<Real> mAlgorithm;
+  FluidTensor<Real, 1>                mMagnitude;
+  FluidTensor<Real, 1>                mDescriptors;
 };
+
+using SpectralShapeClient = BasicSpectralShapeClient<double>;
+using SpectralShapeFloatClient = BasicSpectralShapeClient<float>;
 } // namespace spectralshape
 
 using RTSpectralShapeClient = ClientWrapper<spectralshape::SpectralShapeClient>;
+using RTSpectralShapeFloatClient =
+    ClientWrapper<spectralshape::SpectralShapeFloatClient>;
 
 auto constexpr NRTSpectralShapeParams =
     makeNRTParams<spectralshape::SpectralShapeClient>(
@@ -160,5 +165,13 @@ using NRTSpectralShapeClient =
 using NRTThreadedSpectralShapeClient =
     NRTThreadingAdaptor<NRTSpectralShapeClient>;
 
+using NRTSpectralShapeFloatClient =
+    NRTControlAdaptor<spectralshape::SpectralShapeFloatClient,
+                      decltype(NRTSpectralShapeParams), NRTSpectralShapeParams,
+                      1, 1>;
+
+using NRTThreadedSpectralShapeFloatClient =
+    NRTThreadingAdaptor<NRTSpectralShapeFloatClient>;
+
 } // namespace client
 } // namespace fluid
@@ -0,0 +1,272 @@
+#pragma once
+
+#include <data/FluidDataSet.hpp>
+#include <data/FluidIndex.hpp>
+#include <data/FluidJSON.hpp>
+#include <data/FluidTensor.hpp>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace fluid {
+
+// Compact binary counterpart to JSONFile.
+//
+// Layout (native byte order, checked on read):
+//   header: magic "FLUCOMAB", uint32 version, uint32 byte order mark,
+//           uint32 kind, uint32 value size, uint64 rows, uint64 cols
+//   DataSet:  id string table, then rows x cols doubles
+//   LabelSet: id string table, then label string table
+//   anything else: uint64 length, then the object's JSON as UBJSON
+// A string table is rows + 1 uint64 offsets followed by the packed bytes,
+// so each table and the data matrix are read with a single call.
+class BinaryFile {
+public:
+  using json = nlohmann::json;
+  using string = std::string;
+  using fstream = std::fstream;
+  using DataSet = FluidDataSet<string, double, 1>;
+  using LabelSet = FluidDataSet<string, string, 1>;
+
+  static constexpr char     magic[8] = {'F', 'L', 'U', 'C', 'O', 'M', 'A', 'B'};
+  static constexpr uint32_t version = 1;
+  static constexpr uint32_t byteOrderMark = 0x01020304;
+
+  enum class Kind : uint32_t { kJSON, kDataSet, kLabelSet };
+
+  // Files written with this extension use the binary format
+  static bool isBinaryName(string const &fileName) {
+    const string ext = ".bin";
+    return fileName.size() > ext.size() &&
+           fileName.compare(fileName.size() - ext.size(), ext.size(), ext) == 0;
+  }
+
+  // Whether an existing file starts with the binary format's magic bytes
+  static bool isBinaryFile(string const &fileName) {
+    std::ifstream file(fileName, std::ios::binary);
+    char          start[sizeof(magic)];
+    return file.read(start, sizeof(magic)) &&
+           std::memcmp(start, magic, sizeof(magic)) == 0;
+  }
+
+  BinaryFile(string fileName, string rw) : mFileName(fileName), mRW(rw) {
+    assert(rw == "r" || rw == "w");
+    if (fileName.empty()) {
+      mError = "Filename not specified";
+      return;
+    }
+    if (mRW == "r") {
+      openRead();
+    } else if (mRW == "w") {
+      openWrite();
+    } else {
+      mError = "Invalid read/write specifier";
+    }
+  }
+
+  void openRead() {
+    mFile.open(mFileName, fstream::in | fstream::binary | fstream::ate);
+    if (mFile.fail()) {
+      mError = "File not found";
+      return;
+    }
+    mFileSize = static_cast<uint64_t>(mFile.tellg());
+    mFile.seekg(0);
+  }
+
+  void openWrite() {
+    mFile.open(mFileName, fstream::out | fstream::binary | fstream::trunc);
+    if (mFile.fail())
+      mError = "Could not open file for writing";
+  }
+
+  string error() { return mError; }
+
+  bool ok() { return mError.empty(); }
+
+  bool write(DataSet const &ds) {
+    if (!ok()) return false;
+    auto data = ds.getData();
+    writeHeader(Kind::kDataSet, sizeof(double), ds.size(), ds.pointSize());
+    writeStrings(ds.getIds());
+    writeBytes(data.data(), asUnsigned(data.size()) * sizeof(double));
+    return finishWrite();
+  }
+
+  bool write(LabelSet const &ls) {
+    if (!ok()) return false;
+    writeHeader(Kind::kLabelSet, 0, ls.size(), ls.pointSize());
+    writeStrings(ls.getIds());
+    writeStrings(ls.getData());
+    return finishWrite();
+  }
+
+  template <typename T>
+  bool write(T const &x) {
+    if (!ok()) return false;
+    std::vector<std::uint8_t> payload = json::to_ubjson(json(x), true, true);
+    writeHeader(Kind::kJSON, 0, 0, 0);
+    uint64_t length = payload.size();
+    writeBytes(&length, sizeof(length));
+    writeBytes(payload.data(), payload.size());
+    return finishWrite();
+  }
+
+  bool read(DataSet &ds) {
+    Header h;
+    if (!readHeader(h, Kind::kDataSet)) return false;
+    if (h.valueSize != sizeof(double)) return fail("Invalid file format");
+    if (!fits(h.rows, sizeof(uint64_t))) return false;
+    FluidTensor<string, 1> ids(asSigned(h.rows));
+    if (!readStrings(ids)) return false;
+    if (!fits(h.cols, sizeof(double)) ||
+        !fits(h.rows, h.cols * sizeof(double)))
+      return false;
+    FluidTensor<double, 2> data(asSigned(h.rows), asSigned(h.cols));
+    readBytes(data.data(), asUnsigned(data.size()) * sizeof(double));
+    if (!mFile.good()) return fail("Invalid file format");
+    ds = DataSet(ids, data);
+    return true;
+  }
+
+  bool read(LabelSet &ls) {
+    Header h;
+    if (!readHeader(h, Kind::kLabelSet)) return false;
+    if (h.cols != 1) return fail("Invalid file format");
+    if (!fits(h.rows, 2 * sizeof(uint64_t))) return false;
+    FluidTensor<string, 1> ids(asSigned(h.rows));
+    FluidTensor<string, 2> labels(asSigned(h.rows), 1);
+    if (!readStrings(ids) || !readStrings(labels)) return false;
+    ls = LabelSet(ids, labels);
+    return true;
+  }
+
+  template <typename T>
+  bool read(T &x) {
+    Header h;
+    if (!readHeader(h, Kind::kJSON)) return false;
+    uint64_t length = 0;
+    readBytes(&length, sizeof(length));
+    if (!fits(length)) return false;
+    std::vector<std::uint8_t> payload(length);
+    readBytes(payload.data(), payload.size());
+    if (!mFile.good()) return fail("Invalid file format");
+    json j = json::from_ubjson(payload, true, false);
+    if (j.is_discarded()) return fail("Error parsing file");
+    if (!check_json(j, x)) return fail("Invalid JSON format");
+    try {
+      x = j.get<T>();
+    } catch (const std::exception &) {
+      return fail("Invalid JSON format");
+    }
+    return true;
+  }
+
+private:
+  struct Header {
+    char     magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    Kind     kind;
+    uint32_t valueSize;
+    uint64_t rows;
+    uint64_t cols;
+  };
+
+  // written and read as raw bytes, so it mustn't pick up padding or anything
+  // that needs constructing
+  static_assert(sizeof(Header) == 40, "Header layout must not change");
+  static_assert(std::is_trivially_copyable<Header>::value,
+                "Header is copied as raw bytes");
+
+  bool fail(string message) {
+    mError = message;
+    return false;
+  }
+
+  // guards allocations against truncated or corrupt files: whether count
+  // items of size bytes each are left to read, without multiplying them out,
+  // so that huge counts from a corrupt header can't wrap around
+  bool fits(uint64_t count, uint64_t size = 1) {
+    if (!mFile.good()) return fail("Invalid file format");
+    uint64_t remaining = mFileSize - static_cast<uint64_t>(mFile.tellg());
+    return size == 0 || count <= remaining / size ||
+           fail("Invalid file format");
+  }
+
+  void writeBytes(const void *x, size_t n) {
+    mFile.write(static_cast<const char *>(x), static_cast<std::streamsize>(n));
+  }
+
+  void readBytes(void *x, size_t n) {
+    mFile.read(static_cast<char *>(x), static_cast<std::streamsize>(n));
+  }
+
+  bool finishWrite() {
+    mFile.flush();
+    return mFile.good() || fail("Error writing file");
+  }
+
+  void writeHeader(Kind kind, uint32_t valueSize, index rows, index cols) {
+    Header h;
+    std::memcpy(h.magic, magic, sizeof(magic));
+    h.version = version;
+    h.byteOrder = byteOrderMark;
+    h.kind = kind;
+    h.valueSize = valueSize;
+    h.rows = static_cast<uint64_t>(rows);
+    h.cols = static_cast<uint64_t>(cols);
+    writeBytes(&h, sizeof(h));
+  }
+
+  bool readHeader(Header &h, Kind expected) {
+    if (!ok()) return false;
+    if (!fits(sizeof(h))) return false;
+    readBytes(&h, sizeof(h));
+    if (!mFile.good() || std::memcmp(h.magic, magic, sizeof(magic)) != 0)
+      return fail("Invalid file format");
+    if (h.byteOrder != byteOrderMark) return fail("Unsupported byte order");
+    if (h.version > version) return fail("Unsupported file version");
+    if (h.kind != expected) return fail("File holds a different type of object");
+    return true;
+  }
+
+  template <size_t N>
+  void writeStrings(FluidTensorView<const string, N> strings) {
+    std::vector<uint64_t> offsets{0};
+    offsets.reserve(asUnsigned(strings.size()) + 1);
+    for (auto &s : strings) offsets.push_back(offsets.back() + s.size());
+    writeBytes(offsets.data(), offsets.size() * sizeof(uint64_t));
+    for (auto &s : strings) writeBytes(s.data(), s.size());
+  }
+
+  template <size_t N>
+  bool readStrings(FluidTensor<string, N> &strings) {
+    size_t n = asUnsigned(strings.size());
+    if (!fits(n + 1, sizeof(uint64_t))) return false;
+    std::vector<uint64_t> offsets(n + 1);
+    readBytes(offsets.data(), offsets.size() * sizeof(uint64_t));
+    if (!mFile.good() || offsets[0] != 0 ||
+        !std::is_sorted(offsets.begin(), offsets.end()) || !fits(offsets[n]))
+      return fail("Invalid file format");
+    string blob(offsets[n], '\0');
+    readBytes(&blob[0], blob.size());
+    auto s = strings.begin();
+    for (size_t i = 0; i < n; ++i, ++s)
+      s->assign(blob, offsets[i], offsets[i + 1] - offsets[i]);
+    return mFile.good() || fail("Invalid file format");
+  }
+
+  fstream  mFile;
+  string   mFileName;
+  string   mRW;
+  string   mError;
+  uint64_t mFileSize{0};
+};
+
+} // namespace fluid
@@ -3,6 +3,7 @@
 #include "data/FluidIndex.hpp"
 #include "data/FluidTensor.hpp"
 #include "data/TensorTypes.hpp"
+#include <algorithm>
 #include <iomanip>
 #include <iostream>
 #include <string>
@@ -55,6 +56,7 @@ public:
     if (size() == 0)
     {
       mData = FluidTensor<dataType, N + 1>(0, dims...);
+      mIds = FluidTensor<idType, 1>(0);
       mDim = FluidTensorSlice<N>(dims...);
       return true;
     }
@@ -64,19 +66,48 @@ public:
     }
   }
 
+  // Make room for at least n points without further reallocation
+  void reserve(index n)
+  {
+    if (n <= capacity()) return;
+    mData.resizeDim(0, n - capacity());
+    mIds.resizeDim(0, n - mIds.rows());
+    mIndex.reserve(asUnsigned(n));
+  }
+
+  index capacity() const { return mData.rows(); }
+
   bool add(idType const& id, FluidTensorView<dataType, N> point)
   {
     assert(sameExtents(mDim, point.descriptor()));
-    index pos = mData.rows();
-    auto  result = mIndex.insert({id, pos});
+    auto result = mIndex.insert({id, mSize});
     if (!result.second) return false;
-    mData.resizeDim(0, 1);
-    mData.row(mData.rows() - 1) <<= point;
-    mIds.resizeDim(0, 1);
-    mIds(mIds.rows() - 1) = id;
+    if (mSize == capacity()) reserve(std::max<index>(2 * capacity(), 16));
+    mData.row(mSize) <<= point;
+    mIds(mSize) = id;
+    mSize++;
     return true;
   }
 
+  // Add a batch of points, skipping any whose id is already present.
+  // Returns the number of points added
+  index addMany(FluidTensorView<const idType, 1>       ids,
+                FluidTensorView<const dataType, N + 1> points)
+  {
+    assert(ids.rows() == points.rows());
+    reserve(mSize + ids.rows());
+    index added = 0;
+    for (index i = 0; i < ids.rows(); i++)
+    {
+      if (!mIndex.insert({ids(i), mSize}).second) continue;
+      mData.row(mSize) <<= points.row(i);
+      mIds(mSize) = ids(i);
+      mSize++;
+      added++;
+    }
+    return added;
+  }
+
   bool get(idType const& id, FluidTensorView<dataType, N> point) const
   {
     auto pos = mIndex.find(id);
@@ -112,30 +143,46 @@ public:
     return true;
   }
 
+  // Removal moves the last point into the gap, so it is O(1) but doesn't
+  // preserve the order of the remaining points
   bool remove(idType const& id)
   {
     auto pos = mIndex.find(id);
-    if (pos == mIndex.end()) { return false; }
-    else
+    if (pos == mIndex.end()) return false;
+    index current = pos->second;
+    index last = mSize - 1;
+    mIndex.erase(pos);
+    if (current != last)
     {
-      auto current = pos->second;
-      mData.deleteRow(current);
-      mIds.deleteRow(current);
-      mIndex.erase(id);
-      for (auto& point : mIndex)
-        if (point.second > current) point.second--;
+      mData.row(current) <<= mData.row(last);
+      mIds(current) = std::move(mIds(last));
+      mIndex[mIds(current)] = current;
     }
+    mIds(last) = idType{};
+    mSize--;
     return true;
   }
 
-  FluidTensorView<dataType, N + 1>       getData() { return mData; }
-  FluidTensorView<idType, 1>             getIds() { return mIds; }
-  FluidTensorView<const dataType, N + 1> getData() const { return mData; }
-  FluidTensorView<const idType, 1>       getIds() const { return mIds; }
+  FluidTensorView<dataType, N + 1> getData()
+  {
+    return firstRows(mData.descriptor(), mData.data());
+  }
+  FluidTensorView<idType, 1> getIds()
+  {
+    return firstRows(mIds.descriptor(), mIds.data());
+  }
+  FluidTensorView<const dataType, N + 1> getData() const
+  {
+    return firstRows(mData.descriptor(), mData.data());
+  }
+  FluidTensorView<const idType, 1> getIds() const
+  {
+    return firstRows(mIds.descriptor(), mIds.data());
+  }
 
   index pointSize() const { return mDim.size; }
   index dims() const { return mDim.size; }
-  index size() const { return mIds.size(); }
+  index size() const { return mSize; }
   bool  initialized() const { return (size() > 0); }
 
   std::string printRow(FluidTensorView<const dataType, N> row,
@@ -197,10 +244,20 @@ public:
   }
 
 private:
+  // Storage may have spare capacity past the last point, so views only
+  // cover the first size() rows
+  template <typename U, size_t M>
+  FluidTensorView<U, M> firstRows(FluidTensorSlice<M> desc, U* data) const
+  {
+    desc.grow(0, mSize - desc.extents[0]);
+    return {desc, data};
+  }
+
   void initFromData()
   {
     assert(mIds.rows() == mData.rows());
     mDim = mData.cols();
+    mSize = mIds.rows();
     for (index i = 0; i < mIds.size(); i++) { mIndex.insert({mIds[i], i}); }
   }
 
@@ -208,5 +265,6 @@ private:
   FluidTensor<idType, 1>            mIds;
   FluidTensor<dataType, N + 1>      mData;
   FluidTensorSlice<N>               mDim;
+  index                             mSize{0};
 };
 } // namespace fluid
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithms/public/HNSW.hpp>
 #include <algorithms/public/KDTree.hpp>
 #include <algorithms/public/KMeans.hpp>
 #include <algorithms/public/SKMeans.hpp>
@@ -14,7 +15,16 @@
 #include <data/FluidIndex.hpp>
 #include <data/FluidTensor.hpp>
 #include <data/TensorTypes.hpp>
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <fstream>
+#include <numeric>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
 #include <nlohmann/json.hpp>
 
 namespace fluid {
@@ -52,7 +62,7 @@ bool check_json(const nlohmann::json &j,
 namespace impl {
 
 template <typename T, typename Validator>
-void from_json(const nlohmann::json &j, FluidTensor<T, 1>& t, Validator&& validate)
+void from_json(const nlohmann::json &j, FluidTensorView<T, 1> t, Validator&& validate)
 {
   using namespace nlohmann;
   if((t.size() > 1 && !j.is_array()) || (j.size() < asUnsigned(t.size()))) return;
@@ -60,15 +70,16 @@ void from_json(const nlohmann::json &j, FluidTensor<T, 1>& t, Validator&& valida
   std::transform(j.begin(), j.begin() + t.size(), t.begin(), [](const json& x)
   {return x.get<T>();});
 }
-} //impl
 
 template <typename T>
-void from_json(const nlohmann::json &j, FluidTensor<T, 1> &t) {
-  impl::from_json(j, t, [](const auto& x){ return x.is_number(); });
+bool is_json_value(const nlohmann::json &x) {
+  return std::is_same<T, std::string>::value ? x.is_string() : x.is_number();
 }
+} //impl
 
-void from_json(const nlohmann::json &j, FluidTensor<std::string, 1> &t) {
-  impl::from_json(j, t, [](const auto& x){ return x.is_string(); });
+template <typename T>
+void from_json(const nlohmann::json &j, FluidTensor<T, 1> &t) {
+  impl::from_json(j, FluidTensorView<T, 1>(t), impl::is_json_value<T>);
 }
 
 template <typename T>
@@ -85,12 +96,9 @@ template <typename T>
 void from_json(const nlohmann::json &j, FluidTensor<T, 2> &t) {
   if (j.size() > 0) {
     auto result = FluidTensor<T, 2>(asSigned(j.size()), asSigned(j[0].size()));
-    FluidTensor<T, 1> tmp(asSigned(j[0].size()));
-    for (size_t i = 0; i < j.size(); i++) {
-      j.at(i).get_to(tmp);
-      result.row(asSigned(i)) <<= tmp;
-    }
-    t = result;
+    for (size_t i = 0; i < j.size(); i++)
+      impl::from_json(j.at(i), result.row(asSigned(i)), impl::is_json_value<T>);
+    t = std::move(result);
   }
 }
 
@@ -133,6 +141,231 @@ void from_json(const nlohmann::json &j, FluidDataSet<std::string, T, 1> &ds) {
   }
 }
 
+namespace impl {
+
+// Writes each value as nlohmann's dump() would, without building the tree.
+// Numbers go straight to the stream through nlohmann::detail::to_chars, the
+// formatting dump() uses. That isn't public API, so it is tied to the
+// release CMakeLists.txt pins (v3.11.2) and needs rechecking on an upgrade
+static_assert(NLOHMANN_JSON_VERSION_MAJOR == 3 &&
+                  NLOHMANN_JSON_VERSION_MINOR == 11,
+              "write_json_value relies on nlohmann::detail::to_chars from "
+              "nlohmann/json v3.11.x");
+
+template <typename T>
+void write_json_value(std::ostream &os, const T &x) {
+  if constexpr (std::is_floating_point<T>::value) {
+    if (!std::isfinite(x)) {
+      os << "null";
+      return;
+    }
+    std::array<char, 64> buffer;
+    char *end = nlohmann::detail::to_chars(
+        buffer.data(), buffer.data() + buffer.size(), static_cast<double>(x));
+    os.write(buffer.data(), end - buffer.data());
+  } else if constexpr (std::is_integral<T>::value &&
+                       !std::is_same<T, bool>::value) {
+    os << x;
+  } else {
+    os << nlohmann::json(x).dump();
+  }
+}
+
+inline void write_json_break(std::ostream &os, int indent, int level) {
+  if (indent < 0) return;
+  os << '\n' << std::string(asUnsigned(indent * level), ' ');
+}
+
+// SAX handler filling a FluidDataSet straight from the token stream, one
+// row at a time, for {"cols": n, "data": {id: [values...], ...}}
+template <typename T>
+class DataSetSAX {
+public:
+  using json = nlohmann::json;
+
+  DataSetSAX(FluidDataSet<std::string, T, 1> &ds) : mDataSet(ds) {}
+
+  bool null() { return value(); }
+  bool boolean(bool) { return value(); }
+  bool number_integer(json::number_integer_t x) { return number(x); }
+  bool number_unsigned(json::number_unsigned_t x) { return number(x); }
+  bool number_float(json::number_float_t x, const std::string &) {
+    return number(x);
+  }
+  bool string(std::string &x) {
+    if (!inRow()) return value();
+    if constexpr (std::is_same<T, std::string>::value) {
+      mRow.push_back(std::move(x));
+      return true;
+    }
+    return false;
+  }
+  bool binary(json::binary_t &) { return value(); }
+
+  bool start_object(std::size_t) {
+    mDepth++;
+    if (mSkip) return true;
+    if (mDepth == 1) return true;
+    if (mDepth == 2 && mKey == "data") {
+      mSeenData = true;
+      return true;
+    }
+    return startSkipping();
+  }
+
+  bool end_object() {
+    if (mSkip && mDepth == mSkip) mSkip = 0;
+    mDepth--;
+    return true;
+  }
+
+  bool key(std::string &x) {
+    if (mSkip) return true;
+    if (mDepth == 1) mKey = x;
+    else if (mDepth == 2) mId = std::move(x);
+    return true;
+  }
+
+  bool start_array(std::size_t) {
+    mDepth++;
+    if (mSkip) return true;
+    if (mDepth == 3 && inData()) {
+      mRow.clear();
+      return true;
+    }
+    if (mDepth == 1) return false;
+    return startSkipping();
+  }
+
+  bool end_array() {
+    if (mSkip && mDepth == mSkip) mSkip = 0;
+    else if (!mSkip && mDepth == 3 && !addRow()) return false;
+    mDepth--;
+    return true;
+  }
+
+  bool parse_error(std::size_t, const std::string &,
+                   const nlohmann::detail::exception &) {
+    mParseError = true;
+    return false;
+  }
+
+  bool  parseError() const { return mParseError; }
+  index cols() const { return mCols; }
+
+  // the whole document was a DataSet of consistent shape
+  bool valid() const {
+    if (!mSeenData || mCols < 0) return false;
+    return mDataSet.size() == 0 || mDataSet.pointSize() == mCols;
+  }
+
+private:
+  bool inData() const { return mDepth >= 2 && mKey == "data"; }
+  bool inRow() const { return !mSkip && mDepth == 3 && inData(); }
+
+  // unknown members are skipped, anything unexpected inside "data" is invalid
+  bool startSkipping() {
+    if (mDepth <= 1 || inData()) return false;
+    mSkip = mDepth;
+    return true;
+  }
+
+  // scalars are only allowed as "cols", inside rows or in unknown members
+  bool value() {
+    return mSkip || (mDepth == 1 && mKey != "cols" && mKey != "data");
+  }
+
+  template <typename U>
+  bool number(U x) {
+    if (mSkip) return true;
+    if (mDepth == 1 && mKey == "cols") {
+      mCols = static_cast<index>(x);
+      return mCols >= 0;
+    }
+    if constexpr (std::is_arithmetic<T>::value) {
+      if (inRow()) {
+        mRow.push_back(static_cast<T>(x));
+        return true;
+      }
+    }
+    return value();
+  }
+
+  bool addRow() {
+    index size = asSigned(mRow.size());
+    if (mDataSet.size() == 0 && mDataSet.pointSize() != size)
+      mDataSet.resize(size);
+    if (size != mDataSet.pointSize()) return false;
+    mDataSet.add(mId, FluidTensorView<T, 1>(mRow.data(), 0, size));
+    return true;
+  }
+
+  FluidDataSet<std::string, T, 1> &mDataSet;
+  std::vector<T>                   mRow;
+  std::string                      mKey;
+  std::string                      mId;
+  index                            mDepth{0};
+  index                            mSkip{0};
+  index                            mCols{-1};
+  bool                             mSeenData{false};
+  bool                             mParseError{false};
+};
+
+} // namespace impl
+
+enum class JSONReadResult { kOK, kParseError, kInvalidFormat };
+
+// Writes the same text as to_json(ds).dump(indent), streaming one row at a
+// time instead of building the whole tree first
+template <typename T>
+void write_json(std::ostream &os, const FluidDataSet<std::string, T, 1> &ds,
+                int indent = -1) {
+  const char *separator = indent < 0 ? ":" : ": ";
+  auto        ids = ds.getIds();
+  auto        data = ds.getData();
+  // ids in the same order as nlohmann's std::map based objects
+  std::vector<index> order(asUnsigned(ds.size()));
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(),
+            [&](index a, index b) { return ids(a) < ids(b); });
+  os << '{';
+  impl::write_json_break(os, indent, 1);
+  os << "\"cols\"" << separator << ds.pointSize() << ',';
+  impl::write_json_break(os, indent, 1);
+  os << "\"data\"" << separator << '{';
+  for (size_t i = 0; i < order.size(); i++) {
+    auto row = data.row(order[i]);
+    if (i > 0) os << ',';
+    impl::write_json_break(os, indent, 2);
+    impl::write_json_value(os, ids(order[i]));
+    os << separator << '[';
+    for (index c = 0; c < row.size(); c++) {
+      if (c > 0) os << ',';
+      impl::write_json_break(os, indent, 3);
+      impl::write_json_value(os, row(c));
+    }
+    if (row.size() > 0) impl::write_json_break(os, indent, 2);
+    os << ']';
+  }
+  if (!order.empty()) impl::write_json_break(os, indent, 1);
+  os << '}';
+  impl::write_json_break(os, indent, 0);
+  os << '}';
+}
+
+// Parses a DataSet from a stream or string without building the whole tree
+template <typename Input, typename T>
+JSONReadResult read_json(Input &&in, FluidDataSet<std::string, T, 1> &ds) {
+  FluidDataSet<std::string, T, 1> result;
+  impl::DataSetSAX<T>             sax(result);
+  bool parsed = nlohmann::json::sax_parse(std::forward<Input>(in), &sax);
+  if (sax.parseError()) return JSONReadResult::kParseError;
+  if (!parsed || !sax.valid()) return JSONReadResult::kInvalidFormat;
+  if (result.size() == 0) result.resize(sax.cols());
+  ds = std::move(result);
+  return JSONReadResult::kOK;
+}
+
 namespace algorithm {
 // KDTree
 void to_json(nlohmann::json &j, const KDTree &tree) {
@@ -142,6 +375,7 @@ void to_json(nlohmann::json &j, const KDTree &tree) {
   j["cols"] = treeData.data.cols();
   j["data"] = FluidTensorView<double, 2>(treeData.data);
   j["ids"] = FluidTensorView<std::string, 1>(treeData.ids);
+  j["metric"] = static_cast<index>(treeData.metric);
 }
 
 bool check_json(const nlohmann::json &j, const KDTree &) {
@@ -160,7 +394,66 @@ void from_json(const nlohmann::json &j, KDTree &tree) {
   j.at("tree").get_to(treeData.tree);
   j.at("data").get_to(treeData.data);
   j.at("ids").get_to(treeData.ids);
-  tree.fromFlat(treeData);
+  if (j.contains("metric"))
+    treeData.metric =
+        static_cast<DistanceFuncs::Distance>(j.at("metric").get<index>());
+  if (!tree.fromFlat(std::move(treeData)))
+    throw std::invalid_argument("Inconsistent KDTree");
+}
+
+// HNSW
+void to_json(nlohmann::json &j, const HNSW &graph) {
+  HNSW::FlatData graphData = graph.toFlat();
+  j["base"] = FluidTensorView<index, 2>(graphData.base);
+  j["upper"] = FluidTensorView<index, 2>(graphData.upper);
+  j["levels"] = FluidTensorView<index, 1>(graphData.levels);
+  j["rows"] = graphData.data.rows();
+  j["cols"] = graphData.data.cols();
+  j["data"] = FluidTensorView<double, 2>(graphData.data);
+  j["ids"] = FluidTensorView<std::string, 1>(graphData.ids);
+  j["maxConnections"] = graphData.maxConnections;
+  j["constructionBeam"] = graphData.constructionBeam;
+  j["searchBeam"] = graphData.searchBeam;
+  j["entryPoint"] = graphData.entryPoint;
+  j["metric"] = static_cast<index>(graphData.metric);
+}
+
+bool check_json(const nlohmann::json &j, const HNSW &) {
+  return fluid::check_json(j,
+    {"rows", "cols", "data", "ids", "base", "upper", "levels",
+      "maxConnections", "constructionBeam", "searchBeam", "entryPoint"},
+    {JSONTypes::NUMBER, JSONTypes::NUMBER, JSONTypes::ARRAY,
+      JSONTypes::ARRAY, JSONTypes::ARRAY, JSONTypes::ARRAY, JSONTypes::ARRAY,
+      JSONTypes::NUMBER, JSONTypes::NUMBER, JSONTypes::NUMBER,
+      JSONTypes::NUMBER}
+  );
+}
+
+void from_json(const nlohmann::json &j, HNSW &graph) {
+  index rows = j.at("rows").get<index>();
+  index cols = j.at("cols").get<index>();
+  index maxConnections = j.at("maxConnections").get<index>();
+  FluidTensor<index, 1> levels(rows);
+  j.at("levels").get_to(levels);
+  if (std::any_of(levels.begin(), levels.end(),
+                  [](index level) { return level < 0; }))
+    throw std::invalid_argument("Inconsistent HNSW graph");
+  HNSW::FlatData graphData(rows, cols, maxConnections,
+                           std::accumulate(levels.begin(), levels.end(),
+                                           index(0)));
+  graphData.levels = levels;
+  j.at("base").get_to(graphData.base);
+  j.at("upper").get_to(graphData.upper);
+  j.at("data").get_to(graphData.data);
+  j.at("ids").get_to(graphData.ids);
+  graphData.constructionBeam = j.at("constructionBeam").get<index>();
+  graphData.searchBeam = j.at("searchBeam").get<index>();
+  graphData.entryPoint = j.at("entryPoint").get<index>();
+  if (j.contains("metric"))
+    graphData.metric =
+        static_cast<DistanceFuncs::Distance>(j.at("metric").get<index>());
+  if (!graph.fromFlat(std::move(graphData)))
+    throw std::invalid_argument("Inconsistent HNSW graph");
 }
 
 // KMeans
@@ -467,6 +760,21 @@ void from_json(const nlohmann::json &j, UMAP &umap) {
   RealMatrix embedding(rows, cols);
   j.at("embedding").get_to(embedding);
   KDTree tree = j.at("tree").get<algorithm::KDTree>();
+  auto& treeRows = j.at("tree").at("tree");
+  if (treeRows.size() > 0 &&
+      asSigned(treeRows[0].size()) < KDTree::FlatData(0, 0).tree.cols()) {
+    // older trees don't store fitted rows: rebuild in embedding order, which
+    // UMAP uses as point ids
+    KDTree::FlatData treeData = tree.toFlat();
+    FluidTensor<std::string, 1> ids(treeData.ids.size());
+    RealMatrix data(treeData.data.rows(), treeData.data.cols());
+    for (index i = 0; i < ids.size(); i++) {
+      index row = std::stoi(treeData.ids(i));
+      ids(row) = treeData.ids(i);
+      data.row(row) <<= treeData.data.row(i);
+    }
+    tree = KDTree(KDTree::DataSet(ids, data));
+  }
   double a = j.at("a").get<index>();
   double b = j.at("b").get<index>();
   index k = j.at("k").get<index>();
@@ -475,6 +783,25 @@ void from_json(const nlohmann::json &j, UMAP &umap) {
 
 } // namespace algorithm
 
+// Everything else goes through the tree and its from_json / to_json
+template <typename T>
+void write_json(std::ostream &os, const T &x, int indent = -1) {
+  os << nlohmann::json(x).dump(indent);
+}
+
+template <typename Input, typename T>
+JSONReadResult read_json(Input &&in, T &x) {
+  auto j = nlohmann::json::parse(std::forward<Input>(in), nullptr, false);
+  if (j.is_discarded()) return JSONReadResult::kParseError;
+  if (!check_json(j, x)) return JSONReadResult::kInvalidFormat;
+  try {
+    x = j.template get<T>();
+  } catch (const std::exception &) { // from_json found the parts inconsistent
+    return JSONReadResult::kInvalidFormat;
+  }
+  return JSONReadResult::kOK;
+}
+
 class JSONFile {
 public:
   using json = nlohmann::json;
@@ -530,6 +857,27 @@ public:
     return result;
   }
 
+  template <typename T>
+  bool write(const T &x) {
+    if (ok()) {
+      write_json(mFile, x, 2);
+      mFile << std::endl;
+      return mFile.good();
+    }
+    return false;
+  }
+
+  template <typename T>
+  bool read(T &x) {
+    if (!ok()) return false;
+    switch (read_json(mFile, x)) {
+    case JSONReadResult::kParseError: mError = "Error parsing JSON"; break;
+    case JSONReadResult::kInvalidFormat: mError = "Invalid JSON format"; break;
+    case JSONReadResult::kOK: break;
+    }
+    return ok();
+  }
+
 private:
   fstream mFile;
   json mData;
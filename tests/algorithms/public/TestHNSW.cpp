@@ -0,0 +1,182 @@
+#define CATCH_CONFIG_MAIN
+
+#include <algorithms/public/HNSW.hpp>
+#include <algorithms/public/KDTree.hpp>
+#include <catch2/catch.hpp>
+#include <DataSets.hpp>
+#include <data/FluidDataSet.hpp>
+#include <data/FluidIndex.hpp>
+#include <data/FluidTensor.hpp>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+namespace fluid {
+
+using algorithm::HNSW;
+using algorithm::KDTree;
+
+// fraction of the exact k nearest neighbours of each query that graph finds
+double recall(HNSW const& graph, HNSW::DataSet const& ds,
+              HNSW::DataSet const& queries, index k, index searchBeam = 0)
+{
+  KDTree                 tree(ds, KDTree::defaultLeafSize, graph.metric());
+  FluidTensor<index, 2>  exact(queries.size(), k);
+  FluidTensor<index, 2>  found(queries.size(), k);
+  FluidTensor<double, 2> distances(queries.size(), k);
+  tree.kNearest(queries, k, exact, distances);
+  graph.kNearest(queries, k, found, distances, 0, searchBeam);
+  index hits = 0;
+  for (index i = 0; i < queries.size(); ++i)
+    for (index j = 0; j < k; ++j)
+      hits += std::count(exact.row(i).begin(), exact.row(i).end(), found(i, j));
+  return static_cast<double>(hits) / (queries.size() * k);
+}
+
+TEST_CASE("HNSW finds nearly all of the exact nearest neighbours", "[HNSW]")
+{
+  auto ds = testdatasets::uniform(2000, 8, 42);
+  auto queries = testdatasets::uniform(200, 8, 43);
+  HNSW graph(ds);
+  CHECK(graph.size() == 2000);
+  CHECK(graph.dims() == 8);
+  CHECK(recall(graph, ds, queries, 10) > 0.95);
+
+  SECTION("and all of them with a wide enough search beam")
+  {
+    CHECK(recall(graph, ds, queries, 10, 2000) == 1.0);
+  }
+}
+
+TEST_CASE("HNSW searches with other distance metrics", "[HNSW]")
+{
+  auto ds = testdatasets::uniform(2000, 8, 44);
+  auto queries = testdatasets::uniform(100, 8, 45);
+  for (auto metric : algorithm::DistanceFuncs::searchMetrics)
+  {
+    HNSW graph(ds, HNSW::defaultMaxConnections, HNSW::defaultConstructionBeam,
+               HNSW::defaultSearchBeam, metric);
+    CHECK(graph.metric() == metric);
+    CHECK(recall(graph, ds, queries, 10) > 0.9);
+  }
+}
+
+TEST_CASE("HNSW finds each fitted point as its own nearest neighbour",
+          "[HNSW]")
+{
+  auto ds = testdatasets::uniform(500, 4, 7);
+  HNSW graph(ds);
+  for (index i = 0; i < ds.size(); i += 25)
+  {
+    auto [dists, ids] = graph.kNearest(ds.getData().row(i), 3);
+    auto [indexDists, indices] = graph.kNearestIndices(ds.getData().row(i), 3);
+    REQUIRE(ids.size() == 3);
+    CHECK(*ids[0] == ds.getIds()(i));
+    CHECK(indices[0] == i);
+    CHECK(dists[0] == 0);
+    CHECK(std::is_sorted(dists.begin(), dists.end()));
+    CHECK(std::equal(dists.begin(), dists.end(), indexDists.begin()));
+  }
+}
+
+TEST_CASE("HNSW single queries find what batch queries do", "[HNSW]")
+{
+  auto                   ds = testdatasets::uniform(2000, 6, 11);
+  auto                   queries = testdatasets::uniform(20, 6, 12);
+  HNSW                   graph(ds);
+  FluidTensor<index, 2>  batch(queries.size(), 10);
+  FluidTensor<double, 2> distances(queries.size(), 10);
+  for (index beam : {10, 400}) // the wider beam outgrows the visited set
+  {
+    graph.kNearest(queries, 10, batch, distances, 0, beam);
+    for (index i = 0; i < queries.size(); ++i)
+    {
+      auto [dists, indices] = graph.kNearestIndices(
+          queries.getData().row(i), 10, 0, FluidDefaultAllocator(), beam);
+      REQUIRE(indices.size() == 10);
+      CHECK(std::equal(indices.begin(), indices.end(), batch.row(i).begin()));
+    }
+  }
+}
+
+TEST_CASE("HNSW radius search only returns points within the radius",
+          "[HNSW]")
+{
+  auto                   ds = testdatasets::uniform(500, 3, 9);
+  HNSW                   graph(ds);
+  FluidTensor<double, 1> point{0.1, -0.2, 0.3};
+  auto [dists, ids] = graph.kNearest(point, 0, 0.4);
+  CHECK(dists.size() > 0);
+  CHECK(std::all_of(dists.begin(), dists.end(),
+                    [](double d) { return d <= 0.4; }));
+}
+
+TEST_CASE("HNSW survives a round trip through its flat representation",
+          "[HNSW]")
+{
+  auto ds = testdatasets::uniform(300, 5, 3);
+  auto queries = testdatasets::uniform(50, 5, 4);
+  HNSW graph(ds, 8, 50, 20);
+  HNSW copy;
+  REQUIRE(copy.fromFlat(graph.toFlat()));
+  CHECK(copy.initialized());
+  CHECK(copy.size() == graph.size());
+  CHECK(copy.dims() == graph.dims());
+  CHECK(copy.maxConnections() == 8);
+  CHECK(copy.searchBeam() == 20);
+  for (index i = 0; i < queries.size(); ++i)
+  {
+    auto expected = graph.kNearestIndices(queries.getData().row(i), 5);
+    auto actual = copy.kNearestIndices(queries.getData().row(i), 5);
+    CHECK(std::equal(expected.second.begin(), expected.second.end(),
+                     actual.second.begin()));
+  }
+}
+
+TEST_CASE("HNSW rejects flat data that isn't a graph over its points",
+          "[HNSW]")
+{
+  auto ds = testdatasets::uniform(300, 5, 13);
+  HNSW graph(ds, 8);
+  auto loads = [](HNSW::FlatData const& flat) {
+    HNSW copy;
+    return copy.fromFlat(flat) || copy.initialized();
+  };
+  REQUIRE(loads(graph.toFlat()));
+
+  auto flat = graph.toFlat();
+  flat.base(0, 1) = 300; // neighbour out of range
+  CHECK_FALSE(loads(flat));
+
+  flat = graph.toFlat();
+  flat.base(0, 0) = 17; // more neighbours than a row holds
+  CHECK_FALSE(loads(flat));
+
+  flat = graph.toFlat();
+  flat.entryPoint = 300;
+  CHECK_FALSE(loads(flat));
+
+  flat = graph.toFlat();
+  flat.levels(flat.entryPoint)++; // upper has a row too few
+  CHECK_FALSE(loads(flat));
+
+  flat = graph.toFlat();
+  flat.upper(0, 0) = 1;
+  flat.upper(0, 1) = std::find(flat.levels.begin(), flat.levels.end(), 0) -
+                     flat.levels.begin(); // a node that isn't on layer 1
+  CHECK_FALSE(loads(flat));
+}
+
+TEST_CASE("HNSW can be built incrementally", "[HNSW]")
+{
+  auto ds = testdatasets::uniform(1000, 4, 5);
+  auto queries = testdatasets::uniform(100, 4, 6);
+  HNSW graph;
+  for (index i = 0; i < ds.size(); ++i)
+    graph.addNode(ds.getIds()(i), ds.getData().row(i));
+  CHECK(graph.size() == 1000);
+  CHECK(recall(graph, ds, queries, 5) > 0.95);
+}
+
+} // namespace fluid
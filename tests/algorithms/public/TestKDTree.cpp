@@ -0,0 +1,306 @@
+#define CATCH_CONFIG_MAIN
+
+#include <algorithms/public/KDTree.hpp>
+#include <algorithms/util/DistanceFuncs.hpp>
+#include <catch2/catch.hpp>
+#include <DataSets.hpp>
+#include <CatchUtils.hpp>
+#include <data/FluidDataSet.hpp>
+#include <data/FluidIndex.hpp>
+#include <data/FluidTensor.hpp>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fluid {
+
+using algorithm::DistanceFuncs;
+using algorithm::KDTree;
+
+std::vector<std::pair<double, index>>
+bruteForce(KDTree::DataSet const& ds, FluidTensorView<const double, 1> point)
+{
+  std::vector<std::pair<double, index>> result;
+  auto                                  data = ds.getData();
+  for (index i = 0; i < ds.size(); ++i)
+  {
+    double sum = 0;
+    for (index j = 0; j < ds.pointSize(); ++j)
+      sum += (data(i, j) - point(j)) * (data(i, j) - point(j));
+    result.emplace_back(std::sqrt(sum), i);
+  }
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+void checkAgainstBruteForce(KDTree const& tree, KDTree::DataSet const& ds,
+                            index k, unsigned seed)
+{
+  std::mt19937                           gen(seed);
+  std::uniform_real_distribution<double> dist(-1.0, 1.0);
+  FluidTensor<double, 1>                 point(ds.pointSize());
+  for (index q = 0; q < 50; ++q)
+  {
+    std::generate(point.begin(), point.end(), [&] { return dist(gen); });
+    auto expected = bruteForce(ds, point);
+    auto [dists, ids] = tree.kNearest(point, k);
+    REQUIRE(asSigned(dists.size()) == k);
+    for (index i = 0; i < k; ++i)
+    {
+      CHECK(dists[asUnsigned(i)] ==
+            Approx(expected[asUnsigned(i)].first).margin(1e-12));
+      CHECK(*ids[asUnsigned(i)] ==
+            ds.getIds()(expected[asUnsigned(i)].second));
+    }
+  }
+}
+
+TEST_CASE("KDTree finds the same neighbours as a brute force search",
+          "[KDTree]")
+{
+  auto   ds = testdatasets::uniform(500, 4, 42);
+  KDTree tree(ds);
+  CHECK(tree.size() == 500);
+  CHECK(tree.dims() == 4);
+  checkAgainstBruteForce(tree, ds, 1, 1);
+  checkAgainstBruteForce(tree, ds, 10, 2);
+}
+
+TEST_CASE("KDTree results don't depend on leaf size", "[KDTree]")
+{
+  auto ds = testdatasets::uniform(400, 6, 11);
+  for (index leafSize : {1, 2, 8, 64, 1000})
+  {
+    KDTree tree(ds, leafSize);
+    CHECK(tree.size() == 400);
+    checkAgainstBruteForce(tree, ds, 7, 12);
+  }
+}
+
+TEST_CASE("KDTree searches with other distance metrics", "[KDTree]")
+{
+  auto                   ds = testdatasets::uniform(400, 5, 17);
+  auto                   queries = testdatasets::uniform(30, 5, 18);
+  auto                   data = ds.getData();
+  index                  k = 6;
+  FluidTensor<double, 1> point(ds.pointSize());
+  for (auto metric : DistanceFuncs::searchMetrics)
+  {
+    KDTree tree(ds, KDTree::defaultLeafSize, metric);
+    auto   distance = DistanceFuncs::map()[metric];
+    for (index q = 0; q < queries.size(); ++q)
+    {
+      point <<= queries.getData().row(q);
+      Eigen::Map<Eigen::ArrayXd>            p(point.data(), point.size());
+      std::vector<std::pair<double, index>> expected;
+      for (index i = 0; i < ds.size(); ++i)
+        expected.emplace_back(
+            distance(Eigen::Map<const Eigen::ArrayXd>(data.row(i).data(),
+                                                      ds.pointSize()),
+                     p),
+            i);
+      std::sort(expected.begin(), expected.end());
+      auto [dists, indices] = tree.kNearestIndices(point, k);
+      REQUIRE(asSigned(indices.size()) == k);
+      for (index i = 0; i < k; ++i)
+      {
+        CHECK(dists[asUnsigned(i)] ==
+              Approx(expected[asUnsigned(i)].first).margin(1e-9));
+        CHECK(indices[asUnsigned(i)] == expected[asUnsigned(i)].second);
+      }
+    }
+  }
+}
+
+TEST_CASE("KDTree reports neighbours as rows of the fitted DataSet",
+          "[KDTree]")
+{
+  auto   ds = testdatasets::uniform(300, 4, 31);
+  KDTree tree(ds);
+  auto   point = ds.getData().row(123);
+  auto [dists, ids] = tree.kNearest(point, 4);
+  auto [indexDists, indices] = tree.kNearestIndices(point, 4);
+  REQUIRE(indices.size() == 4);
+  CHECK(indices[0] == 123);
+  for (size_t i = 0; i < 4; ++i)
+  {
+    CHECK(indexDists[i] == dists[i]);
+    CHECK(ds.getIds()(indices[i]) == *ids[i]);
+  }
+
+  FluidTensor<std::string, 1> fittedIds(ds.size());
+  tree.getIds(fittedIds);
+  REQUIRE_THAT(fittedIds, EqualsRange(ds.getIds()));
+
+  SECTION("other DataSets can be aligned to the fitted order")
+  {
+    FluidTensor<std::string, 1> reversedIds(ds.size());
+    FluidTensor<double, 2>      values(ds.size(), 1);
+    for (index i = 0; i < ds.size(); ++i)
+    {
+      reversedIds(i) = ds.getIds()(ds.size() - 1 - i);
+      values(i, 0) = static_cast<double>(ds.size() - 1 - i);
+    }
+    KDTree::DataSet aligned;
+    CHECK(tree.alignToFitted(KDTree::DataSet(reversedIds, values), aligned));
+    for (index i = 0; i < ds.size(); ++i)
+      CHECK(aligned.getData()(i, 0) == static_cast<double>(i));
+    CHECK_FALSE(tree.alignToFitted(KDTree::DataSet(1), aligned));
+  }
+}
+
+TEST_CASE("KDTree batch queries match single queries", "[KDTree]")
+{
+  auto                   ds = testdatasets::uniform(1000, 3, 21);
+  auto                   queries = testdatasets::uniform(300, 3, 22);
+  KDTree                 tree(ds);
+  index                  k = 5;
+  FluidTensor<index, 2>  indices(queries.size(), k);
+  FluidTensor<double, 2> distances(queries.size(), k);
+
+  for (index threads : {1, 4})
+  {
+    indices.fill(-2);
+    tree.kNearest(queries, k, indices, distances, threads);
+    for (index i = 0; i < queries.size(); ++i)
+    {
+      auto [dists, ids] = tree.kNearest(queries.getData().row(i), k);
+      for (index j = 0; j < k; ++j)
+      {
+        CHECK(distances(i, j) == dists[asUnsigned(j)]);
+        CHECK(ds.getIds()(indices(i, j)) == *ids[asUnsigned(j)]);
+      }
+    }
+  }
+
+  SECTION("asking for more neighbours than points pads the results")
+  {
+    FluidTensor<index, 2>  few(2, 1200);
+    FluidTensor<double, 2> farAway(2, 1200);
+    tree.kNearest(queries.getData()(Slice(0, 2), Slice(0)), 1200, few, farAway);
+    CHECK(few(1, 999) >= 0);
+    CHECK(few(1, 1000) == -1);
+    CHECK(std::isinf(farAway(1, 1000)));
+  }
+}
+
+TEST_CASE("KDTree radius search returns everything within the radius",
+          "[KDTree]")
+{
+  auto                   ds = testdatasets::uniform(300, 3, 7);
+  KDTree                 tree(ds);
+  FluidTensor<double, 1> point{0.1, -0.2, 0.3};
+  auto                   expected = bruteForce(ds, point);
+  index                  inside = std::count_if(
+      expected.begin(), expected.end(),
+      [](auto const& x) { return x.first < 0.5; });
+  auto [dists, ids] = tree.kNearest(point, 0, 0.5);
+  CHECK(asSigned(dists.size()) == inside);
+  CHECK(std::is_sorted(dists.begin(), dists.end()));
+}
+
+TEST_CASE("KDTree survives a round trip through its flat representation",
+          "[KDTree]")
+{
+  auto   ds = testdatasets::uniform(200, 5, 3);
+  KDTree tree(ds);
+  KDTree copy;
+  REQUIRE(copy.fromFlat(tree.toFlat()));
+  CHECK(copy.initialized());
+  CHECK(copy.size() == tree.size());
+  CHECK(copy.dims() == tree.dims());
+  checkAgainstBruteForce(copy, ds, 5, 4);
+}
+
+TEST_CASE("KDTree rejects flat data that isn't a tree over its points",
+          "[KDTree]")
+{
+  auto   ds = testdatasets::uniform(50, 3, 8);
+  KDTree tree(ds);
+  auto   corrupt = [&](index row, index col, index value) {
+    auto flat = tree.toFlat();
+    flat.tree(row, col) = value;
+    KDTree copy;
+    return copy.fromFlat(flat) || copy.initialized();
+  };
+  CHECK_FALSE(corrupt(0, 0, 50));  // child out of range
+  CHECK_FALSE(corrupt(10, 1, 3));  // child before its parent
+  CHECK_FALSE(corrupt(0, 2, 3));   // split past the last dimension
+  CHECK_FALSE(corrupt(49, 3, 2));  // bucket past the last point
+  CHECK_FALSE(corrupt(0, 4, -1));  // fitted row out of range
+
+  auto flat = tree.toFlat();
+  flat.ids = FluidTensor<std::string, 1>(49);
+  CHECK_FALSE(KDTree().fromFlat(flat));
+}
+
+TEST_CASE("KDTree reads two-column trees from older files", "[KDTree]")
+{
+  KDTree::FlatData flat(0, 0);
+  flat.tree = FluidTensor<index, 2>{{1, 2}, {-1, -1}, {-1, -1}};
+  flat.ids = FluidTensor<std::string, 1>{"b", "a", "c"};
+  flat.data = FluidTensor<double, 2>{{1.0}, {0.0}, {2.0}};
+  KDTree tree;
+  REQUIRE(tree.fromFlat(flat));
+  FluidTensor<double, 1> point{1.8};
+  auto [dists, ids] = tree.kNearest(point, 2);
+  REQUIRE(ids.size() == 2);
+  CHECK(*ids[0] == "c");
+  CHECK(*ids[1] == "b");
+  CHECK(tree.toFlat().tree.cols() == 5);
+
+  FluidTensor<index, 2>  indices(1, 2);
+  FluidTensor<double, 2> distances(1, 2);
+  tree.kNearest(FluidTensor<double, 2>{{1.8}}, 2, indices, distances);
+  CHECK(indices(0, 0) == 2);
+  CHECK(indices(0, 1) == 0);
+}
+
+TEST_CASE("KDTree can be built incrementally", "[KDTree]")
+{
+  auto   ds = testdatasets::uniform(200, 2, 5);
+  KDTree tree;
+  for (index i = 0; i < ds.size(); ++i)
+    tree.addNode(ds.getIds()(i), ds.getData().row(i));
+  CHECK(tree.size() == 200);
+  checkAgainstBruteForce(tree, ds, 3, 6);
+
+  SECTION("on top of a fitted tree")
+  {
+    auto   firstHalf = KDTree::DataSet(ds.getIds()(Slice(0, 100)),
+                                       ds.getData()(Slice(0, 100), Slice(0)));
+    KDTree fitted(firstHalf);
+    for (index i = 100; i < ds.size(); ++i)
+      fitted.addNode(ds.getIds()(i), ds.getData().row(i));
+    CHECK(fitted.size() == 200);
+    checkAgainstBruteForce(fitted, ds, 3, 7);
+  }
+
+  SECTION("with the cosine metric and points off the unit sphere")
+  {
+    auto   firstHalf = KDTree::DataSet(ds.getIds()(Slice(0, 100)),
+                                       ds.getData()(Slice(0, 100), Slice(0)));
+    KDTree fitted(firstHalf, KDTree::defaultLeafSize,
+                  DistanceFuncs::Distance::kCosine);
+    FluidTensor<double, 1> point(ds.pointSize());
+    for (index i = 100; i < ds.size(); ++i)
+    {
+      point <<= ds.getData().row(i);
+      point.apply([scale = 1.0 + i % 7 * 3](double& x) { x *= scale; });
+      fitted.addNode(ds.getIds()(i), point);
+    }
+    CHECK(fitted.size() == 200);
+    for (index i = 0; i < ds.size(); ++i)
+    {
+      auto [dists, ids] = fitted.kNearest(ds.getData().row(i), 1);
+      REQUIRE(dists.size() == 1);
+      CHECK(dists[0] == Approx(0).margin(1e-9));
+      CHECK(*ids[0] == ds.getIds()(i));
+    }
+  }
+}
+
+} // namespace fluid
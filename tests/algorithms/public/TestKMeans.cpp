@@ -0,0 +1,191 @@
+#define CATCH_CONFIG_MAIN
+
+#include <algorithms/public/KMeans.hpp>
+#include <algorithms/public/SKMeans.hpp>
+#include <catch2/catch.hpp>
+#include <data/FluidDataSet.hpp>
+#include <data/FluidIndex.hpp>
+#include <data/FluidTensor.hpp>
+#include <cmath>
+#include <random>
+#include <string>
+
+namespace fluid {
+
+using algorithm::KMeans;
+using algorithm::SKMeans;
+using DataSet = FluidDataSet<std::string, double, 1>;
+
+// tight blobs around the corners of a hypercube, point i in blob i % nBlobs
+DataSet makeBlobs(index rows, index cols, index nBlobs, unsigned seed,
+                  double spread = 0.05)
+{
+  std::mt19937                     gen(seed);
+  std::normal_distribution<double> noise(0.0, spread);
+  FluidTensor<std::string, 1>      ids(rows);
+  FluidTensor<double, 2>           data(rows, cols);
+  for (index i = 0; i < rows; ++i)
+  {
+    ids(i) = std::to_string(i);
+    for (index j = 0; j < cols; ++j)
+      data(i, j) = ((i % nBlobs) >> j & 1) + noise(gen);
+  }
+  return DataSet(ids, data);
+}
+
+double sqDistance(FluidTensorView<const double, 1> x,
+                  FluidTensorView<const double, 1> y)
+{
+  double result = 0;
+  for (index i = 0; i < x.size(); ++i) result += (x(i) - y(i)) * (x(i) - y(i));
+  return result;
+}
+
+// a converged Lloyd solution: every point is nearest its own mean, and every
+// mean is the centroid of its points (empty clusters keep theirs)
+void checkConverged(KMeans const& kmeans, DataSet const& dataSet)
+{
+  index                  n = dataSet.size(), k = kmeans.getK();
+  FluidTensor<double, 2> means(k, dataSet.dims());
+  FluidTensor<double, 2> centroids(k, dataSet.dims());
+  FluidTensor<index, 1>  assignments(n);
+  FluidTensor<index, 1>  counts(k);
+  kmeans.getMeans(means);
+  kmeans.getAssignments(assignments);
+  centroids.fill(0);
+  counts.fill(0);
+  auto data = dataSet.getData();
+  for (index i = 0; i < n; ++i)
+  {
+    double own = sqDistance(data.row(i), means.row(assignments(i)));
+    for (index j = 0; j < k; ++j)
+      CHECK(own <= sqDistance(data.row(i), means.row(j)) + 1e-9);
+    for (index j = 0; j < dataSet.dims(); ++j)
+      centroids(assignments(i), j) += data(i, j);
+    counts(assignments(i))++;
+  }
+  for (index i = 0; i < k; ++i)
+  {
+    if (counts(i) == 0) continue;
+    for (index j = 0; j < dataSet.dims(); ++j)
+      CHECK(means(i, j) == Approx(centroids(i, j) / counts(i)).margin(1e-9));
+  }
+}
+
+TEST_CASE("KMeans converges to a Lloyd fixed point", "[KMeans]")
+{
+  auto   dataSet = makeBlobs(5000, 5, 32, 7);
+  KMeans kmeans;
+  kmeans.train(dataSet, 24, 200, 0, 4);
+  checkConverged(kmeans, dataSet);
+
+  SECTION("and carries on from its means when trained again")
+  {
+    auto more = makeBlobs(3000, 5, 32, 8);
+    kmeans.train(more, 24, 200, 0, 2);
+    CHECK(kmeans.nAssigned() == 3000);
+    checkConverged(kmeans, more);
+  }
+}
+
+TEST_CASE("KMeans++ seeding finds well separated blobs", "[KMeans]")
+{
+  // every blob should end up with its own mean, which random seeding misses;
+  // tight blobs make two seeds in one blob vanishingly unlikely
+  index  nBlobs = 8;
+  auto   dataSet = makeBlobs(4000, 3, nBlobs, 11, 0.001);
+  KMeans kmeans;
+  kmeans.train(dataSet, nBlobs, 100);
+  FluidTensor<index, 1> assignments(dataSet.size());
+  kmeans.getAssignments(assignments);
+  for (index i = 0; i < dataSet.size(); ++i)
+    CHECK(assignments(i) == assignments(i % nBlobs));
+  for (index i = 0; i < nBlobs; ++i)
+    CHECK(kmeans.getClusterSize(i) == dataSet.size() / nBlobs);
+}
+
+TEST_CASE("Mini-batch KMeans finds the blob centres", "[KMeans]")
+{
+  index  nBlobs = 4;
+  auto   dataSet = makeBlobs(20000, 2, nBlobs, 3);
+  KMeans kmeans;
+  kmeans.train(dataSet, nBlobs, 50, 256, 2);
+  REQUIRE(kmeans.nAssigned() == dataSet.size());
+
+  FluidTensor<double, 2> means(nBlobs, 2);
+  FluidTensor<index, 1>  assignments(dataSet.size());
+  kmeans.getMeans(means);
+  kmeans.getAssignments(assignments);
+  for (index i = 0; i < nBlobs; ++i)
+  {
+    auto mean = means.row(assignments(i));
+    CHECK(mean(0) == Approx(i & 1).margin(0.05));
+    CHECK(mean(1) == Approx(i >> 1 & 1).margin(0.05));
+  }
+
+  SECTION("and refines a trained model rather than restarting it")
+  {
+    FluidTensor<double, 2> before(means);
+    kmeans.train(dataSet, nBlobs, 1, 8, 1);
+    kmeans.getMeans(means);
+    // one small batch against the weight of every point already assigned
+    for (index i = 0; i < nBlobs; ++i)
+      for (index j = 0; j < 2; ++j)
+        CHECK(means(i, j) == Approx(before(i, j)).margin(1e-3));
+  }
+}
+
+TEST_CASE("KMeans vq finds the nearest mean", "[KMeans]")
+{
+  auto   dataSet = makeBlobs(2000, 4, 16, 5, 0.3);
+  KMeans kmeans;
+  kmeans.train(dataSet, 12, 10);
+  FluidTensor<double, 2> means(12, 4);
+  kmeans.getMeans(means);
+  auto data = dataSet.getData();
+  for (index i = 0; i < dataSet.size(); ++i)
+  {
+    index nearest = kmeans.vq(data.row(i), FluidDefaultAllocator());
+    for (index j = 0; j < 12; ++j)
+      CHECK(sqDistance(data.row(i), means.row(nearest)) <=
+            sqDistance(data.row(i), means.row(j)) + 1e-9);
+  }
+
+  SECTION("including strided points and loaded means")
+  {
+    KMeans                 loaded;
+    FluidTensor<double, 2> columns(4, 100);
+    loaded.setMeans(means);
+    columns <<= data(Slice(0, 100), Slice(0)).transpose();
+    for (index i = 0; i < 100; ++i)
+      CHECK(loaded.vq(columns.col(i)) == kmeans.vq(data.row(i)));
+  }
+}
+
+TEST_CASE("SKMeans encodes frames as the batch does", "[SKMeans]")
+{
+  auto    dataSet = makeBlobs(1000, 6, 8, 9, 0.2);
+  SKMeans skmeans;
+  skmeans.train(dataSet, 8, 50);
+  index                  n = dataSet.size(), k = skmeans.getK();
+  auto                   data = dataSet.getData();
+  FluidTensor<double, 2> batch(n, k);
+  FluidTensor<double, 2> frames(n, k);
+  FluidTensor<double, 2> means(k, dataSet.dims());
+  skmeans.encode(data, batch, 0.25);
+  skmeans.getMeans(means);
+  for (index i = 0; i < n; ++i)
+  {
+    skmeans.encode(data.row(i), frames.row(i), 0.25, FluidDefaultAllocator());
+    for (index j = 0; j < k; ++j)
+    {
+      double dot = 0;
+      for (index d = 0; d < dataSet.dims(); ++d)
+        dot += data(i, d) * means(j, d);
+      CHECK(batch(i, j) == Approx(std::max(dot - 0.25, 0.0)).margin(1e-9));
+      CHECK(frames(i, j) == Approx(batch(i, j)).margin(1e-12));
+    }
+  }
+}
+
+} // namespace fluid
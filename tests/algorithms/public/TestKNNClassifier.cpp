@@ -0,0 +1,120 @@
+#define CATCH_CONFIG_MAIN
+
+#include <algorithms/public/HNSW.hpp>
+#include <algorithms/public/KDTree.hpp>
+#include <algorithms/public/KNNClassifier.hpp>
+#include <algorithms/public/LabelSetEncoder.hpp>
+#include <catch2/catch.hpp>
+#include <data/FluidDataSet.hpp>
+#include <data/FluidIndex.hpp>
+#include <data/FluidTensor.hpp>
+#include <random>
+#include <string>
+
+namespace fluid {
+
+using algorithm::HNSW;
+using algorithm::KDTree;
+using algorithm::KNNClassifier;
+using algorithm::LabelSetEncoder;
+using DataSet = FluidDataSet<std::string, double, 1>;
+using LabelSet = FluidDataSet<std::string, std::string, 1>;
+
+// labels in the order index was fitted on, and their class indices
+template <typename Index>
+std::pair<LabelSet, FluidTensor<index, 1>>
+fittedClasses(Index const& tree, LabelSet const& labels,
+              LabelSetEncoder& encoder)
+{
+  LabelSet aligned(1);
+  REQUIRE(tree.alignToFitted(labels, aligned));
+  encoder.fit(aligned);
+  FluidTensor<index, 1> classes(aligned.size());
+  for (int i = 0; i < aligned.size(); ++i)
+    classes(i) = encoder.encodeIndex(aligned.getData()(i, 0));
+  return {aligned, classes};
+}
+
+template <typename Index>
+void checkAgreement(Index const& tree, LabelSet const& labels, index dims)
+{
+  LabelSetEncoder encoder;
+  auto [aligned, classes] = fittedClasses(tree, labels, encoder);
+  KNNClassifier                          classifier;
+  std::mt19937                           gen(7);
+  std::uniform_real_distribution<double> dist(-2.0, 2.0);
+  RealVector                             point(dims);
+  for (int i = 0; i < 200; ++i)
+  {
+    for (auto& x : point) x = dist(gen);
+    for (bool weighted : {false, true})
+    {
+      std::string const& label =
+          classifier.predict(tree, point, aligned, 7, weighted);
+      index prediction = classifier.predictIndex(
+          tree, point, classes, encoder.numLabels(), 7, weighted);
+      CHECK(encoder.decodeIndex(prediction) == label);
+    }
+  }
+
+  FluidTensor<double, 2> points(1000, dims);
+  for (auto& x : points) x = dist(gen);
+  for (bool weighted : {false, true})
+  {
+    FluidTensor<index, 1> batch(points.rows());
+    classifier.predictIndex(tree, points, classes, encoder.numLabels(), 7,
+                            weighted, batch, 3);
+    for (int i = 0; i < points.rows(); ++i)
+      CHECK(batch(i) == classifier.predictIndex(tree, points.row(i), classes,
+                                                encoder.numLabels(), 7,
+                                                weighted));
+  }
+}
+
+TEST_CASE("Class index prediction agrees with label prediction",
+          "[KNNClassifier]")
+{
+  index                                  rows = 500, dims = 3;
+  std::mt19937                           gen(42);
+  std::uniform_real_distribution<double> dist(-1.0, 1.0);
+  FluidTensor<std::string, 1>            ids(rows);
+  FluidTensor<double, 2>                 data(rows, dims);
+  FluidTensor<std::string, 2>            names(rows, 1);
+  for (int i = 0; i < rows; ++i)
+  {
+    ids(i) = std::to_string(i);
+    for (int j = 0; j < dims; ++j) data(i, j) = dist(gen);
+    // a noisy boundary, so that neighbourhoods are often mixed
+    int octant = (data(i, 0) > 0) + 2 * (data(i, 1) + 0.2 * dist(gen) > 0);
+    names(i, 0) = "class" + std::to_string(octant);
+  }
+  DataSet  ds(ids, data);
+  LabelSet labels(ids, names);
+
+  checkAgreement(KDTree(ds), labels, dims);
+  checkAgreement(HNSW(ds), labels, dims);
+}
+
+TEST_CASE("Neighbours that share a label pool their votes", "[KNNClassifier]")
+{
+  FluidTensor<std::string, 1> ids{"a1", "b", "a2"};
+  FluidTensor<double, 2>      data{{0.0}, {0.04}, {0.1}};
+  FluidTensor<std::string, 2> names{{"A"}, {"B"}, {"A"}};
+  KDTree                      tree(DataSet(ids, data));
+  LabelSetEncoder             encoder;
+  auto [aligned, classes] =
+      fittedClasses(tree, LabelSet(ids, names), encoder);
+
+  KNNClassifier          classifier;
+  FluidTensor<double, 1> point{0.03};
+  CHECK(classifier.predict(tree, point, aligned, 3, false) == "A");
+  CHECK(encoder.decodeIndex(classifier.predictIndex(
+            tree, point, classes, encoder.numLabels(), 3, false)) == "A");
+  // ...unless an exact match takes all the weight
+  point(0) = 0.04;
+  CHECK(classifier.predict(tree, point, aligned, 3, true) == "B");
+  CHECK(encoder.decodeIndex(classifier.predictIndex(
+            tree, point, classes, encoder.numLabels(), 3, true)) == "B");
+}
+
+} // namespace fluid
@@ -0,0 +1,73 @@
+#define CATCH_CONFIG_MAIN
+
+#include <algorithms/public/HNSW.hpp>
+#include <algorithms/public/KDTree.hpp>
+#include <algorithms/public/KNNRegressor.hpp>
+#include <catch2/catch.hpp>
+#include <DataSets.hpp>
+#include <data/FluidDataSet.hpp>
+#include <data/FluidIndex.hpp>
+#include <data/FluidTensor.hpp>
+#include <string>
+
+namespace fluid {
+
+using algorithm::HNSW;
+using algorithm::KDTree;
+using algorithm::KNNRegressor;
+using DataSet = FluidDataSet<std::string, double, 1>;
+
+template <typename Index>
+void checkBatch(Index const& tree, DataSet const& targets,
+                FluidTensorView<const double, 2> queries)
+{
+  DataSet aligned(targets.dims());
+  REQUIRE(tree.alignToFitted(targets, aligned));
+  KNNRegressor regressor;
+  for (bool weighted : {false, true})
+  {
+    FluidTensor<double, 2> batch(queries.rows(), targets.dims());
+    FluidTensor<double, 1> single(targets.dims());
+    regressor.predict(tree, aligned, queries, batch, 5, weighted, 3);
+    for (int i = 0; i < queries.rows(); ++i)
+    {
+      FluidTensor<double, 1> query(queries.row(i));
+      regressor.predict(tree, aligned, query, single, 5, weighted);
+      for (int j = 0; j < targets.dims(); ++j)
+        CHECK(batch(i, j) == Approx(single(j)).margin(1e-12));
+    }
+  }
+}
+
+TEST_CASE("Batch regression matches point by point prediction",
+          "[KNNRegressor]")
+{
+  auto ds = testdatasets::uniform(800, 4, 1);
+  auto targets = testdatasets::uniform(800, 2, 2);
+  auto queries = testdatasets::uniform(600, 4, 3);
+  checkBatch(KDTree(ds), targets, queries.getData());
+  checkBatch(HNSW(ds), targets, queries.getData());
+}
+
+TEST_CASE("Regression averages the targets of the nearest points",
+          "[KNNRegressor]")
+{
+  FluidTensor<std::string, 1> ids{"a", "b", "c"};
+  FluidTensor<double, 2>      data{{0.0}, {1.0}, {3.0}};
+  FluidTensor<double, 2>      values{{10.0}, {20.0}, {40.0}};
+  KDTree                      tree(DataSet(ids, data));
+  DataSet                     targets(1);
+  REQUIRE(tree.alignToFitted(DataSet(ids, values), targets));
+
+  KNNRegressor           regressor;
+  FluidTensor<double, 2> queries{{0.5}, {1.0}};
+  FluidTensor<double, 2> predictions(2, 1);
+  regressor.predict(tree, targets, queries, predictions, 2, false);
+  CHECK(predictions(0, 0) == Approx(15.0));
+  CHECK(predictions(1, 0) == Approx(15.0));
+  regressor.predict(tree, targets, queries, predictions, 2, true);
+  CHECK(predictions(0, 0) == Approx(15.0));
+  CHECK(predictions(1, 0) == Approx(20.0)); // exact match
+}
+
+} // namespace fluid
@@ -0,0 +1,113 @@
+#define CATCH_CONFIG_MAIN
+
+#include <algorithms/public/STFT.hpp>
+#include <catch2/catch.hpp>
+#include <data/FluidIndex.hpp>
+#include <data/FluidTensor.hpp>
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <random>
+
+namespace fluid {
+
+using algorithm::ISTFT;
+using algorithm::STFT;
+
+FluidTensor<double, 1> makeSignal(index size)
+{
+  std::mt19937                           gen(3);
+  std::uniform_real_distribution<double> noise(-0.1, 0.1);
+  FluidTensor<double, 1>                 signal(size);
+  for (index i = 0; i < size; ++i)
+    signal(i) = std::sin(0.05 * i) + noise(gen);
+  return signal;
+}
+
+TEST_CASE("Threaded STFT matches the single threaded one", "[STFT]")
+{
+  index winSize = 1024, fftSize = 2048, hopSize = 256, size = 44100;
+  auto  signal = makeSignal(size);
+  STFT  stft(winSize, fftSize, hopSize);
+  index nFrames = size / hopSize + 1, nBins = fftSize / 2 + 1;
+
+  FluidTensor<std::complex<double>, 2> serial(nFrames, nBins);
+  FluidTensor<std::complex<double>, 2> parallel(nFrames, nBins);
+  stft.process(signal, serial);
+  stft.process(signal, parallel, 4);
+  CHECK(std::equal(serial.begin(), serial.end(), parallel.begin()));
+
+  SECTION("and frames are centred on multiples of the hop")
+  {
+    FluidTensor<double, 1>               frame(winSize);
+    FluidTensor<std::complex<double>, 1> spectrum(nBins);
+    for (index i : {index(8), index(100), nFrames - 10})
+    {
+      frame <<= signal(Slice(i * hopSize - winSize / 2, winSize));
+      stft.processFrame(frame, spectrum);
+      for (index j = 0; j < nBins; ++j)
+        CHECK(std::abs(spectrum(j) - serial(i, j)) < 1e-9);
+    }
+  }
+
+  SECTION("and the threaded ISTFT reconstructs the input")
+  {
+    ISTFT                  istft(winSize, fftSize, hopSize);
+    FluidTensor<double, 1> single(size);
+    FluidTensor<double, 1> threaded(size);
+    istft.process(serial, single);
+    istft.process(parallel, threaded, 4);
+    for (index i = 0; i < size; ++i)
+    {
+      CHECK(threaded(i) == Approx(single(i)).margin(1e-12));
+      CHECK(single(i) == Approx(signal(i)).margin(1e-9));
+    }
+  }
+}
+
+TEST_CASE("STFT writes into strided spectrogram views", "[STFT]")
+{
+  index winSize = 512, hopSize = 128, size = 8000;
+  auto  signal = makeSignal(size);
+  STFT  stft(winSize, winSize, hopSize);
+  index nFrames = size / hopSize + 1, nBins = winSize / 2 + 1;
+
+  FluidTensor<std::complex<double>, 2> rows(nFrames, nBins);
+  FluidTensor<std::complex<double>, 2> cols(nBins, nFrames);
+  stft.process(signal, rows);
+  stft.process(signal, cols.transpose(), 3);
+  CHECK(std::equal(rows.begin(), rows.end(), cols.transpose().begin()));
+
+  ISTFT                  istft(winSize, winSize, hopSize);
+  FluidTensor<double, 1> resynth(size);
+  istft.process(cols.transpose(), resynth, 3);
+  for (index i = 0; i < size; ++i)
+    CHECK(resynth(i) == Approx(signal(i)).margin(1e-9));
+}
+
+TEST_CASE("Uncentred frames start at multiples of the hop", "[STFT]")
+{
+  index winSize = 256, hopSize = 64, nFrames = 40;
+  index size = (nFrames - 1) * hopSize + winSize;
+  auto  signal = makeSignal(size);
+  STFT  stft(winSize, winSize, hopSize);
+  FluidTensor<std::complex<double>, 2> spectrogram(nFrames, winSize / 2 + 1);
+  stft.processFrames(signal, spectrogram, 2);
+
+  FluidTensor<std::complex<double>, 1> spectrum(winSize / 2 + 1);
+  for (index i = 0; i < nFrames; ++i)
+  {
+    stft.processFrame(signal(Slice(i * hopSize, winSize)), spectrum);
+    CHECK(std::equal(spectrum.begin(), spectrum.end(),
+                     spectrogram.row(i).begin()));
+  }
+
+  ISTFT                  istft(winSize, winSize, hopSize);
+  FluidTensor<double, 1> resynth(size);
+  istft.processFrames(spectrogram, resynth, 2);
+  // the first and last samples only fall on the window's zero
+  for (index i = 1; i < size - 1; ++i)
+    CHECK(resynth(i) == Approx(signal(i)).margin(1e-9));
+}
+
+} // namespace fluid
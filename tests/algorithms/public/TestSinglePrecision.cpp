@@ -0,0 +1,180 @@
+#define CATCH_CONFIG_MAIN
+
+#include <algorithms/public/DCT.hpp>
+#include <algorithms/public/MelBands.hpp>
+#include <algorithms/public/STFT.hpp>
+#include <algorithms/public/SpectralShape.hpp>
+#include <catch2/catch.hpp>
+#include <clients/common/MemoryBufferAdaptor.hpp>
+#include <clients/rt/MFCCClient.hpp>
+#include <clients/rt/SpectralShapeClient.hpp>
+#include <data/FluidIndex.hpp>
+#include <data/FluidMemory.hpp>
+#include <data/FluidTensor.hpp>
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <memory>
+#include <random>
+
+namespace fluid {
+
+using namespace algorithm;
+
+template <typename T>
+FluidTensor<T, 1> makeSignal(index size)
+{
+  std::mt19937                           gen(17);
+  std::uniform_real_distribution<double> noise(-0.05, 0.05);
+  FluidTensor<T, 1>                      signal(size);
+  for (index i = 0; i < size; ++i)
+    signal(i) = static_cast<T>(0.5 * std::sin(0.07 * i) +
+                               0.25 * std::sin(0.31 * i) + noise(gen));
+  return signal;
+}
+
+template <typename T>
+FluidTensor<T, 1> magnitudes(index winSize, index fftSize)
+{
+  BasicSTFT<T>                    stft(winSize, fftSize, winSize / 2);
+  auto                            signal = makeSignal<T>(winSize);
+  FluidTensor<std::complex<T>, 1> spectrum(fftSize / 2 + 1);
+  FluidTensor<T, 1>               mags(fftSize / 2 + 1);
+  stft.processFrame(signal, spectrum);
+  BasicSTFT<T>::magnitude(spectrum, mags);
+  return mags;
+}
+
+template <typename T, typename U>
+double maxDifference(FluidTensorView<T, 1> x, FluidTensorView<U, 1> y)
+{
+  double result = 0;
+  for (index i = 0; i < x.size(); ++i)
+    result = std::max(result, std::abs(double(x(i)) - double(y(i))));
+  return result;
+}
+
+TEST_CASE("Float STFT matches the double STFT", "[SinglePrecision]")
+{
+  auto   single = magnitudes<float>(1024, 1024);
+  auto   reference = magnitudes<double>(1024, 1024);
+  double peak = *std::max_element(reference.begin(), reference.end());
+  CHECK(maxDifference<float, double>(single, reference) < 1e-4 * peak);
+
+  SECTION("and the float ISTFT reconstructs its input")
+  {
+    index                               winSize = 512;
+    BasicSTFT<float>                    stft(winSize, winSize, winSize / 4);
+    BasicISTFT<float>                   istft(winSize, winSize, winSize / 4);
+    auto                                signal = makeSignal<float>(8192);
+    FluidTensor<std::complex<float>, 2> spectrogram(
+        8192 / (winSize / 4) + 1, winSize / 2 + 1);
+    FluidTensor<float, 1>               resynthesised(8192);
+    stft.process(signal, spectrogram);
+    istft.process(spectrogram, resynthesised);
+    CHECK(maxDifference<float, float>(signal(Slice(winSize, 4096)),
+                                      resynthesised(Slice(winSize, 4096))) <
+          1e-4);
+  }
+}
+
+TEST_CASE("Float mel bands and DCT match double precision",
+          "[SinglePrecision]")
+{
+  index fftSize = 1024, nBins = fftSize / 2 + 1, nBands = 40, nCoefs = 13;
+  auto  singleMags = magnitudes<float>(fftSize, fftSize);
+  auto  referenceMags = magnitudes<double>(fftSize, fftSize);
+
+  BasicMelBands<float>  singleBands(nBands, fftSize);
+  BasicMelBands<double> referenceBands(nBands, fftSize);
+  singleBands.init(20, 20000, nBands, nBins, 44100, fftSize);
+  referenceBands.init(20, 20000, nBands, nBins, 44100, fftSize);
+  FluidTensor<float, 1>  singleMel(nBands);
+  FluidTensor<double, 1> referenceMel(nBands);
+  singleBands.processFrame(singleMags, singleMel, false, false, true,
+                           FluidDefaultAllocator());
+  referenceBands.processFrame(referenceMags, referenceMel, false, false, true,
+                              FluidDefaultAllocator());
+  // log bands, so this is in dB
+  CHECK(maxDifference<float, double>(singleMel, referenceMel) < 1e-3);
+
+  BasicDCT<float>  singleDCT(nBands, nCoefs);
+  BasicDCT<double> referenceDCT(nBands, nCoefs);
+  singleDCT.init(nBands, nCoefs);
+  referenceDCT.init(nBands, nCoefs);
+  FluidTensor<float, 1>  singleCoefs(nCoefs);
+  FluidTensor<double, 1> referenceCoefs(nCoefs);
+  singleDCT.processFrame(singleMel, singleCoefs);
+  referenceDCT.processFrame(referenceMel, referenceCoefs);
+  CHECK(maxDifference<float, double>(singleCoefs, referenceCoefs) < 1e-2);
+}
+
+TEST_CASE("Float spectral shape matches double precision", "[SinglePrecision]")
+{
+  auto singleMags = magnitudes<float>(1024, 1024);
+  auto referenceMags = magnitudes<double>(1024, 1024);
+
+  for (bool logFreq : {false, true})
+  {
+    BasicSpectralShape<float>  single(FluidDefaultAllocator());
+    BasicSpectralShape<double> reference(FluidDefaultAllocator());
+    FluidTensor<float, 1>      singleShape(7);
+    FluidTensor<double, 1>     referenceShape(7);
+    single.processFrame(singleMags, singleShape, 44100, 0, -1, 95, logFreq,
+                        false, FluidDefaultAllocator());
+    reference.processFrame(referenceMags, referenceShape, 44100, 0, -1, 95,
+                           logFreq, false, FluidDefaultAllocator());
+    for (index i = 0; i < 7; ++i)
+      CHECK(singleShape(i) ==
+            Approx(referenceShape(i)).epsilon(1e-3).margin(1e-3));
+  }
+}
+
+template <typename Client>
+std::shared_ptr<client::MemoryBufferAdaptor>
+analyse(std::shared_ptr<client::MemoryBufferAdaptor> source)
+{
+  using namespace client;
+  typename Client::ParamSetType params(Client::getParameterDescriptors(),
+                                       FluidDefaultAllocator());
+  auto features = std::make_shared<MemoryBufferAdaptor>(1, 1, 44100);
+  params.template set<0>(std::shared_ptr<const BufferAdaptor>(source),
+                         nullptr);
+  params.template set<5>(std::shared_ptr<BufferAdaptor>(features), nullptr);
+  FluidContext c;
+  Client       nrt(params, c);
+  REQUIRE(nrt.template process<float>(c).ok());
+  return features;
+}
+
+void compareFeatures(std::shared_ptr<client::MemoryBufferAdaptor> single,
+                     std::shared_ptr<client::MemoryBufferAdaptor> reference,
+                     double                                       tolerance)
+{
+  client::BufferAdaptor::ReadAccess x(single.get());
+  client::BufferAdaptor::ReadAccess y(reference.get());
+  REQUIRE(x.numChans() == y.numChans());
+  REQUIRE(x.numFrames() == y.numFrames());
+  for (index i = 0; i < x.numChans(); ++i)
+    for (index j = 0; j < x.numFrames(); ++j)
+      CHECK(x.samps(i)(j) ==
+            Approx(y.samps(i)(j)).epsilon(tolerance).margin(tolerance));
+}
+
+TEST_CASE("Float descriptor clients match their double versions",
+          "[SinglePrecision]")
+{
+  using namespace client;
+  auto signal = makeSignal<float>(20000);
+  auto source = std::make_shared<MemoryBufferAdaptor>(1, 20000, 44100);
+  {
+    BufferAdaptor::Access buf(source.get());
+    buf.samps(0) <<= signal;
+  }
+  compareFeatures(analyse<NRTMFCCFloatClient>(source),
+                  analyse<NRTMFCCClient>(source), 1e-2);
+  compareFeatures(analyse<NRTSpectralShapeFloatClient>(source),
+                  analyse<NRTSpectralShapeClient>(source), 1e-3);
+}
+
+} // namespace fluid
@@ -0,0 +1,169 @@
+#define CATCH_CONFIG_MAIN
+
+#include <algorithms/public/KDTree.hpp>
+#include <algorithms/public/UMAP.hpp>
+#include <catch2/catch.hpp>
+#include <data/FluidDataSet.hpp>
+#include <data/FluidIndex.hpp>
+#include <data/FluidTensor.hpp>
+#include <Eigen/Core>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace fluid {
+
+// Two groups of points, each fully connected within itself and not at all
+// to the other, starting from one random jumble
+struct TwoGroups
+{
+  TwoGroups(index groupSize, index dims) : size{groupSize}
+  {
+    std::vector<int> rows, cols;
+    for (index g = 0; g < 2; ++g)
+      for (index i = 0; i < groupSize; ++i)
+        for (index j = 0; j < groupSize; ++j)
+          if (i != j)
+          {
+            rows.push_back(static_cast<int>(g * groupSize + i));
+            cols.push_back(static_cast<int>(g * groupSize + j));
+          }
+    embIndices = Eigen::Map<Eigen::ArrayXi>(rows.data(), asSigned(rows.size()));
+    refIndices = Eigen::Map<Eigen::ArrayXi>(cols.data(), asSigned(cols.size()));
+    epochsPerSample = Eigen::ArrayXd::Ones(embIndices.size());
+    embedding = 5 * Eigen::ArrayXXd::Random(2 * groupSize, dims);
+    AB.resize(2);
+    AB << 1.577, 0.895; // minDist = 0.1
+  }
+
+  // mean distance to the other points in the same group, over the distance
+  // between the groups' centres
+  double spread() const
+  {
+    auto   first = embedding.topRows(size);
+    auto   second = embedding.bottomRows(size);
+    double between =
+        std::sqrt((first.colwise().mean() - second.colwise().mean())
+                      .square()
+                      .sum());
+    double within = 0;
+    for (index i = 0; i < 2 * size; ++i)
+    {
+      index group = i / size;
+      for (index j = group * size; j < (group + 1) * size; ++j)
+        within += std::sqrt(
+            (embedding.row(i) - embedding.row(j)).square().sum());
+    }
+    within /= 2 * size * (size - 1);
+    return within / between;
+  }
+
+  index           size;
+  Eigen::ArrayXi  embIndices;
+  Eigen::ArrayXi  refIndices;
+  Eigen::ArrayXd  epochsPerSample;
+  Eigen::ArrayXXd embedding;
+  Eigen::VectorXd AB;
+};
+
+TEST_CASE("UMAP layout optimisation pulls connected points together",
+          "[UMAP]")
+{
+  auto dims = GENERATE(2, 3, 5);
+  auto threads = GENERATE(1, 4);
+  TwoGroups groups(40, dims);
+  REQUIRE(groups.spread() > 1);
+  algorithm::impl::optimizeLayout(
+      groups.embedding, groups.embedding, groups.embIndices,
+      groups.refIndices, groups.epochsPerSample, groups.AB, true, 1.0, 100,
+      1.0, threads);
+  CHECK(groups.embedding.allFinite());
+  CHECK(groups.spread() < 0.25);
+
+  SECTION("and against a fixed reference")
+  {
+    Eigen::ArrayXXd const reference = groups.embedding;
+    TwoGroups             moved(40, dims);
+    algorithm::impl::optimizeLayout(
+        moved.embedding, reference, moved.embIndices, moved.refIndices,
+        moved.epochsPerSample, moved.AB, true, 1.0, 100, 1.0, threads);
+    // each point ends up near the reference group it is connected to
+    moved.embedding.bottomRows(40) = reference.bottomRows(40);
+    CHECK(moved.spread() < 0.25);
+  }
+}
+
+using DataSet = FluidDataSet<std::string, double, 1>;
+
+// points on a noisy grid, with an embedding that is the grid itself
+DataSet makeGrid(index side, std::string prefix, double offset = 0)
+{
+  std::mt19937                           gen(5);
+  std::uniform_real_distribution<double> noise(-0.1, 0.1);
+  FluidTensor<std::string, 1>            ids(side * side);
+  FluidTensor<double, 2>                 data(side * side, 4);
+  for (int i = 0; i < side * side; ++i)
+  {
+    ids(i) = prefix + std::to_string(i);
+    data(i, 0) = i / side + offset + noise(gen);
+    data(i, 1) = i % side + offset + noise(gen);
+    data(i, 2) = noise(gen);
+    data(i, 3) = noise(gen);
+  }
+  return DataSet(ids, data);
+}
+
+TEST_CASE("Points added to a fitted UMAP join their neighbourhoods", "[UMAP]")
+{
+  index                       side = 20, n = side * side, k = 8;
+  DataSet                     grid = makeGrid(side, "");
+  FluidTensor<std::string, 1> rowIds(n);
+  for (int i = 0; i < n; ++i) rowIds(i) = std::to_string(i);
+  FluidTensor<double, 2> layout(n, 2);
+  layout <<= grid.getData()(Slice(0), Slice(0, 2));
+  algorithm::UMAP umap;
+  umap.init(layout, algorithm::KDTree(DataSet(rowIds, grid.getData())), k,
+            1.577, 0.895);
+
+  // a small patch in between the existing points near the middle
+  DataSet added = makeGrid(3, "new", 8.5);
+  DataSet result = umap.add(added, 100, 0.1);
+  REQUIRE(result.size() == added.size());
+  CHECK(umap.size() == n + added.size());
+  CHECK(umap.getTree().size() == n + added.size());
+
+  FluidTensor<double, 2> embedding(umap.size(), 2);
+  umap.getEmbedding(embedding);
+  FluidTensor<double, 1> point(2);
+  for (int i = 0; i < added.size(); ++i)
+  {
+    auto id = added.getIds()(i);
+    REQUIRE(result.get(id, point));
+    CHECK(point(0) == embedding(n + i, 0));
+    // within the area the patch was added to
+    CHECK(std::abs(point(0) - 9.5) < 2);
+    CHECK(std::abs(point(1) - 9.5) < 2);
+  }
+
+  // points away from the patch stay where they were
+  for (int i = 0; i < n; ++i)
+  {
+    if (std::abs(grid.getData()(i, 0) - 9.5) < 4 &&
+        std::abs(grid.getData()(i, 1) - 9.5) < 4)
+      continue;
+    CHECK(embedding(i, 0) == layout(i, 0));
+    CHECK(embedding(i, 1) == layout(i, 1));
+  }
+
+  SECTION("and are found by later searches")
+  {
+    FluidTensor<double, 1> query(added.getData().row(4));
+    FluidTensor<double, 1> placed(2);
+    umap.transformPoint(query, placed);
+    CHECK(std::abs(placed(0) - embedding(n + 4, 0)) < 1);
+    CHECK(std::abs(placed(1) - embedding(n + 4, 1)) < 1);
+  }
+}
+
+} // namespace fluid
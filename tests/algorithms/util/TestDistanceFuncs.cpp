@@ -0,0 +1,69 @@
+#define CATCH_CONFIG_MAIN
+
+#include <algorithms/util/DistanceFuncs.hpp>
+#include <catch2/catch.hpp>
+#include <data/FluidIndex.hpp>
+#include <Eigen/Core>
+
+namespace fluid {
+
+using algorithm::DistanceFuncs;
+using algorithm::DistanceMatrix;
+using Distance = DistanceFuncs::Distance;
+
+// positive, so that KL and JS are well defined
+Eigen::ArrayXXd randomPoints(index rows, index cols)
+{
+  return Eigen::ArrayXXd::Random(rows, cols).abs() + 0.01;
+}
+
+TEST_CASE("DistanceMatrix matches pairwise distances for every metric",
+          "[DistanceFuncs]")
+{
+  Eigen::ArrayXXd X = randomPoints(150, 7);
+  Eigen::ArrayXXd Y = randomPoints(90, 7);
+  for (index d = 0; d <= static_cast<index>(Distance::kJS); d++)
+  {
+    auto            distance = DistanceFuncs::map()[static_cast<Distance>(d)];
+    Eigen::MatrixXd D = DistanceMatrix(X, Y, d);
+    Eigen::MatrixXd parallel = DistanceMatrix(X, Y, d, 4);
+    REQUIRE(D.rows() == X.rows());
+    REQUIRE(D.cols() == Y.rows());
+    for (index i = 0; i < X.rows(); i++)
+      for (index j = 0; j < Y.rows(); j++)
+      {
+        CHECK(D(i, j) ==
+              Approx(distance(X.row(i), Y.row(j))).margin(1e-9));
+        CHECK(parallel(i, j) == D(i, j));
+      }
+  }
+}
+
+TEST_CASE("DistanceMatrix of a single set of points is symmetric with a zero "
+          "diagonal",
+          "[DistanceFuncs]")
+{
+  Eigen::ArrayXXd X = randomPoints(100, 5);
+  for (auto d : {Distance::kManhattan, Distance::kEuclidean,
+                 Distance::kSqEuclidean, Distance::kCosine})
+  {
+    Eigen::MatrixXd D = DistanceMatrix(X, static_cast<index>(d));
+    CHECK(D.diagonal().isZero());
+    CHECK(D.isApprox(D.transpose()));
+  }
+}
+
+TEST_CASE("Distance functors agree with the distance map", "[DistanceFuncs]")
+{
+  Eigen::ArrayXXd X = randomPoints(2, 6);
+  Eigen::ArrayXd  x = X.row(0), y = X.row(1);
+  for (index d = 0; d <= static_cast<index>(Distance::kJS); d++)
+  {
+    auto   dist = static_cast<Distance>(d);
+    double expected = DistanceFuncs::map()[dist](x, y);
+    CHECK(DistanceFuncs::visit(dist, [&](auto f) { return f(x, y); }) ==
+          Approx(expected));
+  }
+}
+
+} // namespace fluid
@@ -0,0 +1,93 @@
+#define CATCH_CONFIG_MAIN
+
+#include <algorithms/util/FFT.hpp>
+#include <catch2/catch.hpp>
+#include <data/FluidIndex.hpp>
+#include <data/FluidTensor.hpp>
+#include <Eigen/Core>
+#include <cmath>
+#include <complex>
+
+namespace fluid {
+
+using algorithm::FFT;
+using algorithm::IFFT;
+
+TEST_CASE("Batched FFT matches frame by frame transforms", "[FFT]")
+{
+  index                   size = 512, nFrames = 9;
+  FluidTensor<double, 2>  frames(nFrames, size);
+  Eigen::Map<Eigen::ArrayXd>(frames.data(), frames.size()) =
+      Eigen::ArrayXd::Random(frames.size());
+  FFT                                  fft(size);
+  FluidTensor<std::complex<double>, 2> spectra(nFrames, size / 2 + 1);
+  fft.process(frames, spectra);
+
+  for (index i = 0; i < nFrames; i++)
+  {
+    Eigen::ArrayXcd expected =
+        fft.process(Eigen::Map<Eigen::ArrayXd>(frames.row(i).data(), size));
+    for (index j = 0; j < expected.size(); j++)
+      CHECK(std::abs(spectra(i, j) - expected(j)) < 1e-9);
+  }
+
+  SECTION("and writes into strided views")
+  {
+    FluidTensor<std::complex<double>, 2> transposed(size / 2 + 1, nFrames);
+    fft.process(frames, transposed.transpose());
+    CHECK(std::equal(spectra.begin(), spectra.end(),
+                     transposed.transpose().begin()));
+  }
+
+  SECTION("and the batched IFFT inverts it")
+  {
+    IFFT                   ifft(size);
+    FluidTensor<double, 2> resynth(nFrames, size);
+    ifft.process(spectra, resynth);
+    for (index i = 0; i < frames.size(); i++)
+      CHECK(resynth.data()[i] / size ==
+            Approx(frames.data()[i]).margin(1e-9));
+
+    FluidTensor<double, 2> heads(nFrames, 100);
+    ifft.process(spectra, heads);
+    CHECK(std::equal(heads.begin(), heads.end(),
+                     resynth(Slice(0), Slice(0, 100)).begin()));
+  }
+}
+
+TEST_CASE("FFT sizes above 65536 are supported", "[FFT]")
+{
+  index           size = 1 << 18, bin = 1234;
+  Eigen::ArrayXd  signal = Eigen::ArrayXd::LinSpaced(size, 0, size - 1);
+  signal = (signal * 2 * M_PI * bin / size).cos();
+  FFT             fft(size);
+  Eigen::ArrayXcd spectrum = fft.process(signal);
+  REQUIRE(spectrum.size() == size / 2 + 1);
+  Eigen::Index peak;
+  spectrum.abs().maxCoeff(&peak);
+  CHECK(peak == bin);
+  CHECK(std::abs(spectrum(bin)) == Approx(size / 2.0));
+
+  IFFT           ifft(size);
+  Eigen::ArrayXd resynth = ifft.process(spectrum) / size;
+  CHECK((resynth - signal).abs().maxCoeff() < 1e-6);
+
+  SECTION("alongside smaller transforms made earlier and later")
+  {
+    FFT             small(1024);
+    Eigen::ArrayXd  impulse = Eigen::ArrayXd::Zero(1024);
+    impulse(0) = 1;
+    Eigen::ArrayXcd flat = small.process(impulse);
+    CHECK((flat - 1.0).abs().maxCoeff() < 1e-12);
+  }
+
+  SECTION("and setting up with no size in mind keeps the larger setup")
+  {
+    FFT::setup();
+    FFT             again(size);
+    Eigen::ArrayXcd respectrum = again.process(signal);
+    CHECK((respectrum - spectrum).abs().maxCoeff() < 1e-9);
+  }
+}
+
+} // namespace fluid
@@ -0,0 +1,80 @@
+#define CATCH_CONFIG_MAIN
+
+#include <algorithms/util/ParallelFor.hpp>
+#include <catch2/catch.hpp>
+#include <data/FluidIndex.hpp>
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace fluid {
+
+using algorithm::parallelFor;
+using algorithm::ThreadPool;
+
+TEST_CASE("parallelFor visits every index exactly once", "[parallelFor]")
+{
+  ThreadPool::instance().setMaxThreads(4);
+  std::vector<std::atomic<int>> visits(10007);
+  parallelFor(
+      10007, 64,
+      [&](index start, index end) {
+        for (index i = start; i < end; i++) visits[asUnsigned(i)]++;
+      },
+      4);
+  CHECK(std::all_of(visits.begin(), visits.end(),
+                    [](auto& v) { return v == 1; }));
+}
+
+TEST_CASE("parallelFor stays within the shared pool's limit", "[parallelFor]")
+{
+  ThreadPool&           pool = ThreadPool::instance();
+  index                 limit = pool.maxThreads();
+  std::mutex            mutex;
+  std::set<std::thread::id> threads;
+  parallelFor(
+      1000, 1,
+      [&](index, index) {
+        std::lock_guard<std::mutex> lock(mutex);
+        threads.insert(std::this_thread::get_id());
+      },
+      limit + 8);
+  CHECK(asSigned(threads.size()) <= limit);
+
+  SECTION("even when called from one of the pool's own jobs")
+  {
+    std::atomic<index> total{0};
+    pool.submit([&]() {
+          parallelFor(1000, 1, [&](index start, index end) {
+            total += end - start;
+          });
+        })
+        .wait();
+    CHECK(total == 1000);
+  }
+}
+
+TEST_CASE("parallelFor rethrows an exception from any block on the caller",
+          "[parallelFor]")
+{
+  ThreadPool::instance().setMaxThreads(4);
+  std::atomic<index> calls{0};
+  auto               run = [&]() {
+    parallelFor(
+        1000, 1,
+        [&](index start, index end) {
+          calls++;
+          if (start <= 500 && 500 < end)
+            throw std::runtime_error("block 500");
+        },
+        4);
+  };
+  CHECK_THROWS_WITH(run(), "block 500");
+  CHECK(calls <= 1000);
+}
+
+} // namespace fluid
@@ -0,0 +1,85 @@
+#define CATCH_CONFIG_MAIN
+
+#include <algorithms/util/SpectralEmbedding.hpp>
+#include <catch2/catch.hpp>
+#include <data/FluidIndex.hpp>
+#include <Eigen/Core>
+#include <Eigen/Sparse>
+#include <cmath>
+#include <vector>
+
+namespace fluid {
+
+using algorithm::SpectralEmbedding;
+
+// two rings of nodes joined by a single weak edge
+Eigen::SparseMatrix<double> twoRings(index ringSize)
+{
+  std::vector<Eigen::Triplet<double>> edges;
+  auto connect = [&](index a, index b, double w) {
+    edges.emplace_back(a, b, w);
+    edges.emplace_back(b, a, w);
+  };
+  for (index r = 0; r < 2; ++r)
+    for (index i = 0; i < ringSize; ++i)
+    {
+      index offset = r * ringSize;
+      connect(offset + i, offset + (i + 1) % ringSize, 1.0);
+      connect(offset + i, offset + (i + 2) % ringSize, 0.5);
+    }
+  connect(0, ringSize, 0.01);
+  Eigen::SparseMatrix<double> graph(2 * ringSize, 2 * ringSize);
+  graph.setFromTriplets(edges.begin(), edges.end());
+  return graph;
+}
+
+TEST_CASE("Spectral embedding separates weakly joined clusters",
+          "[SpectralEmbedding]")
+{
+  index             ringSize = 60;
+  SpectralEmbedding embedding;
+  Eigen::ArrayXXd   y = embedding.train(twoRings(ringSize), 2);
+  REQUIRE(embedding.converged());
+  REQUIRE(y.rows() == 2 * ringSize);
+  REQUIRE(y.cols() == 2);
+
+  // the first coordinate takes one sign per ring
+  double sign = y(0, 0) > 0 ? 1 : -1;
+  for (index i = 0; i < ringSize; ++i)
+  {
+    CHECK(sign * y(i, 0) > 0);
+    CHECK(sign * y(ringSize + i, 0) < 0);
+  }
+  Eigen::VectorXd values = embedding.eigenValues();
+  CHECK(values(0) == Approx(0).margin(1e-6));
+  CHECK(values(1) < values(2));
+
+  SECTION("and warm starts from its previous eigenvectors")
+  {
+    index coldIterations = embedding.iterations();
+    embedding.train(twoRings(ringSize), 2);
+    REQUIRE(embedding.converged());
+    // starting in the right subspace takes fewer restarts than a cold start
+    CHECK(embedding.iterations() < coldIterations);
+
+    SpectralEmbedding fresh;
+    fresh.train(twoRings(ringSize), 2);
+    CHECK(fresh.iterations() == coldIterations);
+  }
+}
+
+TEST_CASE("Spectral embedding reports graphs it can't embed",
+          "[SpectralEmbedding]")
+{
+  Eigen::SparseMatrix<double> tiny(3, 3);
+  tiny.insert(0, 1) = 1;
+  tiny.insert(1, 0) = 1;
+  tiny.insert(1, 2) = 1;
+  tiny.insert(2, 1) = 1;
+  SpectralEmbedding embedding;
+  Eigen::ArrayXXd   y = embedding.train(tiny, 3);
+  CHECK_FALSE(embedding.converged());
+  CHECK(y.size() == 0);
+}
+
+} // namespace fluid
@@ -0,0 +1,108 @@
+#define CATCH_CONFIG_MAIN
+
+#include <catch2/catch.hpp>
+#include <CatchUtils.hpp>
+#include <clients/common/BufferSnapshot.hpp>
+#include <clients/common/MemoryBufferAdaptor.hpp>
+#include <memory>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+using fluid::EqualsRange;
+using fluid::client::BufferAdaptor;
+using fluid::client::BufferSnapshot;
+using fluid::client::MemoryBufferAdaptor;
+
+std::shared_ptr<BufferAdaptor> makeBuffer(fluid::index chans, fluid::index frames)
+{
+  auto buf = std::make_shared<MemoryBufferAdaptor>(chans, frames, 44100);
+  BufferAdaptor::Access access(buf.get());
+  auto                  all = access.allFrames();
+  std::iota(all.begin(), all.end(), 0.0f);
+  return buf;
+}
+
+TEST_CASE("BufferSnapshot copies the contents of a buffer", "[BufferSnapshot]")
+{
+  std::shared_ptr<const BufferAdaptor> origin = makeBuffer(2, 100);
+  auto                                 snapshot = BufferSnapshot::take(origin);
+  BufferAdaptor::ReadAccess            src(origin.get());
+  BufferAdaptor::ReadAccess            copy(snapshot.get());
+  CHECK(copy.exists());
+  CHECK(copy.valid());
+  CHECK(copy.numChans() == 2);
+  CHECK(copy.numFrames() == 100);
+  CHECK(copy.sampleRate() == src.sampleRate());
+  REQUIRE_THAT(copy.allFrames(), EqualsRange(src.allFrames()));
+  REQUIRE_THAT(copy.samps(1), EqualsRange(src.samps(1)));
+  REQUIRE_THAT(copy.samps(10, 5, 1), EqualsRange(src.samps(10, 5, 1)));
+}
+
+TEST_CASE("BufferSnapshots of an unchanged buffer share their samples",
+          "[BufferSnapshot]")
+{
+  auto                                 buf = makeBuffer(1, 50);
+  std::shared_ptr<const BufferAdaptor> origin = buf;
+  auto first = std::static_pointer_cast<const BufferSnapshot>(
+      BufferSnapshot::take(origin));
+  auto second = std::static_pointer_cast<const BufferSnapshot>(
+      BufferSnapshot::take(origin));
+  CHECK(first.get() != second.get());
+  CHECK(first->frames() == second->frames());
+
+  SECTION("but not once it has changed")
+  {
+    {
+      BufferAdaptor::Access access(buf.get());
+      access.samps(0)(7) = -1;
+    }
+    auto changed = std::static_pointer_cast<const BufferSnapshot>(
+        BufferSnapshot::take(origin));
+    CHECK(changed->frames() != first->frames());
+    BufferAdaptor::ReadAccess copy(changed.get());
+    CHECK(copy.samps(0)(7) == -1);
+    BufferAdaptor::ReadAccess old(first.get());
+    CHECK(old.samps(0)(7) == 7);
+  }
+
+  SECTION("or after every snapshot has gone")
+  {
+    first.reset();
+    second.reset();
+    auto fresh = std::static_pointer_cast<const BufferSnapshot>(
+        BufferSnapshot::take(origin));
+    BufferAdaptor::ReadAccess copy(fresh.get());
+    CHECK(copy.numFrames() == 50);
+  }
+}
+
+TEST_CASE("BufferSnapshots are read only", "[BufferSnapshot]")
+{
+  std::shared_ptr<const BufferAdaptor> origin = makeBuffer(1, 10);
+  auto snapshot = std::const_pointer_cast<BufferAdaptor>(
+      BufferSnapshot::take(origin));
+  BufferAdaptor::Access access(snapshot.get());
+  CHECK_FALSE(access.resize(20, 1, 44100).ok());
+}
+
+TEST_CASE("BufferSnapshots can be taken from several threads at once",
+          "[BufferSnapshot]")
+{
+  std::vector<std::shared_ptr<const BufferAdaptor>> origins{
+      makeBuffer(2, 20000), makeBuffer(1, 30000)};
+  std::vector<std::shared_ptr<const BufferAdaptor>> snapshots(8);
+  std::vector<std::thread>                          threads;
+  for (size_t i = 0; i < snapshots.size(); i++)
+    threads.emplace_back([&, i]() {
+      snapshots[i] = BufferSnapshot::take(origins[i % origins.size()]);
+    });
+  for (auto& t : threads) t.join();
+
+  for (size_t i = 0; i < snapshots.size(); i++)
+  {
+    BufferAdaptor::ReadAccess src(origins[i % origins.size()].get());
+    BufferAdaptor::ReadAccess copy(snapshots[i].get());
+    REQUIRE_THAT(copy.allFrames(), EqualsRange(src.allFrames()));
+  }
+}
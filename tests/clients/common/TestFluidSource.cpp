@@ -57,3 +57,42 @@ TEMPLATE_TEST_CASE(
     j = j < hostSize ? j : j - hostSize;
   }
 }
+
+TEMPLATE_TEST_CASE("FluidSource windows are contiguous across the wrap",
+                   "[FluidSource][frames]", int, double)
+{
+  constexpr int hostSize = 64;
+  constexpr int maxFrameSize = 256;
+  constexpr int channels = 2;
+
+  FluidSource<TestType> framer(maxFrameSize, channels, hostSize);
+
+  FluidTensor<TestType, 2> data(channels, 4096);
+  std::iota(data.begin(), data.end(), 1);
+  // the input delayed by a whole frame, as in the test above
+  FluidTensor<TestType, 2> expected(channels, data.cols() + maxFrameSize);
+  expected(Slice(0), Slice(maxFrameSize, data.cols())) <<= data;
+  FluidTensor<TestType, 2> pulled(channels, maxFrameSize);
+
+  auto frameSize = GENERATE(17, 64, 200, 256);
+  int  hop = std::max(frameSize / 3, 1);
+
+  for (int i = 0, j = 0; i + hostSize <= data.cols(); i += hostSize)
+  {
+    framer.push(data(Slice(0), Slice(i, hostSize)));
+    for (; j < hostSize; j += hop)
+    {
+      auto window = framer.window(frameSize, j);
+      auto frame = pulled(Slice(0), Slice(0, frameSize));
+      framer.pull(frame, j);
+      int start = maxFrameSize + i + j - frameSize;
+      for (int c = 0; c < channels; ++c)
+      {
+        CHECK_THAT(window.row(c),
+                   EqualsRange(expected.row(c)(Slice(start, frameSize))));
+        CHECK_THAT(frame.row(c), EqualsRange(window.row(c)));
+      }
+    }
+    j = j < hostSize ? j : j - hostSize;
+  }
+}
@@ -0,0 +1,219 @@
+#define CATCH_CONFIG_MAIN
+
+#include <catch2/catch.hpp>
+#include <clients/common/FluidContext.hpp>
+#include <clients/common/MemoryBufferAdaptor.hpp>
+#include <clients/nrt/BufSelectEveryClient.hpp>
+#include <clients/rt/HPSSClient.hpp>
+#include <clients/rt/SpectralShapeClient.hpp>
+#include <data/FluidIndex.hpp>
+#include <data/FluidMemory.hpp>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace fluid {
+namespace client {
+
+std::shared_ptr<MemoryBufferAdaptor> makeSource(index chans, index frames)
+{
+  auto                                  source =
+      std::make_shared<MemoryBufferAdaptor>(chans, frames, 44100);
+  std::mt19937                          gen(42);
+  std::uniform_real_distribution<float> noise(-0.1f, 0.1f);
+  BufferAdaptor::Access                 buf(source.get());
+  for (index i = 0; i < chans; ++i)
+  {
+    auto channel = buf.samps(i);
+    for (index j = 0; j < frames; ++j)
+      channel(j) = std::sin(0.01f * (i + 1) * j) + noise(gen);
+  }
+  return source;
+}
+
+// Runs a wrapped client over source, writing to the outputs at Outs...
+template <typename NRTClient, size_t... Outs>
+std::vector<std::shared_ptr<MemoryBufferAdaptor>>
+run(std::shared_ptr<MemoryBufferAdaptor> source, index channelThreads,
+    FluidTask* task = nullptr, index startFrame = 0, index numFrames = -1,
+    index startChan = 0, index numChans = -1)
+{
+  using ParamSet = typename NRTClient::ParamSetType;
+  ParamSet params(NRTClient::getParameterDescriptors(),
+                  FluidDefaultAllocator());
+  params.template set<0>(std::shared_ptr<const BufferAdaptor>(source),
+                         nullptr);
+  params.template set<1>(std::move(startFrame), nullptr);
+  params.template set<2>(std::move(numFrames), nullptr);
+  params.template set<3>(std::move(startChan), nullptr);
+  params.template set<4>(std::move(numChans), nullptr);
+  std::vector<std::shared_ptr<MemoryBufferAdaptor>> outputs;
+  for (size_t i = 0; i < sizeof...(Outs); ++i)
+    outputs.push_back(std::make_shared<MemoryBufferAdaptor>(1, 1, 44100));
+  index n = 0;
+  (params.template set<Outs>(
+       std::shared_ptr<BufferAdaptor>(outputs[asUnsigned(n++)]), nullptr),
+   ...);
+  FluidContext c;
+  if (task) c.task(task);
+  NRTClient client(params, c);
+  CHECK(client.channelThreads() == 1); // serial unless asked otherwise
+  client.channelThreads(channelThreads);
+  auto result = client.template process<float>(c);
+  CHECK(result.ok());
+  return outputs;
+}
+
+bool sameContents(std::shared_ptr<MemoryBufferAdaptor> a,
+                  std::shared_ptr<MemoryBufferAdaptor> b)
+{
+  BufferAdaptor::ReadAccess x(a.get());
+  BufferAdaptor::ReadAccess y(b.get());
+  if (x.numChans() != y.numChans() || x.numFrames() != y.numFrames())
+    return false;
+  auto xs = x.allFrames();
+  auto ys = y.allFrames();
+  return std::equal(xs.begin(), xs.end(), ys.begin());
+}
+
+TEST_CASE("Channel-parallel streaming matches serial processing",
+          "[NRTClientWrapper]")
+{
+  auto source = makeSource(6, 20000);
+  auto serial = run<NRTHPSSClient, 5, 6, 7>(source, 1);
+  auto parallel = run<NRTHPSSClient, 5, 6, 7>(source, 4);
+  for (size_t i = 0; i < serial.size(); ++i)
+  {
+    BufferAdaptor::ReadAccess out(serial[i].get());
+    CHECK(out.numChans() == 6);
+    CHECK(out.numFrames() == 20000);
+    CHECK(sameContents(serial[i], parallel[i]));
+  }
+}
+
+TEST_CASE("Channel-parallel control analysis matches serial processing",
+          "[NRTClientWrapper]")
+{
+  auto      source = makeSource(5, 30000);
+  FluidTask task;
+  auto      serial = run<NRTSpectralShapeClient, 5>(source, 1);
+  auto      parallel = run<NRTSpectralShapeClient, 5>(source, 0, &task);
+  BufferAdaptor::ReadAccess out(serial[0].get());
+  CHECK(out.numChans() == 5 * 7);
+  CHECK(sameContents(serial[0], parallel[0]));
+  CHECK(task.progress() == Approx(1.0));
+}
+
+TEST_CASE("Hosts choose channel threads through the threading adaptor",
+          "[NRTClientWrapper]")
+{
+  auto source = makeSource(4, 20000);
+  auto serial = run<NRTSpectralShapeClient, 5>(source, 1);
+  auto output = std::make_shared<MemoryBufferAdaptor>(1, 1, 44100);
+
+  using Adaptor = NRTThreadedSpectralShapeClient;
+  Adaptor::ParamSetType params(Adaptor::getParameterDescriptors(),
+                               FluidDefaultAllocator());
+  params.template set<0>(std::shared_ptr<const BufferAdaptor>(source),
+                         nullptr);
+  params.template set<5>(std::shared_ptr<BufferAdaptor>(output), nullptr);
+  Adaptor adaptor(params, FluidContext());
+  adaptor.setSynchronous(true);
+  CHECK(adaptor.channelThreads() == 1);
+  REQUIRE(adaptor.setChannelThreads(0).ok());
+  CHECK(adaptor.channelThreads() == 0);
+  REQUIRE(adaptor.enqueue(params).ok());
+  REQUIRE(adaptor.process().ok());
+  CHECK(adaptor.channelThreads() == 0);
+  CHECK(sameContents(serial[0], output));
+
+  SECTION("which other clients ignore")
+  {
+    using Selector = NRTThreadingSelectEveryClient;
+    Selector::ParamSetType selectParams(Selector::getParameterDescriptors(),
+                                        FluidDefaultAllocator());
+    Selector selector(selectParams, FluidContext());
+    CHECK(selector.setChannelThreads(0).ok());
+    CHECK(selector.channelThreads() == 1);
+  }
+}
+
+TEST_CASE("Batches pack each item's results one after another",
+          "[NRTClientWrapper]")
+{
+  auto mono = makeSource(1, 12000);
+  auto stereo = makeSource(2, 30000);
+  auto wide = makeSource(3, 9000);
+
+  using ParamSet = NRTSpectralShapeClient::ParamSetType;
+  ParamSet params(NRTSpectralShapeClient::getParameterDescriptors(),
+                  FluidDefaultAllocator());
+  auto     packed = std::make_shared<MemoryBufferAdaptor>(1, 1, 44100);
+  params.template set<5>(std::shared_ptr<BufferAdaptor>(packed), nullptr);
+  FluidContext           c;
+  FluidTask              task;
+  NRTSpectralShapeClient client(params, c);
+  c.task(&task);
+
+  std::vector<BufferProcessSpec> items{{mono.get(), 0, -1, 0, -1},
+                                       {stereo.get(), 1000, 20000, 0, -1},
+                                       {wide.get(), 0, -1, 1, 1},
+                                       {stereo.get(), 0, -1, 1, -1}};
+  std::vector<std::shared_ptr<MemoryBufferAdaptor>> sources{mono, stereo,
+                                                            wide, stereo};
+  std::vector<index> offsets;
+
+  for (index threads : {1, 3})
+  {
+    client.channelThreads(threads);
+    auto result = client.processBatch(items, offsets, c);
+    REQUIRE(result.ok());
+    REQUIRE(offsets.size() == items.size() + 1);
+    CHECK(offsets[0] == 0);
+    CHECK(task.progress() == Approx(1.0));
+
+    BufferAdaptor::ReadAccess out(packed.get());
+    CHECK(out.numChans() == 2 * 7);
+    CHECK(out.numFrames() == offsets.back());
+
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+      auto single = run<NRTSpectralShapeClient, 5>(
+          sources[i], 1, nullptr, items[i].startFrame, items[i].nFrames,
+          items[i].startChan, items[i].nChans);
+      BufferAdaptor::ReadAccess expected(single[0].get());
+      index                     frames = offsets[i + 1] - offsets[i];
+      REQUIRE(frames == expected.numFrames());
+      for (index j = 0; j < out.numChans(); ++j)
+      {
+        auto actual = out.samps(offsets[i], frames, j);
+        if (j < expected.numChans())
+          CHECK(std::equal(actual.begin(), actual.end(),
+                           expected.samps(j).begin()));
+        else
+          CHECK(std::all_of(actual.begin(), actual.end(),
+                            [](float x) { return x == 0; }));
+      }
+    }
+  }
+
+  SECTION("and leave no stale offsets behind on errors")
+  {
+    params.template set<5>(std::shared_ptr<BufferAdaptor>(), nullptr);
+    CHECK(client.processBatch(items, offsets, c).status() ==
+          Result::Status::kError);
+    CHECK(offsets.empty());
+  }
+
+  SECTION("and report which item is out of range")
+  {
+    items[2].startFrame = 9000;
+    auto result = client.processBatch(items, offsets, c);
+    CHECK(result.status() == Result::Status::kError);
+  }
+}
+
+} // namespace client
+} // namespace fluid
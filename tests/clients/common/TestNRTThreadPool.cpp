@@ -0,0 +1,132 @@
+#define CATCH_CONFIG_MAIN
+
+#include <catch2/catch.hpp>
+#include <clients/common/NRTThreadPool.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <vector>
+
+using fluid::client::NRTThreadPool;
+
+TEST_CASE("NRTThreadPool runs every submitted job", "[NRTThreadPool]")
+{
+  NRTThreadPool                  pool(4);
+  std::atomic<int>               count{0};
+  std::vector<std::future<void>> done;
+  for (int i = 0; i < 1000; i++)
+    done.push_back(pool.submit([&count]() { count++; }));
+  for (auto& f : done) f.wait();
+  CHECK(count == 1000);
+}
+
+TEST_CASE("NRTThreadPool never runs more than maxThreads jobs at once",
+          "[NRTThreadPool]")
+{
+  NRTThreadPool    pool(3);
+  std::atomic<int> running{0};
+  std::atomic<int> mostRunning{0};
+  auto             job = [&]() {
+    int now = ++running;
+    int most = mostRunning;
+    while (now > most && !mostRunning.compare_exchange_weak(most, now)) {}
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    running--;
+  };
+
+  std::vector<std::future<void>> done;
+  for (int i = 0; i < 50; i++) done.push_back(pool.submit(job));
+  for (auto& f : done) f.wait();
+  CHECK(mostRunning <= 3);
+  CHECK(mostRunning > 1);
+
+  SECTION("including after the limit is lowered")
+  {
+    pool.setMaxThreads(1);
+    CHECK(pool.maxThreads() == 1);
+    mostRunning = 0;
+    done.clear();
+    for (int i = 0; i < 20; i++) done.push_back(pool.submit(job));
+    for (auto& f : done) f.wait();
+    CHECK(mostRunning == 1);
+  }
+}
+
+TEST_CASE("NRTThreadPool defaults to one thread per core", "[NRTThreadPool]")
+{
+  NRTThreadPool pool;
+  CHECK(pool.maxThreads() == fluid::algorithm::hardwareThreads());
+  CHECK(NRTThreadPool::instance().maxThreads() >= 1);
+}
+
+TEST_CASE("NRTThreadPool can withdraw jobs that haven't started",
+          "[NRTThreadPool]")
+{
+  NRTThreadPool      pool(1);
+  std::promise<void> release;
+  auto               released = release.get_future().share();
+  fluid::index       blockingId, waitingId;
+  bool               ran = false;
+  auto blocking = pool.submit([released]() { released.wait(); }, &blockingId);
+  auto waiting = pool.submit([&ran]() { ran = true; }, &waitingId);
+
+  CHECK(pool.withdraw(waitingId));
+  CHECK(waiting.wait_for(std::chrono::seconds(0)) ==
+        std::future_status::ready);
+  CHECK_THROWS_AS(waiting.get(), std::future_error);
+  CHECK_FALSE(pool.withdraw(waitingId));
+
+  release.set_value();
+  blocking.wait();
+  CHECK_FALSE(pool.withdraw(blockingId));
+  CHECK_FALSE(ran);
+}
+
+TEST_CASE("NRTThreadPool stops and joins its workers", "[NRTThreadPool]")
+{
+  NRTThreadPool      pool(1);
+  std::promise<void> start;
+  auto               started = start.get_future();
+  std::atomic<bool>  finished{false};
+  bool               ran = false;
+  auto running = pool.submit([&]() {
+    start.set_value();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    finished = true;
+  });
+  auto waiting = pool.submit([&ran]() { ran = true; });
+  started.wait();
+
+  pool.stop();
+  CHECK(finished);
+  CHECK(pool.threads() == 0);
+  CHECK_THROWS_AS(waiting.get(), std::future_error);
+  CHECK_FALSE(ran);
+
+  SECTION("and starts new ones for later work")
+  {
+    pool.submit([&ran]() { ran = true; }).wait();
+    CHECK(ran);
+    CHECK(pool.threads() == 1);
+    pool.stop();
+    pool.stop();
+    CHECK(pool.threads() == 0);
+  }
+}
+
+TEST_CASE("The shared NRTThreadPool shuts down with its last user",
+          "[NRTThreadPool]")
+{
+  NRTThreadPool& pool = NRTThreadPool::instance();
+  {
+    fluid::client::NRTThreadPoolUser user;
+    {
+      fluid::client::NRTThreadPoolUser other(user);
+    }
+    pool.submit([]() {}).wait();
+    CHECK(pool.threads() >= 1);
+  }
+  CHECK(pool.threads() == 0);
+}
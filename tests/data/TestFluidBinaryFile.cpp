@@ -0,0 +1,137 @@
+#define CATCH_CONFIG_MAIN
+
+#include <algorithms/public/KDTree.hpp>
+#include <catch2/catch.hpp>
+#include <CatchUtils.hpp>
+#include <data/FluidBinaryFile.hpp>
+#include <data/FluidDataSet.hpp>
+#include <data/FluidTensor.hpp>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+using fluid::BinaryFile;
+using fluid::EqualsRange;
+using fluid::FluidTensor;
+using DataSet = BinaryFile::DataSet;
+using LabelSet = BinaryFile::LabelSet;
+
+TEST_CASE("BinaryFile chooses files by extension and magic bytes",
+          "[BinaryFile]")
+{
+  CHECK(BinaryFile::isBinaryName("data.bin"));
+  CHECK_FALSE(BinaryFile::isBinaryName("data.json"));
+  CHECK_FALSE(BinaryFile::isBinaryName(".bin"));
+
+  std::ofstream("not_binary.json") << "{}";
+  CHECK_FALSE(BinaryFile::isBinaryFile("not_binary.json"));
+  CHECK_FALSE(BinaryFile::isBinaryFile("does_not_exist.bin"));
+  std::remove("not_binary.json");
+}
+
+TEST_CASE("BinaryFile round trips a DataSet", "[BinaryFile]")
+{
+  FluidTensor<double, 2>      points{{0, 1.5, -2}, {3, 4, 5e-300}};
+  FluidTensor<std::string, 1> ids{"zero", ""};
+  DataSet                     ds(ids, points);
+
+  {
+    BinaryFile file("dataset.bin", "w");
+    CHECK(file.write(ds));
+  }
+  CHECK(BinaryFile::isBinaryFile("dataset.bin"));
+
+  BinaryFile file("dataset.bin", "r");
+  DataSet    result;
+  REQUIRE(file.read(result));
+  CHECK(result.size() == 2);
+  CHECK(result.dims() == 3);
+  REQUIRE_THAT(result.getIds(), EqualsRange(ids));
+  REQUIRE_THAT(result.getData(), EqualsRange(points));
+  CHECK(result.getIndex("") == 1);
+
+  SECTION("but not as a different type")
+  {
+    BinaryFile other("dataset.bin", "r");
+    LabelSet   labels;
+    CHECK_FALSE(other.read(labels));
+    CHECK_FALSE(other.ok());
+  }
+
+  SECTION("and rejects truncated files")
+  {
+    std::ifstream in("dataset.bin", std::ios::binary);
+    std::string   bytes((std::istreambuf_iterator<char>(in)), {});
+    std::ofstream("truncated.bin", std::ios::binary)
+        << bytes.substr(0, bytes.size() - 4);
+    BinaryFile truncated("truncated.bin", "r");
+    CHECK_FALSE(truncated.read(result));
+    std::remove("truncated.bin");
+  }
+
+  SECTION("and rejects values that aren't doubles")
+  {
+    std::ifstream in("dataset.bin", std::ios::binary);
+    std::string   bytes((std::istreambuf_iterator<char>(in)), {});
+    uint32_t      valueSize = sizeof(float);
+    std::memcpy(&bytes[20], &valueSize, sizeof(valueSize));
+    std::ofstream("float.bin", std::ios::binary) << bytes;
+    BinaryFile floats("float.bin", "r");
+    CHECK_FALSE(floats.read(result));
+    std::remove("float.bin");
+  }
+
+  SECTION("and rejects sizes that overflow")
+  {
+    std::ifstream in("dataset.bin", std::ios::binary);
+    std::string   bytes((std::istreambuf_iterator<char>(in)), {});
+    uint64_t      rows = uint64_t(1) << 61; // rows * 8 bytes wraps to 0
+    std::memcpy(&bytes[24], &rows, sizeof(rows));
+    std::ofstream("overflow.bin", std::ios::binary) << bytes;
+    BinaryFile overflow("overflow.bin", "r");
+    CHECK_FALSE(overflow.read(result));
+    std::remove("overflow.bin");
+  }
+  std::remove("dataset.bin");
+}
+
+TEST_CASE("BinaryFile round trips a LabelSet", "[BinaryFile]")
+{
+  FluidTensor<std::string, 2> labels{{"a"}, {"bb"}, {"ccc"}};
+  FluidTensor<std::string, 1> ids{"x", "y", "z"};
+  LabelSet                    ls(ids, labels);
+
+  {
+    BinaryFile file("labelset.bin", "w");
+    CHECK(file.write(ls));
+  }
+  BinaryFile file("labelset.bin", "r");
+  LabelSet   result;
+  REQUIRE(file.read(result));
+  REQUIRE_THAT(result.getIds(), EqualsRange(ids));
+  REQUIRE_THAT(result.getData(), EqualsRange(labels));
+  std::remove("labelset.bin");
+}
+
+TEST_CASE("BinaryFile stores other objects through their JSON form",
+          "[BinaryFile]")
+{
+  FluidTensor<double, 2>      points{{0, 0}, {1, 1}, {5, 5}};
+  FluidTensor<std::string, 1> ids{"a", "b", "c"};
+  fluid::algorithm::KDTree    tree(DataSet(ids, points));
+
+  {
+    BinaryFile file("tree.bin", "w");
+    CHECK(file.write(tree));
+  }
+  BinaryFile               file("tree.bin", "r");
+  fluid::algorithm::KDTree result;
+  REQUIRE(file.read(result));
+  CHECK(result.size() == 3);
+  FluidTensor<double, 1> query{4, 4};
+  auto [dists, nearest] = result.kNearest(query, 1);
+  CHECK(*nearest[0] == "c");
+  std::remove("tree.bin");
+}
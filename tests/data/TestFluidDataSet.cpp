@@ -155,6 +155,69 @@ TEST_CASE("FluidDataSet can have points removed","[FluidDataSet]")
     CHECK(d.get(labels(0),output) == false);
 }
 
+TEST_CASE("FluidDataSet keeps lookups consistent when removing from the middle","[FluidDataSet]")
+{
+    DataSet d(1); 
+    FluidTensor<int, 1> point{0}; 
+    for(int i = 0; i < 10; i++)
+    {
+        point(0) = i; 
+        d.add(std::to_string(i), point); 
+    }
+
+    CHECK(d.remove("3") == true); 
+    CHECK(d.remove("0") == true); 
+    CHECK(d.remove("9") == true); 
+    CHECK(d.size() == 7); 
+    CHECK(d.getIds().size() == 7); 
+    CHECK(d.getData().size() == 7); 
+    CHECK(d.getIndex("3") == -1); 
+
+    FluidTensor<int, 1> output{-1}; 
+    for(fluid::index i = 0; i < d.size(); i++)
+    {
+        auto id = d.getIds()(i); 
+        CHECK(d.getIndex(id) == i); 
+        CHECK(d.get(id, output) == true); 
+        CHECK(output(0) == std::stoi(id)); 
+        CHECK(d.getData()(i, 0) == std::stoi(id)); 
+    }
+    point(0) = 3; 
+    CHECK(d.add("3", point) == true); 
+    CHECK(d.getIndex("3") == 7); 
+}
+
+TEST_CASE("FluidDataSet can reserve space and add many points at once","[FluidDataSet]")
+{
+    FluidTensor<int, 2> points{{0,1,2,3,4},{5,6,7,8,9},{10,11,12,13,14}}; 
+    FluidTensor<std::string,1> labels{"zero","one","two"}; 
+    DataSet d(5); 
+
+    d.reserve(100); 
+    CHECK(d.capacity() >= 100); 
+    CHECK(d.size() == 0); 
+    CHECK(d.getData().size() == 0); 
+
+    CHECK(d.add(labels(1),points.row(1)) == true); 
+    CHECK(d.addMany(labels, points) == 2); 
+    CHECK(d.size() == 3); 
+
+    FluidTensor<int, 1> output{-1,-1,-1,-1,-1}; 
+    for(fluid::index i = 0; i < 3; i++)
+    {
+        CHECK(d.get(labels(i),output) == true); 
+        REQUIRE_THAT(output,EqualsRange(points.row(i))); 
+    }
+    REQUIRE_THAT(d.getIds(),EqualsRange(FluidTensor<std::string,1>{"one","zero","two"})); 
+
+    SECTION("and copies only hold the points")
+    {
+        DataSet copy(d.getIds(), d.getData()); 
+        CHECK(copy.size() == 3); 
+        CHECK(copy.capacity() == 3); 
+    }
+}
+
 TEST_CASE("FluidDataSet prints consistent summaries for approval","[FluidDataSet]")
 {
     using namespace ApprovalTests; 
@@ -0,0 +1,196 @@
+#define CATCH_CONFIG_MAIN
+
+#include <catch2/catch.hpp>
+#include <CatchUtils.hpp>
+#include <clients/nrt/KNNClassifierClient.hpp>
+#include <clients/nrt/KNNRegressorClient.hpp>
+#include <data/FluidDataSet.hpp>
+#include <data/FluidJSON.hpp>
+#include <data/FluidTensor.hpp>
+#include <cmath>
+#include <sstream>
+#include <string>
+
+using fluid::EqualsRange;
+using fluid::FluidTensor;
+using fluid::JSONReadResult;
+using DataSet = fluid::FluidDataSet<std::string, double, 1>;
+using LabelSet = fluid::FluidDataSet<std::string, std::string, 1>;
+
+std::string written(DataSet const& ds, int indent)
+{
+  std::ostringstream os;
+  fluid::write_json(os, ds, indent);
+  return os.str();
+}
+
+TEST_CASE("Streamed DataSet JSON matches the JSON tree's output", "[JSON]")
+{
+  FluidTensor<double, 2>      points{{0, 1.5, -2}, {3, 4, 1e-300}, {0.1, 7, 8}};
+  FluidTensor<std::string, 1> ids{"b", "a", "c \"quoted\""};
+  DataSet                     ds(ids, points);
+  nlohmann::json              j = ds;
+
+  CHECK(written(ds, -1) == j.dump());
+  CHECK(written(ds, 2) == j.dump(2));
+  CHECK(written(ds, 4) == j.dump(4));
+
+  SECTION("for LabelSets too")
+  {
+    FluidTensor<std::string, 2> labels{{"x"}, {"y"}, {"\\n"}};
+    LabelSet                    ls(ids, labels);
+    nlohmann::json              lj = ls;
+    std::ostringstream          os;
+    fluid::write_json(os, ls, 2);
+    CHECK(os.str() == lj.dump(2));
+  }
+
+  SECTION("for numbers at the edges of its formatting")
+  {
+    FluidTensor<double, 2> edges{{1e-4, 1e16, -0.0},
+                                 {123456789.125, 1e-5, 5e-324},
+                                 {std::nan(""), 1.0 / 0.0, 42}};
+    DataSet                edgeSet(ids, edges);
+    nlohmann::json         ej = edgeSet;
+    CHECK(written(edgeSet, -1) == ej.dump());
+  }
+}
+
+TEST_CASE("Matrices read back from JSON row by row", "[JSON]")
+{
+  FluidTensor<double, 2>      points{{0, 1.5, -2}, {3, 4, 1e-300}};
+  FluidTensor<std::string, 2> labels{{"x", "y"}, {"z", ""}};
+  nlohmann::json              j = points;
+  nlohmann::json              lj = labels;
+  FluidTensor<double, 2>      pointsBack;
+  FluidTensor<std::string, 2> labelsBack;
+  j.get_to(pointsBack);
+  lj.get_to(labelsBack);
+  REQUIRE_THAT(pointsBack, EqualsRange(points));
+  REQUIRE_THAT(labelsBack, EqualsRange(labels));
+}
+
+TEST_CASE("Streamed DataSet JSON reads back what was written", "[JSON]")
+{
+  FluidTensor<double, 2>      points{{0, 1.5}, {3, 4}, {5, 6}};
+  FluidTensor<std::string, 1> ids{"one", "two", "three"};
+  DataSet                     ds(ids, points);
+  DataSet                     result;
+  REQUIRE(fluid::read_json(written(ds, 2), result) == JSONReadResult::kOK);
+  CHECK(result.size() == 3);
+  CHECK(result.dims() == 2);
+  FluidTensor<double, 1> point(2);
+  for (fluid::index i = 0; i < 3; i++)
+  {
+    CHECK(result.get(ids(i), point));
+    REQUIRE_THAT(point, EqualsRange(points.row(i)));
+  }
+
+  SECTION("in any member order, ignoring unknown members")
+  {
+    std::string text = R"({"data": {"a": [1, 2.5]}, "extra": {"x": [[1]]},
+                           "cols": 2})";
+    REQUIRE(fluid::read_json(text, result) == JSONReadResult::kOK);
+    CHECK(result.size() == 1);
+    CHECK(result.get("a")(1) == 2.5);
+  }
+
+  SECTION("including empty DataSets")
+  {
+    REQUIRE(fluid::read_json(std::string(R"({"cols": 4, "data": {}})"),
+                             result) == JSONReadResult::kOK);
+    CHECK(result.size() == 0);
+    CHECK(result.dims() == 4);
+  }
+
+  SECTION("and LabelSets")
+  {
+    LabelSet labels;
+    REQUIRE(fluid::read_json(std::string(R"({"cols": 1, "data": {"a": ["x"]}})"),
+                             labels) == JSONReadResult::kOK);
+    CHECK(labels.get("a")(0) == "x");
+  }
+}
+
+TEST_CASE("Streamed DataSet JSON rejects malformed input", "[JSON]")
+{
+  FluidTensor<double, 2>      points{{1, 2}};
+  FluidTensor<std::string, 1> ids{"kept"};
+  DataSet                     ds(ids, points);
+
+  auto check = [&](std::string text, JSONReadResult expected) {
+    CHECK(fluid::read_json(text, ds) == expected);
+    CHECK(ds.size() == 1);
+  };
+  check(R"({"cols": 2, "data": {"a": [1, 2)", JSONReadResult::kParseError);
+  check(R"({"cols": 2})", JSONReadResult::kInvalidFormat);
+  check(R"({"data": {"a": [1, 2]}})", JSONReadResult::kInvalidFormat);
+  check(R"({"cols": 3, "data": {"a": [1, 2]}})",
+        JSONReadResult::kInvalidFormat);
+  check(R"({"cols": 2, "data": {"a": [1, 2], "b": [1]}})",
+        JSONReadResult::kInvalidFormat);
+  check(R"({"cols": 2, "data": {"a": [1, "x"]}})",
+        JSONReadResult::kInvalidFormat);
+  check(R"({"cols": 2, "data": {"a": {"b": 1}}})",
+        JSONReadResult::kInvalidFormat);
+  check(R"({"cols": "2", "data": {}})", JSONReadResult::kInvalidFormat);
+  check(R"([1, 2])", JSONReadResult::kInvalidFormat);
+}
+
+TEST_CASE("KNN models whose outputs don't match their tree are rejected",
+          "[JSON]")
+{
+  FluidTensor<double, 2>      points{{0, 0}, {1, 0}, {0, 1}};
+  FluidTensor<std::string, 1> ids{"a", "b", "c"};
+  FluidTensor<std::string, 1> otherIds{"a", "b", "x"};
+  DataSet                     ds(ids, points);
+
+  fluid::client::knnclassifier::KNNClassifierData classifier;
+  fluid::client::knnregressor::KNNRegressorData   regressor;
+  classifier.tree = fluid::algorithm::KDTree(ds);
+  regressor.tree = fluid::algorithm::KDTree(ds);
+
+  SECTION("and load when they do")
+  {
+    classifier.labels = LabelSet(ids, FluidTensor<std::string, 2>(3, 1));
+    regressor.target = DataSet(ids, points);
+    auto classifierText = nlohmann::json(classifier).dump();
+    auto regressorText = nlohmann::json(regressor).dump();
+    CHECK(fluid::read_json(classifierText, classifier) ==
+          JSONReadResult::kOK);
+    CHECK(fluid::read_json(regressorText, regressor) == JSONReadResult::kOK);
+    CHECK(classifier.classes.size() == 3);
+  }
+
+  SECTION("with an error rather than out of range reads")
+  {
+    classifier.labels =
+        LabelSet(otherIds, FluidTensor<std::string, 2>(3, 1));
+    regressor.target = DataSet(otherIds, points);
+    auto classifierText = nlohmann::json(classifier).dump();
+    auto regressorText = nlohmann::json(regressor).dump();
+    CHECK(fluid::read_json(classifierText, classifier) ==
+          JSONReadResult::kInvalidFormat);
+    CHECK(fluid::read_json(regressorText, regressor) ==
+          JSONReadResult::kInvalidFormat);
+  }
+}
+
+TEST_CASE("Search trees whose links are out of range are rejected", "[JSON]")
+{
+  FluidTensor<double, 2>      points{{0, 0}, {1, 0}, {0, 1}};
+  FluidTensor<std::string, 1> ids{"a", "b", "c"};
+  DataSet                     ds(ids, points);
+
+  nlohmann::json tree = fluid::algorithm::KDTree(ds);
+  tree["tree"][0][0] = 3;
+  fluid::algorithm::KDTree treeBack;
+  CHECK(fluid::read_json(tree.dump(), treeBack) ==
+        JSONReadResult::kInvalidFormat);
+
+  nlohmann::json graph = fluid::algorithm::HNSW(ds);
+  graph["base"][0][1] = 3;
+  fluid::algorithm::HNSW graphBack;
+  CHECK(fluid::read_json(graph.dump(), graphBack) ==
+        JSONReadResult::kInvalidFormat);
+}
@@ -0,0 +1,24 @@
+#include "DataSets.hpp"
+#include <data/FluidTensor.hpp>
+#include <random>
+
+namespace fluid {
+namespace testdatasets {
+
+FluidDataSet<std::string, double, 1> uniform(index rows, index cols,
+                                            unsigned seed)
+{
+  std::mt19937                           gen(seed);
+  std::uniform_real_distribution<double> dist(-1.0, 1.0);
+  FluidTensor<std::string, 1>            ids(rows);
+  FluidTensor<double, 2>                 data(rows, cols);
+  for (index i = 0; i < rows; ++i)
+  {
+    ids(i) = std::to_string(i);
+    for (index j = 0; j < cols; ++j) data(i, j) = dist(gen);
+  }
+  return FluidDataSet<std::string, double, 1>(ids, data);
+}
+
+} // namespace testdatasets
+} // namespace fluid
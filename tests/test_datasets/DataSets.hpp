@@ -0,0 +1,16 @@
+#pragma once
+
+#include <data/FluidDataSet.hpp>
+#include <data/FluidIndex.hpp>
+
+#include <string>
+
+namespace fluid {
+namespace testdatasets {
+
+// rows points uniformly distributed in [-1, 1)^cols, with ids "0", "1", ...
+FluidDataSet<std::string, double, 1> uniform(index rows, index cols,
+                                            unsigned seed);
+
+} // namespace testdatasets
+} // namespace fluid